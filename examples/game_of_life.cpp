@@ -89,16 +89,17 @@ int main()
   board[20][22] = true;
 
 
+  // one command to clear the screen instead of a store per pixel
+  cpp_box::Blitter<> blitter;
+
   for (std::uint8_t frame = 0; true; ++frame) {
 //    board = next(board);
-    for (int x = 0; x < disp.width; ++x) {
-      for (int y = 0; y < disp.height; ++y) {
-        if (board[y][x]) {
-          disp.write_pixel(x, y, RGBA{ 255, 255, 255, 255 });
-        } else {
-          disp.write_pixel(x, y, RGBA{ 0, 0, 0, 255 });
-        }
+    blitter.fill_rect(0, 0, disp.width, disp.height, 0xFF000000);
+    for (std::int16_t x = 0; x < disp.width; ++x) {
+      for (std::int16_t y = 0; y < disp.height; ++y) {
+        if (board[y][x]) { blitter.fill_rect(x, y, 1, 1, 0xFFFFFFFF); }
       }
     }
+    blitter.submit();
   }
 }
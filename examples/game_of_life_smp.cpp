@@ -0,0 +1,123 @@
+// Multi core variant of game_of_life.cpp, run with `arm_emu --cores 4`.
+// Every core executes main(), each one computes and draws a band of rows.
+#include <hardware.hpp>
+#include <array>
+
+struct RGBA
+{
+  std::uint8_t R;
+  std::uint8_t G;
+  std::uint8_t B;
+  std::uint8_t A;
+};
+
+struct Display
+{
+  void write_pixel(int x, int y, RGBA val)
+  {
+    cpp_box::poke(1024 * 1024 * 8 + ((y * width) + x) * 4, val);
+  }
+
+  void set_resolution(std::uint16_t width, std::uint16_t height)
+  {
+    cpp_box::poke(4, static_cast<std::uint8_t>(width & 0xff));
+    cpp_box::poke(5, static_cast<std::uint8_t>((width >> 8) & 0xff));
+    cpp_box::poke(6, static_cast<std::uint8_t>(height & 0xff));
+    cpp_box::poke(7, static_cast<std::uint8_t>((height >> 8) & 0xff));
+  }
+
+  Display(std::uint16_t t_width, std::uint16_t t_height)
+    : width{ t_width }, height{ t_height }
+  {
+    set_resolution(width, height);
+  }
+
+  std::uint16_t width{ 128 };
+  std::uint16_t height{ 128 };
+};
+
+constexpr int Size = 64;
+using Board        = std::array<std::array<bool, Size>, Size>;
+
+// globals live in the memory shared by all cores
+Board boards[2];
+cpp_box::Spin_Lock lock;
+volatile std::uint32_t arrived    = 0;
+volatile std::uint32_t generation = 0;
+
+// sense reversing barrier, the last core to arrive releases the others
+void barrier(const std::uint32_t cores)
+{
+  const auto current = generation;
+
+  lock.lock();
+  if (++arrived == cores) {
+    arrived    = 0;
+    generation = current + 1;
+  }
+  lock.unlock();
+
+  while (generation == current) {}
+}
+
+int neighbor_count(const Board &board, const int col, const int row)
+{
+  auto count = 0;
+  for (int cur_row = row - 1; cur_row <= row + 1; ++cur_row) {
+    for (int cur_col = col - 1; cur_col <= col + 1; ++cur_col) {
+      if (cur_row < 0 || cur_row >= Size || cur_col < 0 || cur_col >= Size) { continue; }
+      if (cur_row == row && cur_col == col) { continue; }
+      if (board[cur_row][cur_col]) { ++count; }
+    }
+  }
+  return count;
+}
+
+void next_rows(const Board &last, Board &next, const int first_row, const int end_row)
+{
+  for (int row = first_row; row < end_row; ++row) {
+    for (int col = 0; col < Size; ++col) {
+      const auto num_neighbors = neighbor_count(last, col, row);
+      next[row][col]           = num_neighbors == 3 || (last[row][col] && num_neighbors == 2);
+    }
+  }
+}
+
+int main()
+{
+  const auto core  = cpp_box::Core::id();
+  const auto cores = cpp_box::Core::count();
+
+  const auto first_row = static_cast<int>(core * Size / cores);
+  const auto end_row   = static_cast<int>((core + 1) * Size / cores);
+
+  Display disp{ Size, Size };
+
+  if (core == 0) {
+    // glider
+    boards[0][1][2] = true;
+    boards[0][2][3] = true;
+    boards[0][3][1] = true;
+    boards[0][3][2] = true;
+    boards[0][3][3] = true;
+  }
+
+  for (std::uint32_t frame = 0; true; ++frame) {
+    barrier(cores);
+
+    const auto &last = boards[frame % 2];
+    auto &next       = boards[(frame + 1) % 2];
+
+    for (int y = first_row; y < end_row; ++y) {
+      for (int x = 0; x < Size; ++x) {
+        if (last[y][x]) {
+          disp.write_pixel(x, y, RGBA{ 255, 255, 255, 255 });
+        } else {
+          disp.write_pixel(x, y, RGBA{ 0, 0, 0, 255 });
+        }
+      }
+    }
+
+    next_rows(last, next, first_row, end_row);
+  }
+}
@@ -4,7 +4,11 @@
 #include <algorithm>
 #include <array>
 #include <iterator>
+#include <limits>
+#include <string_view>
 #include <tuple>
+#include <type_traits>
+#include <utility>
 #include <variant>
 
 namespace cpp_box::arm {
@@ -104,6 +108,29 @@ enum class OpCode : std::uint32_t {
 
 enum class Shift_Type : std::uint32_t { Logical_Left = 0b00, Logical_Right = 0b01, Arithmetic_Right = 0b10, Rotate_Right = 0b11 };
 
+// CPSR bits 4-0
+enum class Mode : std::uint32_t {
+  User       = 0b10000,
+  FIQ        = 0b10001,
+  IRQ        = 0b10010,
+  Supervisor = 0b10011,
+  Abort      = 0b10111,
+  Undefined  = 0b11011,
+  System     = 0b11111
+};
+
+// Offsets into the vector table at address 0. Unlike real hardware each entry holds the
+// address of the handler, not a branch instruction to it.
+enum class Exception_Vector : std::uint32_t {
+  Reset              = 0x00,
+  Undefined          = 0x04,
+  Software_Interrupt = 0x08,
+  Prefetch_Abort     = 0x0C,
+  Data_Abort         = 0x10,
+  IRQ                = 0x18,
+  FIQ                = 0x1C
+};
+
 
 struct Instruction : Strongly_Typed<std::uint32_t, Instruction>
 {
@@ -117,6 +144,11 @@ struct Instruction : Strongly_Typed<std::uint32_t, Instruction>
   friend struct Multiply_Long;
   friend struct Branch;
   friend struct Load_And_Store_Multiple;
+  friend struct Coprocessor_Data_Operation;
+  friend struct Coprocessor_Register_Transfer;
+  friend struct Status_Register_Read;
+  friend struct Status_Register_Write;
+  friend struct Single_Data_Swap;
 };
 
 struct Single_Data_Transfer : Strongly_Typed<std::uint32_t, Single_Data_Transfer>
@@ -185,6 +217,45 @@ struct Branch : Strongly_Typed<std::uint32_t, Branch>
   constexpr explicit Branch(Instruction ins) noexcept : Strongly_Typed{ ins.m_val } {}
 };
 
+// SWP / SWPB
+struct Single_Data_Swap : Strongly_Typed<std::uint32_t, Single_Data_Swap>
+{
+  [[nodiscard]] constexpr bool byte_transfer() const noexcept { return test_bit(22); }
+  [[nodiscard]] constexpr auto base_register() const noexcept { return (m_val >> 16) & 0b1111; }
+  [[nodiscard]] constexpr auto destination_register() const noexcept { return (m_val >> 12) & 0b1111; }
+  [[nodiscard]] constexpr auto source_register() const noexcept { return m_val & 0b1111; }
+
+  constexpr explicit Single_Data_Swap(Instruction ins) noexcept : Strongly_Typed{ ins.m_val } {}
+};
+
+// CDP
+struct Coprocessor_Data_Operation : Strongly_Typed<std::uint32_t, Coprocessor_Data_Operation>
+{
+  [[nodiscard]] constexpr auto opcode_1() const noexcept { return (m_val >> 20) & 0b1111; }
+  [[nodiscard]] constexpr auto operand_register_1() const noexcept { return (m_val >> 16) & 0b1111; }
+  [[nodiscard]] constexpr auto destination_register() const noexcept { return (m_val >> 12) & 0b1111; }
+  [[nodiscard]] constexpr auto coprocessor_number() const noexcept { return (m_val >> 8) & 0b1111; }
+  [[nodiscard]] constexpr auto opcode_2() const noexcept { return (m_val >> 5) & 0b111; }
+  [[nodiscard]] constexpr auto operand_register_2() const noexcept { return m_val & 0b1111; }
+
+  constexpr explicit Coprocessor_Data_Operation(Instruction ins) noexcept : Strongly_Typed{ ins.m_val } {}
+};
+
+// MCR / MRC
+struct Coprocessor_Register_Transfer : Strongly_Typed<std::uint32_t, Coprocessor_Register_Transfer>
+{
+  [[nodiscard]] constexpr auto opcode_1() const noexcept { return (m_val >> 21) & 0b111; }
+  // MRC, coprocessor register -> ARM register
+  [[nodiscard]] constexpr bool load() const noexcept { return test_bit(20); }
+  [[nodiscard]] constexpr auto coprocessor_register() const noexcept { return (m_val >> 16) & 0b1111; }
+  [[nodiscard]] constexpr auto arm_register() const noexcept { return (m_val >> 12) & 0b1111; }
+  [[nodiscard]] constexpr auto coprocessor_number() const noexcept { return (m_val >> 8) & 0b1111; }
+  [[nodiscard]] constexpr auto opcode_2() const noexcept { return (m_val >> 5) & 0b111; }
+  [[nodiscard]] constexpr auto operand_register() const noexcept { return m_val & 0b1111; }
+
+  constexpr explicit Coprocessor_Register_Transfer(Instruction ins) noexcept : Strongly_Typed{ ins.m_val } {}
+};
+
 
 struct Data_Processing : Strongly_Typed<std::uint32_t, Data_Processing>
 {
@@ -222,6 +293,39 @@ struct Data_Processing : Strongly_Typed<std::uint32_t, Data_Processing>
   constexpr explicit Data_Processing(Instruction ins) noexcept : Strongly_Typed{ ins.m_val } {}
 };
 
+// MRS
+struct Status_Register_Read : Strongly_Typed<std::uint32_t, Status_Register_Read>
+{
+  [[nodiscard]] constexpr bool saved_status() const noexcept { return test_bit(22); }
+  [[nodiscard]] constexpr auto destination_register() const noexcept { return (m_val >> 12) & 0b1111; }
+
+  constexpr explicit Status_Register_Read(Instruction ins) noexcept : Strongly_Typed{ ins.m_val } {}
+};
+
+// MSR, any combination of the control, extension, status and flags fields
+struct Status_Register_Write : Strongly_Typed<std::uint32_t, Status_Register_Write>
+{
+  [[nodiscard]] constexpr bool immediate_operand() const noexcept { return test_bit(25); }
+  [[nodiscard]] constexpr bool saved_status() const noexcept { return test_bit(22); }
+  [[nodiscard]] constexpr auto field_mask() const noexcept { return (m_val >> 16) & 0b1111; }
+  [[nodiscard]] constexpr auto source_register() const noexcept { return m_val & 0b1111; }
+
+  // same rotated immediate encoding as data processing
+  [[nodiscard]] constexpr auto operand_immediate() const noexcept { return Data_Processing{ Instruction{ m_val } }.operand_2_immediate(); }
+
+  // one byte of the status register per bit of the field mask
+  [[nodiscard]] constexpr std::uint32_t byte_mask() const noexcept
+  {
+    std::uint32_t mask = 0;
+    for (std::uint32_t field = 0; field < 4; ++field) {
+      if (cpp_box::arm::test_bit(field_mask(), field)) { mask |= 0xFFu << (field * 8); }
+    }
+    return mask;
+  }
+
+  constexpr explicit Status_Register_Write(Instruction ins) noexcept : Strongly_Typed{ ins.m_val } {}
+};
+
 
 enum class Instruction_Type {
   Data_Processing,
@@ -242,6 +346,29 @@ enum class Instruction_Type {
   Load_And_Store_Multiple
 };
 
+constexpr std::size_t instruction_type_count = static_cast<std::size_t>(Instruction_Type::Load_And_Store_Multiple) + 1;
+
+[[nodiscard]] constexpr std::string_view to_string(const Instruction_Type type) noexcept
+{
+  constexpr std::array<std::string_view, instruction_type_count> names{ "Data_Processing",
+                                                                        "MRS",
+                                                                        "MSR",
+                                                                        "MSRF",
+                                                                        "Multiply",
+                                                                        "Multiply_Long",
+                                                                        "Single_Data_Swap",
+                                                                        "Single_Data_Transfer",
+                                                                        "Undefined",
+                                                                        "Block_Data_Transfer",
+                                                                        "Branch",
+                                                                        "Coprocessor_Data_Transfer",
+                                                                        "Coprocessor_Data_Operation",
+                                                                        "Coprocessor_Register_Transfer",
+                                                                        "Software_Interrupt",
+                                                                        "Load_And_Store_Multiple" };
+  return names[static_cast<std::size_t>(type)];
+}
+
 struct Lookup_Table
 {
   std::uint32_t mask;
@@ -272,9 +399,9 @@ struct Lookup_Table
   // ARMv3  http://netwinder.osuosl.org/pub/netwinder/docs/arm/ARM7500FEvB_3.pdf
   std::array<Lookup_Table, 16> table{
     { { 0b0000'1100'0000'0000'0000'0000'0000'0000, 0b0000'0000'0000'0000'0000'0000'0000'0000, Instruction_Type::Data_Processing },
-      { 0b0000'1111'1011'1111'0000'1111'1111'1111, 0b0000'0001'0000'1111'0000'1111'1111'1111, Instruction_Type::MRS },
-      { 0b0000'1111'1011'1111'1111'1111'1111'0000, 0b0000'0001'0010'1001'1111'0000'0000'0000, Instruction_Type::MSR },
-      { 0b0000'1101'1011'1111'1111'0000'0000'0000, 0b0000'0001'0010'1000'1111'0000'0000'0000, Instruction_Type::MSRF },
+      { 0b0000'1111'1011'1111'0000'1111'1111'1111, 0b0000'0001'0000'1111'0000'0000'0000'0000, Instruction_Type::MRS },
+      { 0b0000'1111'1011'0000'1111'1111'1111'0000, 0b0000'0001'0010'0000'1111'0000'0000'0000, Instruction_Type::MSR },
+      { 0b0000'1101'1011'0000'1111'0000'0000'0000, 0b0000'0001'0010'0000'1111'0000'0000'0000, Instruction_Type::MSRF },
       { 0b0000'1111'1100'0000'0000'0000'1111'0000, 0b0000'0000'0000'0000'0000'0000'1001'0000, Instruction_Type::Multiply },
       { 0b0000'1111'1000'0000'0000'0000'1111'0000, 0b0000'0000'1000'0000'0000'0000'1001'0000, Instruction_Type::Multiply_Long },
       { 0b0000'1111'1011'0000'0000'1111'1111'0000, 0b0000'0001'0000'0000'0000'0000'1001'0000, Instruction_Type::Single_Data_Swap },
@@ -298,21 +425,388 @@ struct Lookup_Table
   return table;
 }
 
+// Accesses to addresses for which is_mmio_range is true are forwarded to the device instead of RAM.
+// event() is called with the id of every event the device put on System::scheduler once it is due.
 struct NO_MMIO
 {
   [[nodiscard]] constexpr bool is_mmio_range([[maybe_unused]] const std::uint32_t loc) const noexcept { return false; }
-  [[nodiscard]] constexpr std::uint32_t read_word([[maybe_unused]] const std::uint32_t loc) const noexcept { return 0; }
-  [[nodiscard]] constexpr std::uint16_t read_half_word([[maybe_unused]] const std::uint32_t loc) const noexcept { return 0; }
-  [[nodiscard]] constexpr std::uint8_t read_byte([[maybe_unused]] const std::uint32_t loc) const noexcept { return 0; }
+  template<typename System>
+  [[nodiscard]] constexpr std::uint32_t read_word([[maybe_unused]] const System &sys, [[maybe_unused]] const std::uint32_t loc) const noexcept
+  {
+    return 0;
+  }
+  template<typename System>
+  [[nodiscard]] constexpr std::uint16_t read_half_word([[maybe_unused]] const System &sys, [[maybe_unused]] const std::uint32_t loc) const noexcept
+  {
+    return 0;
+  }
+  template<typename System>
+  [[nodiscard]] constexpr std::uint8_t read_byte([[maybe_unused]] const System &sys, [[maybe_unused]] const std::uint32_t loc) const noexcept
+  {
+    return 0;
+  }
+  template<typename System>
+  constexpr void write_word([[maybe_unused]] System &sys,
+                            [[maybe_unused]] const std::uint32_t loc,
+                            [[maybe_unused]] const std::uint32_t value) noexcept
+  {
+  }
+  template<typename System>
+  constexpr void write_half_word([[maybe_unused]] System &sys,
+                                 [[maybe_unused]] const std::uint32_t loc,
+                                 [[maybe_unused]] const std::uint16_t value) noexcept
+  {
+  }
+  template<typename System>
+  constexpr void write_byte([[maybe_unused]] System &sys,
+                            [[maybe_unused]] const std::uint32_t loc,
+                            [[maybe_unused]] const std::uint8_t value) noexcept
+  {
+  }
+  template<typename System> constexpr void event([[maybe_unused]] System &sys, [[maybe_unused]] const std::uint32_t id) noexcept {}
+};
+
+// Events due at a given cycle. Few events are ever pending, so they are kept unsorted
+// with the earliest due cycle cached; checking for due events is a single compare.
+struct Scheduler
+{
+  struct Event
+  {
+    std::uint64_t due{ 0 };
+    std::uint32_t id{ 0 };
+  };
+
+  constexpr static std::size_t capacity = 16;
+  constexpr static auto never           = std::numeric_limits<std::uint64_t>::max();
+
+  std::uint64_t cycle{ 0 };
+
+  [[nodiscard]] constexpr bool empty() const noexcept { return count == 0; }
+  [[nodiscard]] constexpr bool due() const noexcept { return cycle >= next_due; }
+  [[nodiscard]] constexpr std::uint64_t next_event() const noexcept { return next_due; }
+
+  // the pending events, unordered. Scheduling them again in this order restores the scheduler
+  [[nodiscard]] constexpr std::size_t size() const noexcept { return count; }
+  [[nodiscard]] constexpr const Event &event(const std::size_t idx) const noexcept { return events[idx]; }
+
+  // returns false if all event slots are in use
+  constexpr bool schedule(const std::uint64_t due_cycle, const std::uint32_t id) noexcept
+  {
+    if (count == events.size()) { return false; }
+    events[count++] = Event{ due_cycle, id };
+    next_due        = std::min(next_due, due_cycle);
+    return true;
+  }
+
+  constexpr void cancel(const std::uint32_t id) noexcept
+  {
+    for (std::size_t idx = 0; idx < count;) {
+      if (events[idx].id == id) {
+        events[idx] = events[--count];
+      } else {
+        ++idx;
+      }
+    }
+    update_next_due();
+  }
+
+  // removes and returns the earliest event, must not be empty()
+  constexpr Event pop() noexcept
+  {
+    std::size_t earliest = 0;
+    for (std::size_t idx = 1; idx < count; ++idx) {
+      if (events[idx].due < events[earliest].due) { earliest = idx; }
+    }
+
+    const auto event = events[earliest];
+    events[earliest] = events[--count];
+    update_next_due();
+    return event;
+  }
+
+private:
+  constexpr void update_next_due() noexcept
+  {
+    next_due = never;
+    for (std::size_t idx = 0; idx < count; ++idx) { next_due = std::min(next_due, events[idx].due); }
+  }
+
+  std::array<Event, capacity> events{};
+  std::size_t count{ 0 };
+  std::uint64_t next_due{ never };
 };
 
-template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_t, RAM_Size>, typename MMIO_Callback = NO_MMIO> struct System
+// Level triggered interrupt request lines, driven by the devices
+struct Interrupt_Lines
 {
-  std::uint32_t CSPR{};
+  bool irq{ false };
+  bool fiq{ false };
+};
+
+// Coprocessors are looked up by number, a CDP/MCR/MRC for a number that
+// reports false from has_coprocessor is an unhandled instruction
+struct NO_COPROCESSOR
+{
+  [[nodiscard]] constexpr bool has_coprocessor([[maybe_unused]] const std::uint32_t number) const noexcept { return false; }
+  template<typename System>
+  constexpr void data_operation([[maybe_unused]] System &sys, [[maybe_unused]] const Coprocessor_Data_Operation op) noexcept
+  {
+  }
+  template<typename System>
+  [[nodiscard]] constexpr std::uint32_t read_register([[maybe_unused]] System &sys, [[maybe_unused]] const Coprocessor_Register_Transfer op) noexcept
+  {
+    return 0;
+  }
+  template<typename System>
+  constexpr void write_register([[maybe_unused]] System &sys,
+                                [[maybe_unused]] const Coprocessor_Register_Transfer op,
+                                [[maybe_unused]] const std::uint32_t value) noexcept
+  {
+  }
+};
+
+// Sees the instruction fetches and data accesses of a core, eg to simulate caches. Every hook returns the
+// cycles the access stalled the core, which are added to the Cycle_Model estimate. `pc` is the address of
+// the instruction doing the access. The default observes nothing and compiles away entirely.
+struct NO_OBSERVER
+{
+  template<typename System>
+  [[nodiscard]] constexpr std::uint32_t fetch([[maybe_unused]] const System &sys, [[maybe_unused]] const std::uint32_t pc) noexcept
+  {
+    return 0;
+  }
+  template<typename System>
+  [[nodiscard]] constexpr std::uint32_t access([[maybe_unused]] const System &sys,
+                                               [[maybe_unused]] const std::uint32_t pc,
+                                               [[maybe_unused]] const std::uint32_t loc,
+                                               [[maybe_unused]] const std::uint32_t size,
+                                               [[maybe_unused]] const bool write) noexcept
+  {
+    return 0;
+  }
+};
+
+// RAM_Types shared between cores provide exchange(loc, value, byte), so that SWP is atomic across host threads
+template<typename RAM, typename = void> struct Has_Exchange : std::false_type
+{
+};
+
+template<typename RAM>
+struct Has_Exchange<RAM, std::void_t<decltype(std::declval<RAM &>().exchange(std::uint32_t{}, std::uint32_t{}, bool{}))>> : std::true_type
+{
+};
+
+// and load<Value>(loc) / store<Value>(loc, value), which the guest's loads and stores go through
+template<typename RAM, typename = void> struct Has_Atomic_Access : std::false_type
+{
+};
+
+template<typename RAM>
+struct Has_Atomic_Access<RAM,
+                         std::void_t<decltype(std::declval<const RAM &>().template load<std::uint32_t>(std::uint32_t{})),
+                                     decltype(std::declval<RAM &>().template store<std::uint32_t>(std::uint32_t{}, std::uint32_t{}))>>
+  : std::true_type
+{
+};
+
+// tag of the System constructor taking RAM that is already set up, eg the Shared_Memory of another core
+struct Existing_RAM
+{
+};
+
+template<std::size_t RAM_Size          = 1024,
+         typename RAM_Type             = std::array<std::uint8_t, RAM_Size>,
+         typename MMIO_Callback        = NO_MMIO,
+         typename Coprocessor_Callback = NO_COPROCESSOR,
+         typename Memory_Observer      = NO_OBSERVER>
+struct System
+{
+  constexpr static std::uint32_t i_bit     = 0b1000'0000;
+  constexpr static std::uint32_t f_bit     = 0b0100'0000;
+  constexpr static std::uint32_t mode_mask = 0b1'1111;
+
+  // privileged, IRQ and FIQ masked until the guest enables them
+  std::uint32_t CSPR{ static_cast<std::uint32_t>(Mode::System) | i_bit | f_bit };
 
   std::array<std::uint32_t, 16> registers{};
   bool invalid_memory_write{ false };
 
+  // registers of the modes that are not current
+  struct Banked_Registers
+  {
+    std::array<std::uint32_t, 5> user_r8_r12{};
+    std::array<std::uint32_t, 5> fiq_r8_r12{};
+    // r13 and r14 for User/System, FIQ, IRQ, Supervisor, Abort, Undefined
+    std::array<std::array<std::uint32_t, 2>, 6> r13_r14{};
+    // User/System has no SPSR, slot 0 is unused
+    std::array<std::uint32_t, 6> spsr{};
+  };
+
+  Banked_Registers banked{};
+
+  Scheduler scheduler{};
+  Interrupt_Lines interrupts{};
+  bool waiting_for_interrupt{ false };
+  std::uint64_t idle_cycles{ 0 };  // cycles skipped over while waiting for an interrupt
+  std::uint64_t instructions{ 0 };
+  std::uint64_t cycle_limit{ Scheduler::never };  // time is never skipped past this, see run_until
+
+  // mix of the retired instructions, exposed to the guest by devices::Pmu
+  struct Counters
+  {
+    std::uint64_t loads{ 0 };  // SWP counts as a load and a store
+    std::uint64_t stores{ 0 };
+    std::uint64_t branches_taken{ 0 };  // any instruction that did not continue with the next one
+  };
+
+  Counters counters{};
+
+  // what the interpreter itself did, to compare changes to it, see arm_emu --stats
+  struct Statistics
+  {
+    std::array<std::uint64_t, instruction_type_count> executed{};  // per Instruction_Type, including those whose condition failed
+    std::uint64_t condition_failed{ 0 };
+    std::uint64_t i_cache_refills{ 0 };  // every other instruction fetch hit the decoded instruction cache
+    std::uint64_t memory_reads{ 0 };  // data accesses, every word of an LDM or STM counts
+    std::uint64_t memory_writes{ 0 };
+    std::uint64_t mmio_accesses{ 0 };  // the reads and writes that went to a device
+
+    [[nodiscard]] constexpr std::uint64_t fetches() const noexcept
+    {
+      std::uint64_t total = 0;
+      for (const auto count : executed) { total += count; }
+      return total;
+    }
+
+    [[nodiscard]] constexpr std::uint64_t i_cache_hits() const noexcept { return fetches() - i_cache_refills; }
+
+    // adds what was counted since `since` another `times` times
+    constexpr void repeat(const Statistics &since, const std::uint64_t times) noexcept
+    {
+      for (std::size_t type = 0; type < executed.size(); ++type) { executed[type] += times * (executed[type] - since.executed[type]); }
+      condition_failed += times * (condition_failed - since.condition_failed);
+      i_cache_refills += times * (i_cache_refills - since.i_cache_refills);
+      memory_reads += times * (memory_reads - since.memory_reads);
+      memory_writes += times * (memory_writes - since.memory_writes);
+      mmio_accesses += times * (mmio_accesses - since.mmio_accesses);
+    }
+  };
+
+  Statistics statistics{};
+
+  // Estimated ARM7TDMI timing, following the S/N/I/C cycle counts of its data sheet: each instruction takes
+  // S(equential) and N(on-sequential) memory cycles, I(nternal) and C(oprocessor) cycles, and a taken branch
+  // refills the pipeline with 1N + 1S. Memory cycles also cost the wait states of the region accessed.
+  // Only estimates, cycles() and the scheduler keep counting one cycle per instruction.
+  struct Cycle_Model
+  {
+    constexpr static std::size_t max_regions = 8;
+
+    // extra cycles of each access to [begin, end)
+    struct Wait_States
+    {
+      std::uint32_t begin{ 0 };
+      std::uint32_t end{ 0 };
+      std::uint32_t sequential{ 0 };
+      std::uint32_t non_sequential{ 0 };
+    };
+
+    struct Totals
+    {
+      std::uint64_t sequential{ 0 };
+      std::uint64_t non_sequential{ 0 };
+      std::uint64_t internal{ 0 };
+      std::uint64_t coprocessor{ 0 };
+      std::uint64_t wait_states{ 0 };
+      std::uint64_t stalls{ 0 };  // reported by the Memory_Observer, eg cache misses
+
+      [[nodiscard]] constexpr std::uint64_t cycles() const noexcept
+      {
+        return sequential + non_sequential + internal + coprocessor + wait_states + stalls;
+      }
+
+      // adds what was counted since `since` another `times` times
+      constexpr void repeat(const Totals &since, const std::uint64_t times) noexcept
+      {
+        sequential += times * (sequential - since.sequential);
+        non_sequential += times * (non_sequential - since.non_sequential);
+        internal += times * (internal - since.internal);
+        coprocessor += times * (coprocessor - since.coprocessor);
+        wait_states += times * (wait_states - since.wait_states);
+        stalls += times * (stalls - since.stalls);
+      }
+    };
+
+    bool enabled{ false };
+    std::array<Wait_States, max_regions> regions{};
+    std::size_t region_count{ 0 };
+    Totals totals{};
+
+    // later regions take precedence where they overlap, returns false if all are in use
+    constexpr bool add_region(const Wait_States region) noexcept
+    {
+      if (region_count == regions.size()) { return false; }
+      regions[region_count++] = region;
+      return true;
+    }
+
+    [[nodiscard]] constexpr Wait_States wait_states(const std::uint32_t address) const noexcept
+    {
+      for (auto idx = region_count; idx > 0; --idx) {
+        if (address >= regions[idx - 1].begin && address < regions[idx - 1].end) { return regions[idx - 1]; }
+      }
+      return {};
+    }
+
+    constexpr void sequential(const std::uint32_t address, const std::uint32_t count = 1) noexcept
+    {
+      totals.sequential += count;
+      totals.wait_states += std::uint64_t{ count } * wait_states(address).sequential;
+    }
+
+    constexpr void non_sequential(const std::uint32_t address) noexcept
+    {
+      ++totals.non_sequential;
+      totals.wait_states += wait_states(address).non_sequential;
+    }
+
+    constexpr void internal(const std::uint32_t count = 1) noexcept { totals.internal += count; }
+    constexpr void coprocessor() noexcept { ++totals.coprocessor; }
+
+    constexpr void refill(const std::uint32_t address) noexcept
+    {
+      non_sequential(address);
+      sequential(address);
+    }
+  };
+
+  Cycle_Model cycle_model{};
+
+  // A short backward branch that is taken twice with identical registers and flags, and no memory or
+  // coprocessor writes in between, is a loop polling for a change only a scheduled event can make.
+  // When enabled such loops are skipped ahead in whole iterations, up to the next event or cycle_limit.
+  struct Idle_Loop_Detector
+  {
+    constexpr static std::int32_t max_loop_size = 64;
+
+    bool side_effect{ false };
+    bool tracking{ false };
+    std::uint32_t branch{ 0 };
+    std::uint32_t CSPR{ 0 };
+    std::array<std::uint32_t, 16> registers{};
+    std::uint64_t cycle{ 0 };
+    std::uint64_t instructions{ 0 };
+    Counters counters{};
+    Statistics statistics{};
+    typename Cycle_Model::Totals cycle_totals{};
+
+    std::uint64_t skipped_cycles{ 0 };
+    std::uint64_t skipped_instructions{ 0 };  // counted in System::instructions, but not executed
+  };
+
+  bool skip_idle_loops{ false };
+  Idle_Loop_Detector idle_loop{};
+
   [[nodiscard]] constexpr auto &SP() noexcept { return registers[13]; }
   [[nodiscard]] constexpr const auto &SP() const noexcept { return registers[13]; }
 
@@ -322,6 +816,118 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
   [[nodiscard]] constexpr auto &PC() noexcept { return registers[15]; }
   [[nodiscard]] constexpr const auto &PC() const noexcept { return registers[15]; }
 
+  [[nodiscard]] constexpr Mode mode() const noexcept { return static_cast<Mode>(CSPR & mode_mask); }
+  [[nodiscard]] constexpr std::uint64_t cycles() const noexcept { return scheduler.cycle; }
+  [[nodiscard]] constexpr std::uint64_t estimated_cycles() const noexcept { return cycle_model.totals.cycles(); }
+
+  [[nodiscard]] constexpr static std::size_t bank(const Mode mode) noexcept
+  {
+    switch (mode) {
+    case Mode::FIQ: return 1;
+    case Mode::IRQ: return 2;
+    case Mode::Supervisor: return 3;
+    case Mode::Abort: return 4;
+    case Mode::Undefined: return 5;
+    case Mode::User:
+    case Mode::System: return 0;
+    }
+    return 0;
+  }
+
+  [[nodiscard]] constexpr bool has_saved_status() const noexcept { return bank(mode()) != 0; }
+  [[nodiscard]] constexpr auto &SPSR() noexcept { return banked.spsr[bank(mode())]; }
+  [[nodiscard]] constexpr const auto &SPSR() const noexcept { return banked.spsr[bank(mode())]; }
+
+  // swaps the banked registers in, only changes the mode bits of CPSR
+  constexpr void switch_mode(const Mode new_mode) noexcept
+  {
+    const auto old_mode = mode();
+    CSPR                = (CSPR & ~mode_mask) | static_cast<std::uint32_t>(new_mode);
+    if (bank(old_mode) == bank(new_mode)) { return; }
+
+    banked.r13_r14[bank(old_mode)] = { registers[13], registers[14] };
+
+    const auto swap_r8_r12 = [this](auto &save_to, const auto &load_from) {
+      for (std::size_t idx = 0; idx < save_to.size(); ++idx) {
+        save_to[idx]       = registers[idx + 8];
+        registers[idx + 8] = load_from[idx];
+      }
+    };
+
+    if (old_mode == Mode::FIQ) {
+      swap_r8_r12(banked.fiq_r8_r12, banked.user_r8_r12);
+    } else if (new_mode == Mode::FIQ) {
+      swap_r8_r12(banked.user_r8_r12, banked.fiq_r8_r12);
+    }
+
+    registers[13] = banked.r13_r14[bank(new_mode)][0];
+    registers[14] = banked.r13_r14[bank(new_mode)][1];
+  }
+
+  constexpr void write_status(const std::uint32_t status) noexcept
+  {
+    switch_mode(static_cast<Mode>(status & mode_mask));
+    CSPR = status;
+  }
+
+  // exception return, CPSR = SPSR
+  constexpr void restore_saved_status() noexcept
+  {
+    if (has_saved_status()) { write_status(SPSR()); }
+  }
+
+  constexpr void enter_exception(const Mode new_mode, const Exception_Vector vector, const bool disable_fiq) noexcept
+  {
+    const auto return_status = CSPR;
+    // PC() is 4 past the next instruction already, handlers return with SUBS PC, LR, #4
+    const auto return_address = PC() + 4;
+
+    switch_mode(new_mode);
+    SPSR() = return_status;
+    LR()   = return_address;
+    CSPR |= i_bit;
+    if (disable_fiq) { CSPR |= f_bit; }
+
+    PC() = read_word(static_cast<std::uint32_t>(vector)) + 4;
+  }
+
+  [[nodiscard]] constexpr bool fiq_pending() const noexcept { return interrupts.fiq && (CSPR & f_bit) == 0; }
+  [[nodiscard]] constexpr bool irq_pending() const noexcept { return interrupts.irq && (CSPR & i_bit) == 0; }
+
+  // halts the core until an interrupt line is raised, masked or not
+  constexpr void wait_for_interrupt() noexcept { waiting_for_interrupt = true; }
+
+  // waiting and nothing is scheduled that could ever raise an interrupt
+  [[nodiscard]] constexpr bool stalled() const noexcept
+  {
+    return waiting_for_interrupt && !interrupts.irq && !interrupts.fiq && scheduler.empty();
+  }
+
+  constexpr void dispatch_events() noexcept
+  {
+    while (!scheduler.empty() && scheduler.due()) { mmio_callback.event(*this, scheduler.pop().id); }
+  }
+
+  // Instead of executing idle cycles the clock jumps straight to the next scheduled event.
+  // Returns true once the core is awake again.
+  constexpr bool wake_up() noexcept
+  {
+    if (!interrupts.irq && !interrupts.fiq) {
+      if (scheduler.empty()) { return false; }
+
+      if (const auto next = std::min(scheduler.next_event(), cycle_limit); next > scheduler.cycle) {
+        idle_cycles += next - scheduler.cycle;
+        scheduler.cycle = next;
+      }
+      dispatch_events();
+
+      if (!interrupts.irq && !interrupts.fiq) { return false; }
+    }
+
+    waiting_for_interrupt = false;
+    return true;
+  }
+
   struct ROM_Block
   {
     bool in_use{ false };
@@ -345,6 +951,15 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
 
   RAM_Type builtin_ram{ init_ram(builtin_ram) };  // just passing ourselves in to resolve the type
   MMIO_Callback mmio_callback{};
+  Coprocessor_Callback coprocessors{};
+  Memory_Observer memory_observer{};
+
+  // data access of the instruction being processed, PC() is 8 past it
+  constexpr void observe_access(const std::uint32_t loc, const std::uint32_t size, const bool write) noexcept
+  {
+    ++(write ? statistics.memory_writes : statistics.memory_reads);
+    cycle_model.totals.stalls += memory_observer.access(*this, PC() - 8, loc, size, write);
+  }
 
   constexpr void unhandled_instruction([[maybe_unused]] const Instruction ins, [[maybe_unused]] const Instruction_Type type) { abort(); }
 
@@ -352,19 +967,38 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
   // read past end of allocated memory will return an unspecified value
   [[nodiscard]] constexpr std::uint8_t read_byte(const std::uint32_t loc) const noexcept
   {
-    if (mmio_callback.is_mmio_range(loc)) { return mmio_callback.read_byte(loc); }
+    if (mmio_callback.is_mmio_range(loc)) { return mmio_callback.read_byte(*this, loc); }
+    return read_ram_byte(loc);
+  }
 
+  constexpr void write_byte(const std::uint32_t loc, const std::uint8_t value) noexcept
+  {
+    idle_loop.side_effect = true;
+    if (mmio_callback.is_mmio_range(loc)) { return mmio_callback.write_byte(*this, loc, value); }
+    write_ram_byte(loc, value);
+  }
+
+  [[nodiscard]] constexpr std::uint8_t read_ram_byte(const std::uint32_t loc) const noexcept
+  {
     if (loc < RAM_Size) {
-      return builtin_ram[loc];
+      if constexpr (Has_Atomic_Access<RAM_Type>::value) {
+        return builtin_ram.template load<std::uint8_t>(loc);
+      } else {
+        return builtin_ram[loc];
+      }
     } else {
       return {};
     }
   }
 
-  constexpr void write_byte(const std::uint32_t loc, const std::uint8_t value) noexcept
+  constexpr void write_ram_byte(const std::uint32_t loc, const std::uint8_t value) noexcept
   {
     if (loc < RAM_Size) {
-      builtin_ram[loc] = value;
+      if constexpr (Has_Atomic_Access<RAM_Type>::value) {
+        builtin_ram.store(loc, value);
+      } else {
+        builtin_ram[loc] = value;
+      }
     } else {
       invalid_memory_write = true;
     }
@@ -373,7 +1007,12 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
   // read past end of allocated memory will return an unspecified value
   [[nodiscard]] constexpr std::uint16_t read_half_word(const std::uint32_t loc) const noexcept
   {
-    if (mmio_callback.is_mmio_range(loc)) { return mmio_callback.read_half_word(loc); }
+    if (mmio_callback.is_mmio_range(loc)) { return mmio_callback.read_half_word(*this, loc); }
+
+    if constexpr (Has_Atomic_Access<RAM_Type>::value) {
+      if (loc + 1 < RAM_Size) { return builtin_ram.template load<std::uint16_t>(loc); }
+      return {};
+    }
 
     const std::uint8_t *data = [&]() -> const std::uint8_t * {
       if (loc + 1 < RAM_Size) { return &builtin_ram[loc]; }
@@ -394,7 +1033,16 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
   // read past end of allocated memory will return an unspecified value
   [[nodiscard]] constexpr std::uint32_t read_word(const std::uint32_t loc) const noexcept
   {
-    if (mmio_callback.is_mmio_range(loc)) { return mmio_callback.read_word(loc); }
+    if (mmio_callback.is_mmio_range(loc)) { return mmio_callback.read_word(*this, loc); }
+    return read_ram_word(loc);
+  }
+
+  [[nodiscard]] constexpr std::uint32_t read_ram_word(const std::uint32_t loc) const noexcept
+  {
+    if constexpr (Has_Atomic_Access<RAM_Type>::value) {
+      if (loc + 3 < RAM_Size) { return builtin_ram.template load<std::uint32_t>(loc); }
+      return {};
+    }
 
     const std::uint8_t *data = [&]() -> const std::uint8_t * {
       if (loc + 3 < RAM_Size) { return &builtin_ram[loc]; }
@@ -415,6 +1063,18 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
 
   constexpr void write_half_word(const std::uint32_t loc, const std::uint16_t value) noexcept
   {
+    idle_loop.side_effect = true;
+    if (mmio_callback.is_mmio_range(loc)) { return mmio_callback.write_half_word(*this, loc, value); }
+
+    if constexpr (Has_Atomic_Access<RAM_Type>::value) {
+      if (loc + 1 < RAM_Size) {
+        builtin_ram.store(loc, value);
+      } else {
+        invalid_memory_write = true;
+      }
+      return;
+    }
+
     auto *data = [&]() -> std::uint8_t * {
       if (loc + 1 <= RAM_Size) { return &builtin_ram[loc]; }
       return nullptr;
@@ -430,6 +1090,22 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
 
   constexpr void write_word(const std::uint32_t loc, const std::uint32_t value) noexcept
   {
+    idle_loop.side_effect = true;
+    if (mmio_callback.is_mmio_range(loc)) { return mmio_callback.write_word(*this, loc, value); }
+    write_ram_word(loc, value);
+  }
+
+  constexpr void write_ram_word(const std::uint32_t loc, const std::uint32_t value) noexcept
+  {
+    if constexpr (Has_Atomic_Access<RAM_Type>::value) {
+      if (loc + 3 < RAM_Size) {
+        builtin_ram.store(loc, value);
+      } else {
+        invalid_memory_write = true;
+      }
+      return;
+    }
+
     auto *data = [&]() -> std::uint8_t * {
       if (loc + 3 <= RAM_Size) { return &builtin_ram[loc]; }
       return nullptr;
@@ -445,6 +1121,65 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
     }
   }
 
+  // Data accesses of instructions, those that go to a device are counted while it is looked up anyway
+  [[nodiscard]] constexpr std::uint8_t data_read_byte(const std::uint32_t loc) noexcept
+  {
+    if (mmio_callback.is_mmio_range(loc)) {
+      ++statistics.mmio_accesses;
+      return mmio_callback.read_byte(*this, loc);
+    }
+    return read_ram_byte(loc);
+  }
+
+  [[nodiscard]] constexpr std::uint32_t data_read_word(const std::uint32_t loc) noexcept
+  {
+    if (mmio_callback.is_mmio_range(loc)) {
+      ++statistics.mmio_accesses;
+      return mmio_callback.read_word(*this, loc);
+    }
+    return read_ram_word(loc);
+  }
+
+  constexpr void data_write_byte(const std::uint32_t loc, const std::uint8_t value) noexcept
+  {
+    idle_loop.side_effect = true;
+    if (mmio_callback.is_mmio_range(loc)) {
+      ++statistics.mmio_accesses;
+      return mmio_callback.write_byte(*this, loc, value);
+    }
+    write_ram_byte(loc, value);
+  }
+
+  constexpr void data_write_word(const std::uint32_t loc, const std::uint32_t value) noexcept
+  {
+    idle_loop.side_effect = true;
+    if (mmio_callback.is_mmio_range(loc)) {
+      ++statistics.mmio_accesses;
+      return mmio_callback.write_word(*this, loc, value);
+    }
+    write_ram_word(loc, value);
+  }
+
+  // SWP, the read and write are one operation
+  constexpr std::uint32_t exchange(const std::uint32_t loc, const std::uint32_t value, const bool byte) noexcept
+  {
+    idle_loop.side_effect = true;
+
+    if constexpr (Has_Exchange<RAM_Type>::value) {
+      if (!mmio_callback.is_mmio_range(loc) && loc + 3 < RAM_Size) { return builtin_ram.exchange(loc, value, byte); }
+    }
+
+    if (byte) {
+      const auto previous = data_read_byte(loc);
+      data_write_byte(loc, static_cast<std::uint8_t>(value & 0xFF));
+      return previous;
+    } else {
+      const auto previous = data_read_word(loc);
+      data_write_word(loc, value);
+      return previous;
+    }
+  }
+
   constexpr System &operator=(System &&) noexcept = default;
   ~System()                                       = default;
   constexpr System(const System &)                = default;
@@ -475,6 +1210,9 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
     i_cache.fill_cache(*this);
   }
 
+  // RAM_Type is not default constructed and filled, ram is used as it is
+  constexpr System(Existing_RAM /*tag*/, RAM_Type ram) noexcept : builtin_ram{ std::move(ram) } { i_cache.fill_cache(*this); }
+
   [[nodiscard]] constexpr auto get_instruction(const std::uint32_t PC) noexcept -> Instruction { return Instruction{ read_word(PC) }; }
 
   constexpr void setup_run(const std::uint32_t loc) noexcept
@@ -489,9 +1227,33 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
   template<typename Tracer = void (*)(const System &, std::uint32_t, Instruction)>
   constexpr void next_operation(Tracer &&tracer = [](const System & /*unused*/, const auto /*unused*/, const auto /*unused*/) {}) noexcept
   {
+    if (waiting_for_interrupt && !wake_up()) { return; }
+
+    if (fiq_pending()) {
+      enter_exception(Mode::FIQ, Exception_Vector::FIQ, true);
+      if (cycle_model.enabled) { cycle_model.refill(PC() - 4); }
+    } else if (irq_pending()) {
+      enter_exception(Mode::IRQ, Exception_Vector::IRQ, false);
+      if (cycle_model.enabled) { cycle_model.refill(PC() - 4); }
+    }
+
     const auto [ins, type] = i_cache.fetch(PC() - 4, *this);
+    ++statistics.executed[static_cast<std::size_t>(type)];
     tracer(*this, PC() - 4, ins);
+    cycle_model.totals.stalls += memory_observer.fetch(*this, PC() - 4);
+
+    if (cycle_model.enabled) { estimate_cycles(ins, type); }
+
+    const auto next = PC() + 4;
     process(ins, type);
+    if (PC() != next) {
+      ++counters.branches_taken;
+      if (cycle_model.enabled) { cycle_model.refill(PC() - 4); }
+    }
+
+    ++instructions;
+    ++scheduler.cycle;
+    if (scheduler.due()) { dispatch_events(); }
   }
 
   [[nodiscard]] constexpr bool operations_remaining() const noexcept { return PC() != RAM_Size - 4; }
@@ -513,9 +1275,10 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
 
     constexpr I_Cache(const System &sys, const std::uint32_t t_start) noexcept : start(t_start), cache{} { fill_cache(sys); }
 
-    constexpr Cache_Elem fetch(const std::uint32_t loc, const System &sys) noexcept
+    constexpr Cache_Elem fetch(const std::uint32_t loc, System &sys) noexcept
     {
-      if (loc > start + (cache.size() * 4) || loc < start) {
+      if (loc >= start + (cache.size() * 4) || loc < start) {
+        ++sys.statistics.i_cache_refills;
         start = loc;
         fill_cache(sys);
       }
@@ -546,7 +1309,154 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
                      Tracer &&tracer = [](const System & /*unused*/, const auto /*unused*/, const auto /*unused*/) {}) noexcept
   {
     setup_run(loc);
-    while (operations_remaining()) { next_operation(tracer); }
+    while (operations_remaining() && !stalled()) { next_operation(tracer); }
+  }
+
+  // Continues execution until the cycle count reaches cycle_budget, the program is done or it stalled.
+  // Instructions skipped over in idle loops are not passed to the tracer.
+  template<typename Tracer = void (*)(const System &, std::uint32_t, Instruction)>
+  constexpr void run_until(const std::uint64_t cycle_budget,
+                           Tracer &&tracer = [](const System & /*unused*/, const auto /*unused*/, const auto /*unused*/) {}) noexcept
+  {
+    cycle_limit = cycle_budget;
+    while (scheduler.cycle < cycle_budget && operations_remaining() && !stalled()) { next_operation(tracer); }
+    cycle_limit = Scheduler::never;
+  }
+
+  constexpr void check_idle_loop(const std::uint32_t branch) noexcept
+  {
+    const auto unchanged = [&] {
+      if (!idle_loop.tracking || idle_loop.branch != branch || idle_loop.side_effect || idle_loop.CSPR != CSPR) { return false; }
+      for (std::size_t idx = 0; idx < registers.size(); ++idx) {
+        if (idle_loop.registers[idx] != registers[idx]) { return false; }
+      }
+      return true;
+    };
+
+    // without an event or limit the loop really is infinite, leave it to the caller
+    if (const auto limit = std::min(scheduler.next_event(), cycle_limit); unchanged() && limit != Scheduler::never) {
+      const auto iteration_cycles       = scheduler.cycle - idle_loop.cycle;
+      const auto iteration_instructions = instructions - idle_loop.instructions;
+
+      // stop short of the limit, the remaining partial iteration is executed normally
+      if (iteration_cycles != 0 && limit > scheduler.cycle + iteration_cycles) {
+        const auto iterations = (limit - scheduler.cycle - 1) / iteration_cycles;
+        scheduler.cycle += iterations * iteration_cycles;
+        instructions += iterations * iteration_instructions;
+        counters.loads += iterations * (counters.loads - idle_loop.counters.loads);
+        counters.stores += iterations * (counters.stores - idle_loop.counters.stores);
+        counters.branches_taken += iterations * (counters.branches_taken - idle_loop.counters.branches_taken);
+        statistics.repeat(idle_loop.statistics, iterations);
+        cycle_model.totals.repeat(idle_loop.cycle_totals, iterations);
+        idle_loop.skipped_cycles += iterations * iteration_cycles;
+        idle_loop.skipped_instructions += iterations * iteration_instructions;
+      }
+    }
+
+    idle_loop.tracking     = true;
+    idle_loop.side_effect  = false;
+    idle_loop.branch       = branch;
+    idle_loop.CSPR         = CSPR;
+    idle_loop.registers    = registers;
+    idle_loop.cycle        = scheduler.cycle;
+    idle_loop.instructions = instructions;
+    idle_loop.counters     = counters;
+    idle_loop.statistics   = statistics;
+    idle_loop.cycle_totals = cycle_model.totals;
+  }
+
+  // Internal cycles the multiplier array takes for the operand Rs, one per significant byte.
+  // Leading bytes of all ones only count as insignificant for signed multiplies.
+  [[nodiscard]] constexpr static std::uint32_t multiplier_cycles(const std::uint32_t operand, const bool is_signed) noexcept
+  {
+    std::uint32_t cycles = 1;
+    for (std::uint32_t shift = 8; shift < 32; shift += 8) {
+      const auto upper = operand >> shift;
+      if (upper == 0 || (is_signed && upper == (0xFFFF'FFFFu >> shift))) { break; }
+      ++cycles;
+    }
+    return cycles;
+  }
+
+  // Charges the cycles of the instruction at PC() - 4 to cycle_model, except for the pipeline refill
+  // of a taken branch, which is charged once it executed. Data accesses are charged to the region of
+  // the base register, which is close enough to the effective address to find the region.
+  constexpr void estimate_cycles(const Instruction ins, const Instruction_Type type) noexcept
+  {
+    const auto pc = PC() - 4;
+    if (!ins.unconditional() && !check_condition(ins)) { return cycle_model.sequential(pc); }
+
+    switch (type) {
+    case Instruction_Type::Data_Processing: {
+      const auto val = Data_Processing{ ins };
+      cycle_model.sequential(pc);
+      if (!val.immediate_operand() && !val.operand_2_immediate_shift()) { cycle_model.internal(); }
+    } break;
+    case Instruction_Type::Multiply:
+    case Instruction_Type::Multiply_Long: {
+      // MUL/MLA always sign extend, for the long variants bit 22 selects a signed multiply
+      const bool long_multiply = type == Instruction_Type::Multiply_Long;
+      const bool is_signed     = !long_multiply || cpp_box::arm::test_bit(ins.data(), 22);
+      const bool accumulate    = cpp_box::arm::test_bit(ins.data(), 21);
+      const auto multiplier    = multiplier_cycles(registers[(ins.data() >> 8) & 0b1111], is_signed);
+      cycle_model.sequential(pc);
+      cycle_model.internal(multiplier + (long_multiply ? 1 : 0) + (accumulate ? 1 : 0));
+    } break;
+    case Instruction_Type::Single_Data_Transfer: {
+      const auto val     = Single_Data_Transfer{ ins };
+      const auto address = registers[val.base_register()];
+      if (val.load()) {
+        cycle_model.sequential(pc);
+        cycle_model.non_sequential(address);
+        cycle_model.internal();
+      } else {
+        cycle_model.non_sequential(address);
+        cycle_model.non_sequential(pc);
+      }
+    } break;
+    case Instruction_Type::Load_And_Store_Multiple: {
+      const auto val      = Load_And_Store_Multiple{ ins };
+      const auto address  = registers[val.base_register()];
+      std::uint32_t count = 0;
+      for (std::uint32_t list = val.register_list(); list != 0; list &= list - 1) { ++count; }
+
+      cycle_model.non_sequential(address);
+      if (count > 1) { cycle_model.sequential(address, count - 1); }
+      if (val.load()) {
+        cycle_model.sequential(pc);
+        cycle_model.internal();
+      } else {
+        cycle_model.non_sequential(pc);
+      }
+    } break;
+    case Instruction_Type::Single_Data_Swap: {
+      const auto address = registers[Single_Data_Swap{ ins }.base_register()];
+      cycle_model.sequential(pc);
+      cycle_model.non_sequential(address);
+      cycle_model.non_sequential(address);
+      cycle_model.internal();
+    } break;
+    case Instruction_Type::Coprocessor_Data_Operation:
+      cycle_model.sequential(pc);
+      cycle_model.internal();
+      break;
+    case Instruction_Type::Coprocessor_Register_Transfer:
+      cycle_model.sequential(pc);
+      cycle_model.coprocessor();
+      if (Coprocessor_Register_Transfer{ ins }.load()) { cycle_model.internal(); }
+      break;
+    case Instruction_Type::Coprocessor_Data_Transfer:
+      cycle_model.non_sequential(registers[(ins.data() >> 16) & 0b1111]);
+      cycle_model.non_sequential(pc);
+      break;
+    case Instruction_Type::Branch:
+    case Instruction_Type::MRS:
+    case Instruction_Type::MSR:
+    case Instruction_Type::MSRF:
+    case Instruction_Type::Undefined:
+    case Instruction_Type::Block_Data_Transfer:
+    case Instruction_Type::Software_Interrupt: cycle_model.sequential(pc); break;
+    }
   }
 
   [[nodiscard]] constexpr auto get_second_operand_shift_amount(const Data_Processing val) const noexcept
@@ -628,26 +1538,36 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
 
     const auto load = val.load();
 
-    if (val.psr()) {
-      abort();  // cannot handle PSR
-    }
+    // with the S bit set and PC not loaded, the User mode registers are transferred
+    const bool pc_loaded    = load && test_bit(register_list, 15);
+    const bool user_bank    = val.psr() && !pc_loaded;
+    const auto current_mode = mode();
+    if (user_bank) { switch_mode(Mode::System); }
 
     // incrementing, lowest # register goes first
     for (std::size_t i = 0; i < 16; ++i) {
       if (test_bit(register_list, i)) {
+        observe_access(start_address, 4, !load);
         if (load) {
-          registers[i] = read_word(start_address);
+          registers[i] = data_read_word(start_address);
         } else {
-          write_word(start_address, registers[i]);
+          data_write_word(start_address, registers[i]);
         }
         start_address += 4;
       }
     }
 
+    ++(load ? counters.loads : counters.stores);
+
+    if (user_bank) { switch_mode(current_mode); }
+
     if (val.write_back()) {
       const auto index_amount = val.up_indexing() ? 4 : -4;
       registers[val.base_register()] += static_cast<std::uint32_t>(bits_set * index_amount);
     }
+
+    // exception return, LDM with PC and the S bit set restores CPSR
+    if (val.psr() && pc_loaded) { restore_saved_status(); }
   }
 
 
@@ -679,18 +1599,21 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
     const auto src_dest_register = val.src_dest_register();
     const auto indexed_location  = static_cast<std::uint32_t>(base_location + index_offset);
 
+    ++(val.load() ? counters.loads : counters.stores);
+    observe_access(pre_indexed ? indexed_location : base_location, val.byte_transfer() ? 1 : 4, !val.load());
+
     if (val.byte_transfer()) {
       if (const auto location = pre_indexed ? indexed_location : base_location; val.load()) {
-        registers[src_dest_register] = read_byte(location);
+        registers[src_dest_register] = data_read_byte(location);
       } else {
-        write_byte(location, static_cast<std::uint8_t>(registers[src_dest_register] & 0xFF));
+        data_write_byte(location, static_cast<std::uint8_t>(registers[src_dest_register] & 0xFF));
       }
     } else {
       // word transfer
       if (const auto location = pre_indexed ? indexed_location : base_location; val.load()) {
-        registers[src_dest_register] = read_word(location);
+        registers[src_dest_register] = data_read_word(location);
       } else {
-        write_word(location, registers[src_dest_register]);
+        data_write_word(location, registers[src_dest_register]);
       }
     }
 
@@ -714,7 +1637,10 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
         n_flag(test_bit(result, 31));
       }
 
-      if (write) { destination = result; }
+      if (write) {
+        destination = result;
+        if (val.set_condition_code() && destination_register == 15) { restore_saved_status(); }
+      }
     };
 
     // use 64 bit operations to be able to capture carry
@@ -740,7 +1666,11 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
         v_flag((first_op_sign == second_op_sign) && (result_sign != first_op_sign));
       }
 
-      if (write) { destination = static_cast<std::uint32_t>(result); }
+      if (write) {
+        destination = static_cast<std::uint32_t>(result);
+        // exception return, SUBS PC, LR, #4 and friends restore CPSR
+        if (val.set_condition_code() && destination_register == 15) { restore_saved_status(); }
+      }
     };
 
 
@@ -770,6 +1700,8 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
     if (instruction.link()) {
       // Link bit set, get PC, which is already pointing at the next instruction
       LR() = PC();
+    } else if (skip_idle_loops && instruction.offset() < 0 && instruction.offset() >= -(Idle_Loop_Detector::max_loop_size + 8)) {
+      check_idle_loop(PC() - 8);
     }
 
     PC() += static_cast<std::uint32_t>(instruction.offset() + 4);
@@ -799,6 +1731,65 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
     }
   }
 
+  constexpr void process(const Coprocessor_Data_Operation val) noexcept
+  {
+    if (!coprocessors.has_coprocessor(val.coprocessor_number())) {
+      return unhandled_instruction(Instruction{ val.data() }, Instruction_Type::Coprocessor_Data_Operation);
+    }
+
+    idle_loop.side_effect = true;
+    coprocessors.data_operation(*this, val);
+  }
+
+  constexpr void process(const Coprocessor_Register_Transfer val) noexcept
+  {
+    if (!coprocessors.has_coprocessor(val.coprocessor_number())) {
+      return unhandled_instruction(Instruction{ val.data() }, Instruction_Type::Coprocessor_Register_Transfer);
+    }
+
+    if (val.load()) {
+      const auto value = coprocessors.read_register(*this, val);
+      if (val.arm_register() == 15) {
+        // MRC to PC only transfers the top 4 bits, into the condition flags
+        CSPR = (CSPR & 0x0FFF'FFFF) | (value & 0xF000'0000);
+      } else {
+        registers[val.arm_register()] = value;
+      }
+    } else {
+      idle_loop.side_effect = true;
+      coprocessors.write_register(*this, val, registers[val.arm_register()]);
+    }
+  }
+
+  constexpr void process(const Single_Data_Swap val) noexcept
+  {
+    const auto size = val.byte_transfer() ? 1u : 4u;
+    observe_access(registers[val.base_register()], size, false);
+    observe_access(registers[val.base_register()], size, true);
+    registers[val.destination_register()] = exchange(registers[val.base_register()], registers[val.source_register()], val.byte_transfer());
+    ++counters.loads;
+    ++counters.stores;
+  }
+
+  constexpr void process(const Status_Register_Read val) noexcept
+  {
+    registers[val.destination_register()] = val.saved_status() ? SPSR() : CSPR;
+  }
+
+  constexpr void process(const Status_Register_Write val) noexcept
+  {
+    const auto value = val.immediate_operand() ? val.operand_immediate() : registers[val.source_register()];
+
+    if (val.saved_status()) {
+      if (has_saved_status()) { SPSR() = (SPSR() & ~val.byte_mask()) | (value & val.byte_mask()); }
+      return;
+    }
+
+    // only the condition flags can be changed from User mode
+    const auto mask = mode() == Mode::User ? val.byte_mask() & 0xFF00'0000 : val.byte_mask();
+    write_status((CSPR & ~mask) | (value & mask));
+  }
+
   constexpr static auto n_bit = 0b1000'0000'0000'0000'0000'0000'0000'0000;
   constexpr static auto z_bit = 0b0100'0000'0000'0000'0000'0000'0000'0000;
   constexpr static auto c_bit = 0b0010'0000'0000'0000'0000'0000'0000'0000;
@@ -877,18 +1868,20 @@ template<std::size_t RAM_Size = 1024, typename RAM_Type = std::array<std::uint8_
       case Instruction_Type::Single_Data_Transfer: process(Single_Data_Transfer{ instruction }); break;
       case Instruction_Type::Branch: process(Branch{ instruction }); break;
       case Instruction_Type::Load_And_Store_Multiple: process(Load_And_Store_Multiple{ instruction }); break;
-      case Instruction_Type::MRS:
+      case Instruction_Type::Coprocessor_Data_Operation: process(Coprocessor_Data_Operation{ instruction }); break;
+      case Instruction_Type::Coprocessor_Register_Transfer: process(Coprocessor_Register_Transfer{ instruction }); break;
+      case Instruction_Type::MRS: process(Status_Register_Read{ instruction }); break;
       case Instruction_Type::MSR:
-      case Instruction_Type::MSRF:
+      case Instruction_Type::MSRF: process(Status_Register_Write{ instruction }); break;
+      case Instruction_Type::Single_Data_Swap: process(Single_Data_Swap{ instruction }); break;
       case Instruction_Type::Multiply:
-      case Instruction_Type::Single_Data_Swap:
       case Instruction_Type::Undefined:
       case Instruction_Type::Block_Data_Transfer:
       case Instruction_Type::Coprocessor_Data_Transfer:
-      case Instruction_Type::Coprocessor_Data_Operation:
-      case Instruction_Type::Coprocessor_Register_Transfer:
       case Instruction_Type::Software_Interrupt: unhandled_instruction(instruction, type); break;
       }
+    } else {
+      ++statistics.condition_failed;
     }
 
     // discount prefetch
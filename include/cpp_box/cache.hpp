@@ -0,0 +1,150 @@
+#ifndef CPP_BOX_CACHE_HPP
+#define CPP_BOX_CACHE_HPP
+
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "compiler.hpp"
+
+namespace cpp_box::cache {
+
+enum struct Write_Policy {
+  WRITE_BACK,    // writes allocate lines, dirty lines are written back when evicted
+  WRITE_THROUGH  // writes never allocate and go straight to memory through a write buffer
+};
+
+struct Cache_Config
+{
+  std::uint32_t size{ 4 * 1024 };
+  std::uint32_t associativity{ 4 };
+  std::uint32_t line_size{ 32 };
+  Write_Policy write_policy{ Write_Policy::WRITE_BACK };
+  std::uint32_t miss_penalty{ 8 };  // cycles to fill a line, or to write one back
+};
+
+struct Cache_Statistics
+{
+  std::uint64_t reads{ 0 };
+  std::uint64_t read_misses{ 0 };
+  std::uint64_t writes{ 0 };
+  std::uint64_t write_misses{ 0 };
+  std::uint64_t write_backs{ 0 };
+
+  [[nodiscard]] constexpr std::uint64_t accesses() const noexcept { return reads + writes; }
+  [[nodiscard]] constexpr std::uint64_t misses() const noexcept { return read_misses + write_misses; }
+};
+
+// Set associative cache with LRU replacement. Only the tags are simulated, data stays in guest RAM.
+struct Cache
+{
+  struct Result
+  {
+    bool hit;
+    std::uint32_t stall;
+  };
+
+  // throws std::invalid_argument unless the sizes are powers of two and at least one set fits
+  explicit Cache(const Cache_Config &t_config);
+
+  Result access(const std::uint32_t address, const bool write) noexcept
+  {
+    const auto line = address >> line_bits;
+    auto *set       = &ways[(line & set_mask) * config.associativity];
+
+    ++clock;
+    ++(write ? statistics.writes : statistics.reads);
+
+    for (std::uint32_t way = 0; way < config.associativity; ++way) {
+      if (set[way].valid && set[way].line == line) {
+        set[way].last_used = clock;
+        set[way].dirty     = set[way].dirty || (write && config.write_policy == Write_Policy::WRITE_BACK);
+        return { true, 0 };
+      }
+    }
+
+    ++(write ? statistics.write_misses : statistics.read_misses);
+    if (write && config.write_policy == Write_Policy::WRITE_THROUGH) { return { false, 0 }; }
+
+    // invalid ways have never been used, so they are picked before any valid one
+    auto *victim = set;
+    for (std::uint32_t way = 1; way < config.associativity; ++way) {
+      if (set[way].last_used < victim->last_used) { victim = &set[way]; }
+    }
+
+    auto stall = config.miss_penalty;
+    if (victim->valid && victim->dirty) {
+      ++statistics.write_backs;
+      stall += config.miss_penalty;
+    }
+
+    *victim = Way{ line, true, write && config.write_policy == Write_Policy::WRITE_BACK, clock };
+    return { false, stall };
+  }
+
+  Cache_Config config;
+  Cache_Statistics statistics{};
+
+private:
+  struct Way
+  {
+    std::uint32_t line{ 0 };
+    bool valid{ false };
+    bool dirty{ false };
+    std::uint64_t last_used{ 0 };
+  };
+
+  std::uint32_t line_bits{ 0 };
+  std::uint32_t set_mask{ 0 };
+  std::uint64_t clock{ 0 };
+  std::vector<Way> ways;
+};
+
+// Memory_Observer of arm::System, simulating an optional instruction cache and an optional data cache.
+// Accesses are also counted per instruction, to map misses back to source lines. Like the other
+// counters, the accesses of skipped idle loop iterations are not simulated.
+struct Cache_Simulator
+{
+  struct Instruction_Statistics
+  {
+    std::uint64_t fetches{ 0 };
+    std::uint64_t fetch_misses{ 0 };
+    std::uint64_t accesses{ 0 };
+    std::uint64_t access_misses{ 0 };
+  };
+
+  template<typename System> [[nodiscard]] std::uint32_t fetch(const System & /*sys*/, const std::uint32_t pc)
+  {
+    if (!instruction_cache) { return 0; }
+    const auto result = instruction_cache->access(pc, false);
+    auto &counts      = per_instruction[pc];
+    ++counts.fetches;
+    if (!result.hit) { ++counts.fetch_misses; }
+    return result.stall;
+  }
+
+  template<typename System>
+  [[nodiscard]] std::uint32_t
+    access(const System & /*sys*/, const std::uint32_t pc, const std::uint32_t loc, const std::uint32_t /*size*/, const bool write)
+  {
+    if (!data_cache) { return 0; }
+    const auto result = data_cache->access(loc, write);
+    auto &counts      = per_instruction[pc];
+    ++counts.accesses;
+    if (!result.hit) { ++counts.access_misses; }
+    return result.stall;
+  }
+
+  std::optional<Cache> instruction_cache;
+  std::optional<Cache> data_cache;
+  std::unordered_map<std::uint32_t, Instruction_Statistics> per_instruction;
+};
+
+// Hit and miss rates of each cache, then the source lines with the most misses
+void write_report(std::ostream &os, const Cache_Simulator &simulator, const Loaded_Files &files, std::size_t max_lines = 30);
+
+}  // namespace cpp_box::cache
+
+#endif
@@ -1,3 +1,6 @@
+#ifndef CPP_BOX_COMPILER_HPP
+#define CPP_BOX_COMPILER_HPP
+
 #include <filesystem>
 #include <map>
 #include <memory>
@@ -64,3 +67,5 @@ Loaded_Files compile(const std::string &t_str,
                      spdlog::logger &logger);
 
 }  // namespace cpp_box
+
+#endif
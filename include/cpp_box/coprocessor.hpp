@@ -0,0 +1,113 @@
+#ifndef CPP_BOX_COPROCESSOR_HPP
+#define CPP_BOX_COPROCESSOR_HPP
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "arm.hpp"
+
+namespace cpp_box::coprocessor {
+
+// view of the guest RAM handed to host side coprocessor kernels
+struct Guest_Memory
+{
+  std::uint8_t *data{ nullptr };
+  std::size_t size{ 0 };
+
+  // nullptr if [loc, loc + length) is not entirely inside of guest RAM
+  [[nodiscard]] std::uint8_t *span(const std::uint32_t loc, const std::size_t length) const noexcept
+  {
+    if (loc > size || length > size - loc) { return nullptr; }
+    return data + loc;  // NOLINT
+  }
+};
+
+struct Handlers
+{
+  std::function<void(const arm::Coprocessor_Data_Operation, Guest_Memory)> data_operation;
+  std::function<std::uint32_t(const arm::Coprocessor_Register_Transfer)> read_register;
+  std::function<void(const arm::Coprocessor_Register_Transfer, std::uint32_t)> write_register;
+
+  // optional, the state of the coprocessor for save states. restore_state returns false if the words are not of it
+  std::function<std::vector<std::uint32_t>()> save_state;
+  std::function<bool(const std::vector<std::uint32_t> &)> restore_state;
+};
+
+// Runtime registry of coprocessors, suitable for use as the Coprocessor_Callback of an arm::System
+struct Registry
+{
+  void add(const std::uint32_t number, Handlers handlers) { coprocessors.at(number) = std::move(handlers); }
+
+  [[nodiscard]] bool has_coprocessor(const std::uint32_t number) const noexcept
+  {
+    return number < coprocessors.size() && coprocessors[number].data_operation && coprocessors[number].read_register
+           && coprocessors[number].write_register;
+  }
+
+  template<typename System> void data_operation(System &sys, const arm::Coprocessor_Data_Operation op)
+  {
+    coprocessors[op.coprocessor_number()].data_operation(op, Guest_Memory{ sys.builtin_ram.data(), sys.builtin_ram.size() });
+  }
+
+  template<typename System>[[nodiscard]] std::uint32_t read_register([[maybe_unused]] System &sys, const arm::Coprocessor_Register_Transfer op)
+  {
+    return coprocessors[op.coprocessor_number()].read_register(op);
+  }
+
+  template<typename System>
+  void write_register([[maybe_unused]] System &sys, const arm::Coprocessor_Register_Transfer op, const std::uint32_t value)
+  {
+    coprocessors[op.coprocessor_number()].write_register(op, value);
+  }
+
+  // the save_state of each coprocessor number, empty for those without, see snapshot.hpp
+  [[nodiscard]] std::vector<std::vector<std::uint32_t>> save_state() const
+  {
+    std::vector<std::vector<std::uint32_t>> state;
+    for (const auto &coprocessor : coprocessors) {
+      state.push_back(coprocessor.save_state ? coprocessor.save_state() : std::vector<std::uint32_t>{});
+    }
+    return state;
+  }
+
+  // returns false if the state is not of the coprocessors added
+  bool restore_state(const std::vector<std::vector<std::uint32_t>> &state)
+  {
+    if (state.size() != coprocessors.size()) { return false; }
+
+    bool restored = true;
+    for (std::size_t number = 0; number < coprocessors.size(); ++number) {
+      if (coprocessors[number].restore_state) {
+        restored = coprocessors[number].restore_state(state[number]) && restored;
+      } else {
+        restored = state[number].empty() && restored;
+      }
+    }
+    return restored;
+  }
+
+private:
+  std::array<Handlers, 16> coprocessors;
+};
+
+// Host native kernels operating on guest buffers.
+//
+// Arguments are set with MCR into the accelerator's c0-c15, CDP opcode_1 selects the kernel and results are read back with MRC.
+// See cpp_box::Accelerator in hardware.hpp for the guest side.
+enum struct Accelerator_Kernel : std::uint32_t {
+  DOT_PRODUCT   = 0,  // c4:c5 (lo:hi) = sum of int32 c0[i] * c1[i] for i < c2
+  CRC32         = 1,  // c4 = crc32 of c2 bytes at c0, starting from crc c3
+  TRANSFORM_4X4 = 2,  // c1[i] = c3 * c0[i] for i < c2 vec4s, c3 is a row major 4x4 Q16.16 matrix
+};
+
+enum struct Accelerator_Status : std::uint32_t { OK = 0, BAD_ADDRESS = 1, UNKNOWN_KERNEL = 2 };
+
+constexpr static std::uint32_t ACCELERATOR_STATUS_REGISTER = 15;
+
+[[nodiscard]] Handlers make_accelerator();
+
+}  // namespace cpp_box::coprocessor
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef CPP_BOX_COVERAGE_HPP
+#define CPP_BOX_COVERAGE_HPP
+
+#include <cstdint>
+#include <iosfwd>
+#include <string_view>
+#include <vector>
+
+#include "compiler.hpp"
+
+namespace cpp_box::coverage {
+
+// One bit per word of guest code in [begin, end), set for every executed instruction.
+// To be passed as the tracer of System::run or run_until, instructions outside of the range are ignored.
+struct Coverage_Map
+{
+  Coverage_Map(std::uint32_t t_begin, std::uint32_t t_end);
+
+  template<typename System, typename Instruction> void operator()(const System & /*sys*/, const std::uint32_t pc, const Instruction /*ins*/) noexcept
+  {
+    mark(pc);
+  }
+
+  void mark(const std::uint32_t address) noexcept
+  {
+    // addresses below begin wrap around and fail the range check as well
+    if (const auto word = (address - begin) / 4; word < words) { bits[word / 64] |= std::uint64_t{ 1 } << (word % 64); }
+  }
+
+  [[nodiscard]] bool contains(const std::uint32_t address) const noexcept { return (address - begin) / 4 < words; }
+
+  [[nodiscard]] bool executed(const std::uint32_t address) const noexcept
+  {
+    const auto word = (address - begin) / 4;
+    return word < words && ((bits[word / 64] >> (word % 64)) & 1) != 0;
+  }
+
+  [[nodiscard]] std::uint32_t executed_words() const noexcept;
+
+  // Adds the instructions executed by another run of the same code, throws std::invalid_argument if the ranges differ
+  Coverage_Map &merge(const Coverage_Map &other);
+
+  std::uint32_t begin;
+  std::uint32_t words;
+  std::vector<std::uint64_t> bits;
+};
+
+// Covers the executable sections of the ELF object that `files` was loaded from
+[[nodiscard]] Coverage_Map make_coverage_map(const Loaded_Files &files);
+
+// lcov tracefile with line and function coverage, using the line numbers of Loaded_Files::location_data.
+// Lines are reported as executed once, the map does not count how often.
+void write_lcov(std::ostream &os, const Coverage_Map &map, const Loaded_Files &files, std::string_view test_name = {});
+
+}  // namespace cpp_box::coverage
+
+#endif
@@ -0,0 +1,503 @@
+#ifndef CPP_BOX_DEVICES_HPP
+#define CPP_BOX_DEVICES_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "memory_map.hpp"
+
+namespace cpp_box::devices {
+
+struct Core_Counters
+{
+  std::uint64_t instructions{ 0 };
+  std::uint64_t cycles{ 0 };
+  std::uint64_t loads{ 0 };
+  std::uint64_t stores{ 0 };
+  std::uint64_t branches_taken{ 0 };
+};
+
+// What a device sees of the core it is attached to
+struct Core_View
+{
+  Core_View()                  = default;
+  Core_View(const Core_View &) = default;
+  Core_View(Core_View &&)      = default;
+  Core_View &operator=(const Core_View &) = default;
+  Core_View &operator=(Core_View &&) = default;
+  virtual ~Core_View()                = default;
+
+  [[nodiscard]] virtual std::uint64_t cycles() const noexcept   = 0;
+  [[nodiscard]] virtual Core_Counters counters() const noexcept = 0;
+};
+
+// Writes and events may also act on the core. Event ids are private to the device scheduling them.
+struct Core_Context : Core_View
+{
+  virtual void schedule(std::uint64_t due_cycle, std::uint32_t id) noexcept = 0;
+  virtual void cancel(std::uint32_t id) noexcept                          = 0;
+  virtual void set_interrupt_lines(bool irq, bool fiq) noexcept           = 0;
+  virtual void wait_for_interrupt() noexcept                              = 0;
+
+  // nullptr if [loc, loc + length) is not entirely inside of RAM
+  [[nodiscard]] virtual std::uint8_t *memory(std::uint32_t loc, std::size_t length) noexcept = 0;
+};
+
+// A memory mapped device. Accesses are passed the word aligned offset into the range the device is
+// mapped at, byte and half word accesses are widened to word accesses.
+struct Device
+{
+  Device()               = default;
+  Device(const Device &) = default;
+  Device(Device &&)      = default;
+  Device &operator=(const Device &) = default;
+  Device &operator=(Device &&) = default;
+  virtual ~Device()            = default;
+
+  [[nodiscard]] virtual std::uint32_t read(const Core_View &core, std::uint32_t offset) noexcept = 0;
+  virtual void write(Core_Context &core, std::uint32_t offset, std::uint32_t value) noexcept     = 0;
+  virtual void event([[maybe_unused]] Core_Context &core, [[maybe_unused]] std::uint32_t id) noexcept {}
+
+  // The registers of the device as words for a save state, see snapshot.hpp. Events the device scheduled are
+  // part of the core's state. restore_state returns false if the words are not of this kind of device.
+  [[nodiscard]] virtual std::vector<std::uint32_t> save_state() const { return {}; }
+  virtual bool restore_state(const std::vector<std::uint32_t> &state) noexcept { return state.empty(); }
+};
+
+// Devices mapped on word granular address ranges, resolved through a table of pages. An access to a
+// page no device is mapped in costs a compare and a load, only mapped pages have a table of words.
+struct Device_Bus
+{
+  constexpr static std::uint32_t page_bits = 12;
+  constexpr static std::uint32_t page_size = 1u << page_bits;
+
+  struct Mapping
+  {
+    Device *device;
+    std::uint32_t begin;
+    std::uint32_t index;
+  };
+
+  // [begin, end) must be word aligned and not overlap the range of another device
+  template<typename T, typename... Param> T &add(const std::uint32_t begin, const std::uint32_t end, Param &&... param)
+  {
+    auto device  = std::make_unique<T>(std::forward<Param>(param)...);
+    auto &result = *device;
+    map(begin, end, std::move(device));
+    return result;
+  }
+
+  void map(std::uint32_t begin, std::uint32_t end, std::unique_ptr<Device> device);
+
+  [[nodiscard]] const Mapping *find(const std::uint32_t loc) const noexcept
+  {
+    const auto page = loc >> page_bits;
+    if (page >= pages.size() || pages[page] == 0) { return nullptr; }
+
+    const auto slot = words[pages[page] - 1u][(loc & (page_size - 1)) / 4];
+    if (slot == 0) { return nullptr; }
+    return &mappings[slot - 1u];
+  }
+
+  [[nodiscard]] Device &device(const std::uint32_t index) const noexcept { return *mappings[index].device; }
+  [[nodiscard]] std::uint32_t size() const noexcept { return static_cast<std::uint32_t>(mappings.size()); }
+
+private:
+  // 1 based indexes into words and mappings, 0 for nothing mapped
+  std::vector<std::uint16_t> pages;
+  std::vector<std::array<std::uint8_t, page_size / 4>> words;
+  std::vector<Mapping> mappings;
+  std::vector<std::unique_ptr<Device>> owned;
+};
+
+// xoshiro128++ running in independent lanes, so that refilling a block of values vectorizes.
+// A read is a single buffer load, runs are reproducible with a fixed seed.
+struct Random_Device final : Device
+{
+  constexpr static std::size_t lanes = 8;
+
+  Random_Device();
+  explicit Random_Device(std::uint64_t seed) noexcept { reseed(seed); }
+
+  void reseed(std::uint64_t seed) noexcept;
+
+  [[nodiscard]] std::uint32_t read() noexcept
+  {
+    if (position == buffer.size()) { refill(); }
+    return buffer[position++];
+  }
+
+  [[nodiscard]] std::uint32_t read([[maybe_unused]] const Core_View &core, [[maybe_unused]] const std::uint32_t offset) noexcept override
+  {
+    return read();
+  }
+  void write([[maybe_unused]] Core_Context &core,
+             [[maybe_unused]] const std::uint32_t offset,
+             [[maybe_unused]] const std::uint32_t value) noexcept override
+  {
+  }
+
+  [[nodiscard]] std::vector<std::uint32_t> save_state() const override;
+  bool restore_state(const std::vector<std::uint32_t> &t_state) noexcept override;
+
+private:
+  void refill() noexcept;
+
+  std::array<std::array<std::uint32_t, lanes>, 4> state{};
+  std::array<std::uint32_t, lanes * 32> buffer{};
+  std::size_t position{ 0 };
+};
+
+struct Interrupt_Controller final : Device
+{
+  // relative to Memory_Map::INTERRUPT_STATUS
+  enum struct Register : std::uint32_t { STATUS = 0x0, ENABLE = 0x4, FIQ_SELECT = 0x8, WAIT_FOR_INTERRUPT = 0xC };
+
+  std::uint32_t status{ 0 };
+  std::uint32_t enable{ 0 };
+  std::uint32_t fiq_select{ 0 };
+
+  void raise(Core_Context &core, system::Interrupt_Source source) noexcept;
+  void update(Core_Context &core) const noexcept;
+
+  [[nodiscard]] std::uint32_t read(const Core_View &core, std::uint32_t offset) noexcept override;
+  void write(Core_Context &core, std::uint32_t offset, std::uint32_t value) noexcept override;
+
+  [[nodiscard]] std::vector<std::uint32_t> save_state() const override;
+  bool restore_state(const std::vector<std::uint32_t> &state) noexcept override;
+};
+
+struct Timer final : Device
+{
+  // relative to Memory_Map::TIMER_n_LOAD
+  enum struct Register : std::uint32_t { LOAD = 0x0, CONTROL = 0x4, VALUE = 0x8 };
+
+  Timer(Interrupt_Controller &t_interrupt_controller, const system::Interrupt_Source t_source) noexcept
+    : interrupt_controller{ &t_interrupt_controller }, source{ t_source }
+  {
+  }
+
+  std::uint32_t load{ 0 };
+  std::uint32_t control{ 0 };
+  std::uint64_t due{ 0 };
+
+  [[nodiscard]] bool enabled() const noexcept { return (control & static_cast<std::uint32_t>(system::Timer_Control::ENABLE)) != 0; }
+  [[nodiscard]] bool periodic() const noexcept { return (control & static_cast<std::uint32_t>(system::Timer_Control::PERIODIC)) != 0; }
+
+  // a period of 0 would fire forever without time passing
+  [[nodiscard]] std::uint64_t period() const noexcept { return std::max(load, 1u); }
+
+  [[nodiscard]] std::uint32_t read(const Core_View &core, std::uint32_t offset) noexcept override;
+  void write(Core_Context &core, std::uint32_t offset, std::uint32_t value) noexcept override;
+  void event(Core_Context &core, std::uint32_t id) noexcept override;
+
+  [[nodiscard]] std::vector<std::uint32_t> save_state() const override;
+  bool restore_state(const std::vector<std::uint32_t> &state) noexcept override;
+
+private:
+  Interrupt_Controller *interrupt_controller;
+  system::Interrupt_Source source;
+};
+
+// Copies and fills done with a single host memmove / memset. The transfer happens right away, the
+// guest sees Dma_Status::BUSY until the modelled completion time and may not rely on the data before.
+struct Dma final : Device
+{
+  // relative to Memory_Map::DMA_SOURCE
+  enum struct Register : std::uint32_t { SOURCE = 0x0, DESTINATION = 0x4, LENGTH = 0x8, CONTROL = 0xC, STATUS = 0x10 };
+
+  constexpr static std::uint32_t bytes_per_cycle = 16;
+
+  explicit Dma(Interrupt_Controller &t_interrupt_controller) noexcept : interrupt_controller{ &t_interrupt_controller } {}
+
+  std::uint32_t source{ 0 };
+  std::uint32_t destination{ 0 };
+  std::uint32_t length{ 0 };
+  std::uint32_t status{ 0 };
+
+  [[nodiscard]] std::uint32_t read(const Core_View &core, std::uint32_t offset) noexcept override;
+  void write(Core_Context &core, std::uint32_t offset, std::uint32_t value) noexcept override;
+  void event(Core_Context &core, std::uint32_t id) noexcept override;
+
+  [[nodiscard]] std::vector<std::uint32_t> save_state() const override;
+  bool restore_state(const std::vector<std::uint32_t> &state) noexcept override;
+
+private:
+  [[nodiscard]] bool transfer(Core_Context &core, std::uint32_t control) const noexcept;
+
+  Interrupt_Controller *interrupt_controller;
+};
+
+// Runs the Blit_Commands the guest queued in a ring in its memory, synchronously when the guest writes
+// the head index. Rows are processed in fixed size blocks of pixels which the compiler vectorizes.
+struct Blitter final : Device
+{
+  // relative to Memory_Map::BLITTER_RING_BASE
+  enum struct Register : std::uint32_t { RING_BASE = 0x0, RING_SIZE = 0x4, HEAD = 0x8, TAIL = 0xC };
+
+  std::uint32_t ring_base{ 0 };
+  std::uint32_t ring_size{ 0 };
+  std::uint32_t tail{ 0 };
+
+  [[nodiscard]] std::uint32_t read(const Core_View &core, std::uint32_t offset) noexcept override;
+  void write(Core_Context &core, std::uint32_t offset, std::uint32_t value) noexcept override;
+
+  [[nodiscard]] std::vector<std::uint32_t> save_state() const override;
+  bool restore_state(const std::vector<std::uint32_t> &state) noexcept override;
+
+  static void run(Core_Context &core, const system::Blit_Command &command) noexcept;
+};
+
+// Performance counters for the guest to measure itself, counting the core's counters while enabled
+struct Pmu final : Device
+{
+  // relative to Memory_Map::PMU_CONTROL
+  enum struct Register : std::uint32_t {
+    CONTROL        = 0x00,
+    INSTRUCTIONS   = 0x08,
+    CYCLES         = 0x10,
+    LOADS          = 0x18,
+    STORES         = 0x20,
+    BRANCHES_TAKEN = 0x28
+  };
+
+  std::uint32_t control{ 0 };
+
+  [[nodiscard]] std::uint32_t read(const Core_View &core, std::uint32_t offset) noexcept override;
+  void write(Core_Context &core, std::uint32_t offset, std::uint32_t value) noexcept override;
+
+  [[nodiscard]] Core_Counters counters(const Core_View &core) const noexcept;
+
+  [[nodiscard]] std::vector<std::uint32_t> save_state() const override;
+  bool restore_state(const std::vector<std::uint32_t> &state) noexcept override;
+
+private:
+  [[nodiscard]] bool enabled() const noexcept { return (control & static_cast<std::uint32_t>(system::Pmu_Control::ENABLE)) != 0; }
+
+  // counted while previously enabled, and the core's counters when last enabled
+  Core_Counters accumulated{};
+  Core_Counters started{};
+  std::uint32_t latched_high{ 0 };
+};
+
+// Spans of named regions the guest marks, timestamped in retired guest instructions and host time.
+// The last `capacity` ended spans are kept, see write_chrome_trace. Spans are not part of save states.
+struct Trace_Markers final : Device
+{
+  // relative to Memory_Map::TRACE_BEGIN
+  enum struct Register : std::uint32_t { BEGIN = 0x0, END = 0x4, NAME_ID = 0x8, NAME = 0xC };
+
+  struct Span
+  {
+    std::uint32_t id{ 0 };
+    std::uint32_t depth{ 0 };
+    std::uint64_t begin_instruction{ 0 };
+    std::uint64_t end_instruction{ 0 };
+    std::chrono::nanoseconds begin_time{ 0 };  // since the device was created
+    std::chrono::nanoseconds end_time{ 0 };
+  };
+
+  constexpr static std::size_t capacity        = 64 * 1024;
+  constexpr static std::size_t max_depth       = 64;
+  constexpr static std::size_t max_name_length = 64;
+
+  [[nodiscard]] std::uint32_t read(const Core_View &core, std::uint32_t offset) noexcept override;
+  void write(Core_Context &core, std::uint32_t offset, std::uint32_t value) noexcept override;
+
+  // oldest first
+  [[nodiscard]] std::vector<Span> spans() const;
+  [[nodiscard]] std::string name(std::uint32_t id) const;
+
+private:
+  [[nodiscard]] std::chrono::nanoseconds now() const noexcept { return std::chrono::steady_clock::now() - created; }
+
+  std::chrono::steady_clock::time_point created{ std::chrono::steady_clock::now() };
+  std::vector<Span> open;
+  std::vector<Span> ended;
+  std::size_t next{ 0 };  // the slot the next ended span is stored in, once ended is at capacity
+  std::uint32_t name_id{ 0 };
+  std::unordered_map<std::uint32_t, std::string> names;
+};
+
+enum struct Timeline {
+  HOST,               // timestamps in host microseconds
+  GUEST_INSTRUCTIONS  // one retired guest instruction is shown as a microsecond
+};
+
+// Chrome trace event JSON (chrome://tracing, Perfetto), the markers of core n are shown as thread n
+void write_chrome_trace(std::ostream &os, const std::vector<const Trace_Markers *> &cores, Timeline timeline);
+
+// Shared by all cores of a machine. A core never touches another core's state, doorbells
+// are picked up by the receiving core's Core_Registers on a periodic scheduler event.
+struct Mailboxes
+{
+  explicit Mailboxes(const std::uint32_t t_core_count) noexcept : core_count{ t_core_count } {}
+
+  std::uint32_t core_count;
+  std::array<std::atomic<std::uint32_t>, system::MAILBOX_COUNT> words{};
+  std::array<std::atomic<bool>, system::MAX_CORES> doorbells{};
+};
+
+struct Core_Registers final : Device
+{
+  // relative to Memory_Map::CORE_ID
+  enum struct Register : std::uint32_t { CORE_ID = 0x0, CORE_COUNT = 0x4, DOORBELL = 0x8, MAILBOX_0 = 0x10 };
+
+  constexpr static std::uint64_t doorbell_poll_interval = 256;
+
+  explicit Core_Registers(Interrupt_Controller &t_interrupt_controller) noexcept : interrupt_controller{ &t_interrupt_controller } {}
+
+  // only set for multi core machines, see Devices::join
+  std::uint32_t core_id{ 0 };
+  std::shared_ptr<Mailboxes> mailboxes;
+
+  void join(Core_Context &core, std::uint32_t id, std::shared_ptr<Mailboxes> shared) noexcept;
+
+  [[nodiscard]] std::uint32_t read(const Core_View &core, std::uint32_t offset) noexcept override;
+  void write(Core_Context &core, std::uint32_t offset, std::uint32_t value) noexcept override;
+  void event(Core_Context &core, std::uint32_t id) noexcept override;
+
+private:
+  Interrupt_Controller *interrupt_controller;
+};
+
+// cycles are those of the cycle model when it is enabled, otherwise one per instruction and idle cycle
+template<typename System>[[nodiscard]] Core_Counters counters_of(const System &sys) noexcept
+{
+  const auto cycles = sys.cycle_model.enabled ? sys.estimated_cycles() : sys.cycles();
+  return { sys.instructions, cycles, sys.counters.loads, sys.counters.stores, sys.counters.branches_taken };
+}
+
+template<typename System> struct System_View final : Core_View
+{
+  explicit System_View(const System &t_sys) noexcept : sys{ t_sys } {}
+
+  [[nodiscard]] std::uint64_t cycles() const noexcept override { return sys.cycles(); }
+  [[nodiscard]] Core_Counters counters() const noexcept override { return counters_of(sys); }
+
+  const System &sys;
+};
+
+// Event ids on the System's scheduler carry the index of the device in the upper half
+template<typename System> struct System_Context final : Core_Context
+{
+  System_Context(System &t_sys, const std::uint32_t t_device) noexcept : sys{ t_sys }, device{ t_device } {}
+
+  [[nodiscard]] std::uint64_t cycles() const noexcept override { return sys.cycles(); }
+  [[nodiscard]] Core_Counters counters() const noexcept override { return counters_of(sys); }
+  void schedule(const std::uint64_t due_cycle, const std::uint32_t id) noexcept override { sys.scheduler.schedule(due_cycle, (device << 16) | id); }
+  void cancel(const std::uint32_t id) noexcept override { sys.scheduler.cancel((device << 16) | id); }
+  void set_interrupt_lines(const bool irq, const bool fiq) noexcept override { sys.interrupts = { irq, fiq }; }
+  void wait_for_interrupt() noexcept override { sys.wait_for_interrupt(); }
+
+  [[nodiscard]] std::uint8_t *memory(const std::uint32_t loc, const std::size_t length) noexcept override
+  {
+    if (loc > sys.builtin_ram.size() || length > sys.builtin_ram.size() - loc) { return nullptr; }
+    return sys.builtin_ram.data() + loc;  // NOLINT
+  }
+
+  System &sys;
+  std::uint32_t device;
+};
+
+// The memory mapped devices of the cpp_box machine, used as the MMIO_Callback of arm::System.
+struct Devices
+{
+  Devices();
+
+  [[nodiscard]] Random_Device &random() const noexcept { return *m_random; }
+  [[nodiscard]] Interrupt_Controller &interrupt_controller() const noexcept { return *m_interrupt_controller; }
+  [[nodiscard]] Timer &timer(const std::size_t index) const noexcept { return *m_timers.at(index); }
+  [[nodiscard]] Core_Registers &core_registers() const noexcept { return *m_core_registers; }
+  [[nodiscard]] Dma &dma() const noexcept { return *m_dma; }
+  [[nodiscard]] Blitter &blitter() const noexcept { return *m_blitter; }
+  [[nodiscard]] Pmu &pmu() const noexcept { return *m_pmu; }
+  [[nodiscard]] Trace_Markers &trace_markers() const noexcept { return *m_trace_markers; }
+
+  // Makes this the id'th core of a multi core machine. Also bounds idle loop skipping to
+  // Core_Registers::doorbell_poll_interval, so that memory written by other cores is seen.
+  template<typename System> void join(System &sys, const std::uint32_t id, std::shared_ptr<Mailboxes> shared) noexcept
+  {
+    const auto *mapping = bus.find(static_cast<std::uint32_t>(system::Memory_Map::CORE_ID));
+    if (mapping == nullptr) { return; }
+    System_Context<System> context{ sys, mapping->index };
+    core_registers().join(context, id, std::move(shared));
+  }
+
+  // the save_state of each device in the order they are mapped, restore_state returns false if the state is of other devices
+  [[nodiscard]] std::vector<std::vector<std::uint32_t>> save_state() const;
+  bool restore_state(const std::vector<std::vector<std::uint32_t>> &state);
+
+  [[nodiscard]] bool is_mmio_range(const std::uint32_t loc) const noexcept { return bus.find(loc) != nullptr; }
+
+  // Accesses outside of the registers of a device read 0 and ignore writes
+  template<typename System>[[nodiscard]] std::uint32_t read_word(const System &sys, const std::uint32_t loc) const noexcept
+  {
+    const auto *mapping = bus.find(loc);
+    if (mapping == nullptr) { return 0; }
+    return mapping->device->read(System_View<System>{ sys }, (loc & ~3u) - mapping->begin);
+  }
+
+  // Sub word reads return the addressed lane of the register
+  template<typename System>[[nodiscard]] std::uint16_t read_half_word(const System &sys, const std::uint32_t loc) const noexcept
+  {
+    return static_cast<std::uint16_t>(read_word(sys, loc) >> ((loc & 3u) * 8));
+  }
+
+  template<typename System>[[nodiscard]] std::uint8_t read_byte(const System &sys, const std::uint32_t loc) const noexcept
+  {
+    return static_cast<std::uint8_t>(read_word(sys, loc) >> ((loc & 3u) * 8));
+  }
+
+  template<typename System> void write_word(System &sys, const std::uint32_t loc, const std::uint32_t value) noexcept
+  {
+    const auto *mapping = bus.find(loc);
+    if (mapping == nullptr) { return; }
+    System_Context<System> context{ sys, mapping->index };
+    mapping->device->write(context, (loc & ~3u) - mapping->begin, value);
+  }
+
+  // Sub word writes to the low lane of a register write the zero extended value, those to other lanes are
+  // ignored. Registers are not read back to merge the value, reads have side effects on several devices.
+  template<typename System> void write_half_word(System &sys, const std::uint32_t loc, const std::uint16_t value) noexcept
+  {
+    if ((loc & 3u) == 0) { write_word(sys, loc, value); }
+  }
+
+  template<typename System> void write_byte(System &sys, const std::uint32_t loc, const std::uint8_t value) noexcept
+  {
+    if ((loc & 3u) == 0) { write_word(sys, loc, value); }
+  }
+
+  // ids of no device, eg from a damaged save state, are ignored
+  template<typename System> void event(System &sys, const std::uint32_t id) noexcept
+  {
+    if ((id >> 16) >= bus.size()) { return; }
+    System_Context<System> context{ sys, id >> 16 };
+    bus.device(id >> 16).event(context, id & 0xFFFF);
+  }
+
+  Device_Bus bus;
+
+private:
+  Random_Device *m_random{ nullptr };
+  Interrupt_Controller *m_interrupt_controller{ nullptr };
+  std::array<Timer *, 2> m_timers{};
+  Core_Registers *m_core_registers{ nullptr };
+  Dma *m_dma{ nullptr };
+  Blitter *m_blitter{ nullptr };
+  Pmu *m_pmu{ nullptr };
+  Trace_Markers *m_trace_markers{ nullptr };
+};
+
+}  // namespace cpp_box::devices
+
+#endif
@@ -279,6 +279,8 @@ struct Symbol_Table_Entry
 
   [[nodiscard]] constexpr auto size() const noexcept { return read(Fields::st_size); }
 
+  [[nodiscard]] constexpr auto type() const noexcept { return static_cast<Type>(read(Fields::st_info) & 0xF); }
+
 
   [[nodiscard]] constexpr auto read(const Fields field) const noexcept -> std::uint64_t
   {
@@ -418,6 +420,8 @@ struct Section_Header
 
   [[nodiscard]] constexpr auto offset() const noexcept { return read(Fields::sh_offset); }
 
+  [[nodiscard]] constexpr auto flags() const noexcept { return read(Fields::sh_flags); }
+
   [[nodiscard]] constexpr auto name_substr(const std::basic_string_view<std::uint8_t> string_table) const noexcept
   {
     const auto name_loc   = name_offset();
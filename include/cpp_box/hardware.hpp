@@ -1,6 +1,7 @@
 #ifndef CPP_BOX_HARDWARE_HPP
 #define CPP_BOX_HARDWARE_HPP
 
+#include <array>
 #include <cstring>
 #include <cstdint>
 #include <cstddef>
@@ -35,6 +36,365 @@ struct Hardware
 
 };
 
+struct Interrupts
+{
+  using Handler = void (*)();
+
+  // handlers should be declared with __attribute__((interrupt("IRQ"))) / __attribute__((interrupt("FIQ")))
+  static void set_irq_handler(const Handler handler) { poke(static_cast<std::uint32_t>(system::Memory_Map::IRQ_HANDLER), handler); }
+  static void set_fiq_handler(const Handler handler) { poke(static_cast<std::uint32_t>(system::Memory_Map::FIQ_HANDLER), handler); }
+
+  // IRQ and FIQ modes have their own stack pointer, which must be set before interrupts are enabled
+  static void set_irq_stack(const std::uint32_t top) { set_banked_stack<0x12>(top); }
+  static void set_fiq_stack(const std::uint32_t top) { set_banked_stack<0x11>(top); }
+
+  static void enable(const system::Interrupt_Source source)
+  {
+    const auto enabled = peek<std::uint32_t>(static_cast<std::uint32_t>(system::Memory_Map::INTERRUPT_ENABLE));
+    poke(static_cast<std::uint32_t>(system::Memory_Map::INTERRUPT_ENABLE), enabled | static_cast<std::uint32_t>(source));
+  }
+
+  static void acknowledge(const system::Interrupt_Source source)
+  {
+    poke(static_cast<std::uint32_t>(system::Memory_Map::INTERRUPT_STATUS), static_cast<std::uint32_t>(source));
+  }
+
+  // clear the I and F bits of CPSR
+  static void unmask()
+  {
+    std::uint32_t cpsr;
+    asm volatile("mrs %0, cpsr" : "=r"(cpsr));
+    cpsr &= ~0xC0u;
+    asm volatile("msr cpsr_c, %0" ::"r"(cpsr) : "memory");
+  }
+
+  // the emulator skips ahead to the next timer expiry instead of executing a busy loop
+  static void wait() { poke(static_cast<std::uint32_t>(system::Memory_Map::WAIT_FOR_INTERRUPT), std::uint32_t{ 1 }); }
+
+private:
+  template<std::uint32_t Mode> static void set_banked_stack(const std::uint32_t top)
+  {
+    std::uint32_t cpsr;
+    asm volatile("mrs %0, cpsr" : "=r"(cpsr));
+    const auto mode_cpsr = (cpsr & ~0x1Fu) | Mode;
+    asm volatile("msr cpsr_c, %1\n"
+                 "mov sp, %2\n"
+                 "msr cpsr_c, %0" ::"r"(cpsr),
+                 "r"(mode_cpsr),
+                 "r"(top)
+                 : "memory");
+  }
+};
+
+// Cycle counting timers, expiry raises Interrupt_Source::TIMER_0 / TIMER_1
+struct Timer
+{
+  static void start(const int timer, const std::uint32_t period_cycles, const bool periodic)
+  {
+    poke(load_register(timer), period_cycles);
+    const auto control = static_cast<std::uint32_t>(system::Timer_Control::ENABLE)
+                         | (periodic ? static_cast<std::uint32_t>(system::Timer_Control::PERIODIC) : 0u);
+    poke(load_register(timer) + 4, control);
+  }
+
+  static void stop(const int timer) { poke(load_register(timer) + 4, std::uint32_t{ 0 }); }
+
+  static std::uint32_t remaining(const int timer) { return peek<std::uint32_t>(load_register(timer) + 8); }
+
+private:
+  static std::uint32_t load_register(const int timer)
+  {
+    return static_cast<std::uint32_t>(timer == 0 ? system::Memory_Map::TIMER_0_LOAD : system::Memory_Map::TIMER_1_LOAD);
+  }
+};
+
+// Multi core machines run the same program on every core, see arm_emu --cores
+struct Core
+{
+  static std::uint32_t id() { return peek<std::uint32_t>(static_cast<std::uint32_t>(system::Memory_Map::CORE_ID)); }
+  static std::uint32_t count() { return peek<std::uint32_t>(static_cast<std::uint32_t>(system::Memory_Map::CORE_COUNT)); }
+
+  // raises Interrupt_Source::DOORBELL on every core in core_mask
+  static void ring(const std::uint32_t core_mask) { poke(static_cast<std::uint32_t>(system::Memory_Map::DOORBELL), core_mask); }
+
+  static std::uint32_t mailbox(const std::uint32_t index) { return peek<std::uint32_t>(mailbox_address(index)); }
+  static void mailbox(const std::uint32_t index, const std::uint32_t value) { poke(mailbox_address(index), value); }
+
+private:
+  static std::uint32_t mailbox_address(const std::uint32_t index)
+  {
+    return static_cast<std::uint32_t>(system::Memory_Map::MAILBOX_0) + index * 4;
+  }
+};
+
+// Bulk copies and fills done by the host. Transfers run in the background, wait() before touching
+// the destination. Completion also raises Interrupt_Source::DMA.
+struct Dma
+{
+  static void copy(void *dest, const void *src, const std::uint32_t length)
+  {
+    start(address(dest), address(src), length, static_cast<std::uint32_t>(system::Dma_Control::START));
+  }
+
+  // the pattern is repeated at every word of the destination, so dest should be word aligned
+  static void fill(void *dest, const std::uint32_t pattern, const std::uint32_t length)
+  {
+    const auto control = static_cast<std::uint32_t>(system::Dma_Control::START) | static_cast<std::uint32_t>(system::Dma_Control::FILL);
+    start(address(dest), pattern, length, control);
+  }
+
+  static std::uint32_t status() { return peek<std::uint32_t>(static_cast<std::uint32_t>(system::Memory_Map::DMA_STATUS)); }
+  static bool busy() { return (status() & static_cast<std::uint32_t>(system::Dma_Status::BUSY)) != 0; }
+
+  // the emulator skips this polling loop ahead to the completion
+  static void wait()
+  {
+    while (busy()) {}
+  }
+
+private:
+  static std::uint32_t address(const void *ptr) { return static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(ptr)); }
+
+  static void start(const std::uint32_t dest, const std::uint32_t source, const std::uint32_t length, const std::uint32_t control)
+  {
+    poke(static_cast<std::uint32_t>(system::Memory_Map::DMA_SOURCE), source);
+    poke(static_cast<std::uint32_t>(system::Memory_Map::DMA_DESTINATION), dest);
+    poke(static_cast<std::uint32_t>(system::Memory_Map::DMA_LENGTH), length);
+    poke(static_cast<std::uint32_t>(system::Memory_Map::DMA_CONTROL), control);
+  }
+};
+
+// Queues drawing commands for the blitter in a ring of Size commands. Commands run when submit() is
+// called, or when the ring is full. Colors are 32bit RGBA, 0xAABBGGRR as a little endian word.
+template<std::uint32_t Size = 64> struct Blitter
+{
+  Blitter()
+  {
+    poke(static_cast<std::uint32_t>(system::Memory_Map::BLITTER_RING_BASE), address(ring.data()));
+    poke(static_cast<std::uint32_t>(system::Memory_Map::BLITTER_RING_SIZE), Size);
+    head = peek<std::uint32_t>(static_cast<std::uint32_t>(system::Memory_Map::BLITTER_TAIL));
+  }
+
+  void fill_rect(const std::int16_t x, const std::int16_t y, const std::uint16_t width, const std::uint16_t height, const std::uint32_t color)
+  {
+    push(command(system::Blit_Operation::FILL_RECT, color, 0, x, y, width, height));
+  }
+
+  // image is stride pixels wide, the top left width x height pixels are drawn
+  void copy_rect(const std::uint32_t *image,
+                 const std::uint16_t stride,
+                 const std::int16_t x,
+                 const std::int16_t y,
+                 const std::uint16_t width,
+                 const std::uint16_t height)
+  {
+    push(command(system::Blit_Operation::COPY_RECT, address(image), stride, x, y, width, height));
+  }
+
+  // pixels of image equal to color_key are not drawn
+  void copy_rect_keyed(const std::uint32_t *image,
+                       const std::uint16_t stride,
+                       const std::int16_t x,
+                       const std::int16_t y,
+                       const std::uint16_t width,
+                       const std::uint16_t height,
+                       const std::uint32_t color_key)
+  {
+    auto cmd      = command(system::Blit_Operation::COPY_RECT, address(image), stride, x, y, width, height);
+    cmd.flags     = static_cast<std::uint16_t>(system::Blit_Flags::COLOR_KEY);
+    cmd.color_key = color_key;
+    push(cmd);
+  }
+
+  void blend_rect(const std::uint32_t *image,
+                  const std::uint16_t stride,
+                  const std::int16_t x,
+                  const std::int16_t y,
+                  const std::uint16_t width,
+                  const std::uint16_t height)
+  {
+    push(command(system::Blit_Operation::BLEND_RECT, address(image), stride, x, y, width, height));
+  }
+
+  // draws the image_width x image_height image stretched to width x height, skipping pixels equal to color_key
+  void scaled_blit(const std::uint32_t *image,
+                   const std::uint16_t image_width,
+                   const std::uint16_t image_height,
+                   const std::int16_t x,
+                   const std::int16_t y,
+                   const std::uint16_t width,
+                   const std::uint16_t height,
+                   const std::uint32_t color_key)
+  {
+    auto cmd          = command(system::Blit_Operation::SCALED_BLIT, address(image), image_width, x, y, width, height);
+    cmd.source_width  = image_width;
+    cmd.source_height = image_height;
+    cmd.flags         = static_cast<std::uint16_t>(system::Blit_Flags::COLOR_KEY);
+    cmd.color_key     = color_key;
+    push(cmd);
+  }
+
+  void submit()
+  {
+    asm volatile("" ::: "memory");
+    poke(static_cast<std::uint32_t>(system::Memory_Map::BLITTER_HEAD), head);
+  }
+
+private:
+  static std::uint32_t address(const void *ptr) { return static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(ptr)); }
+
+  static system::Blit_Command command(const system::Blit_Operation operation,
+                                      const std::uint32_t source,
+                                      const std::uint16_t stride,
+                                      const std::int16_t x,
+                                      const std::int16_t y,
+                                      const std::uint16_t width,
+                                      const std::uint16_t height)
+  {
+    system::Blit_Command cmd{};
+    cmd.operation     = operation;
+    cmd.source        = source;
+    cmd.source_stride = stride;
+    cmd.x             = x;
+    cmd.y             = y;
+    cmd.width         = width;
+    cmd.height        = height;
+    return cmd;
+  }
+
+  void push(const system::Blit_Command &cmd)
+  {
+    // submitting runs every queued command, which frees the whole ring
+    if (head - peek<std::uint32_t>(static_cast<std::uint32_t>(system::Memory_Map::BLITTER_TAIL)) == Size) { submit(); }
+    ring[head % Size] = cmd;
+    ++head;
+  }
+
+  std::array<system::Blit_Command, Size> ring{};
+  std::uint32_t head{ 0 };
+};
+
+// Performance counters of the running core, eg to time a kernel:
+//   Pmu::reset(); Pmu::start(); kernel(); Pmu::stop(); const auto cycles = Pmu::cycles();
+// cycles() are the ARM7TDMI estimate of arm_emu --cycle-model, otherwise one per instruction.
+struct Pmu
+{
+  static void start() { control(static_cast<std::uint32_t>(system::Pmu_Control::ENABLE)); }
+  static void stop() { control(0); }
+
+  // keeps counting if started
+  static void reset()
+  {
+    const auto enabled = peek<std::uint32_t>(static_cast<std::uint32_t>(system::Memory_Map::PMU_CONTROL));
+    control(enabled | static_cast<std::uint32_t>(system::Pmu_Control::RESET));
+  }
+
+  static std::uint64_t instructions() { return read(system::Memory_Map::PMU_INSTRUCTIONS); }
+  static std::uint64_t cycles() { return read(system::Memory_Map::PMU_CYCLES); }
+  static std::uint64_t loads() { return read(system::Memory_Map::PMU_LOADS); }
+  static std::uint64_t stores() { return read(system::Memory_Map::PMU_STORES); }
+  static std::uint64_t branches_taken() { return read(system::Memory_Map::PMU_BRANCHES_TAKEN); }
+
+private:
+  static void control(const std::uint32_t value) { poke(static_cast<std::uint32_t>(system::Memory_Map::PMU_CONTROL), value); }
+
+  // the low word must be read first, it latches the high word
+  static std::uint64_t read(const system::Memory_Map counter)
+  {
+    const auto low  = peek<std::uint32_t>(static_cast<std::uint32_t>(counter));
+    const auto high = peek<std::uint32_t>(static_cast<std::uint32_t>(counter) + 4);
+    return (static_cast<std::uint64_t>(high) << 32) | low;
+  }
+};
+
+// Marks regions of the program, recorded by the emulator as spans, see arm_emu --trace-markers
+//   Trace::name(1, "physics"); ... Trace::begin(1); physics(); Trace::end(1);
+struct Trace
+{
+  static void name(const std::uint32_t id, const char *name)
+  {
+    poke(static_cast<std::uint32_t>(system::Memory_Map::TRACE_NAME_ID), id);
+    poke(static_cast<std::uint32_t>(system::Memory_Map::TRACE_NAME), static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(name)));
+  }
+
+  static void begin(const std::uint32_t id) { poke(static_cast<std::uint32_t>(system::Memory_Map::TRACE_BEGIN), id); }
+  static void end(const std::uint32_t id) { poke(static_cast<std::uint32_t>(system::Memory_Map::TRACE_END), id); }
+
+  // ends the span when going out of scope
+  struct Scope
+  {
+    explicit Scope(const std::uint32_t t_id) : id{ t_id } { begin(id); }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+    ~Scope() { end(id); }
+
+    std::uint32_t id;
+  };
+};
+
+// SWP is the only atomic read-modify-write of ARMv4
+inline std::uint32_t atomic_exchange(volatile std::uint32_t *loc, std::uint32_t value)
+{
+  std::uint32_t previous;
+  asm volatile("swp %0, %1, [%2]" : "=&r"(previous) : "r"(value), "r"(loc) : "memory");
+  return previous;
+}
+
+// Acquired and released through SWP. Plain stores of one core may become visible to the others in any order,
+// only SWP orders the stores of the critical section before the release.
+struct Spin_Lock
+{
+  void lock()
+  {
+    while (atomic_exchange(&locked, 1) != 0) {}
+  }
+
+  void unlock() { atomic_exchange(&locked, 0); }
+
+private:
+  volatile std::uint32_t locked{ 0 };
+};
+
+// Host native kernels, executed by the emulator on coprocessor 7 (system::ACCELERATOR_COPROCESSOR)
+struct Accelerator
+{
+  static_assert(system::ACCELERATOR_COPROCESSOR == 7, "coprocessor number is hardcoded in the asm below");
+
+  static std::int64_t dot_product(const std::int32_t *lhs, const std::int32_t *rhs, const std::uint32_t count)
+  {
+    asm volatile("mcr p7, 0, %0, c0, c0, 0" ::"r"(lhs));
+    asm volatile("mcr p7, 0, %0, c1, c0, 0" ::"r"(rhs));
+    asm volatile("mcr p7, 0, %0, c2, c0, 0" ::"r"(count));
+    asm volatile("cdp p7, 0, c4, c0, c1, 0" ::: "memory");
+    std::uint32_t low;
+    std::uint32_t high;
+    asm volatile("mrc p7, 0, %0, c4, c0, 0" : "=r"(low));
+    asm volatile("mrc p7, 0, %0, c5, c0, 0" : "=r"(high));
+    return static_cast<std::int64_t>((static_cast<std::uint64_t>(high) << 32) | low);
+  }
+
+  static std::uint32_t crc32(const void *data, const std::uint32_t length, const std::uint32_t crc = 0)
+  {
+    asm volatile("mcr p7, 0, %0, c0, c0, 0" ::"r"(data));
+    asm volatile("mcr p7, 0, %0, c2, c0, 0" ::"r"(length));
+    asm volatile("mcr p7, 0, %0, c3, c0, 0" ::"r"(crc));
+    asm volatile("cdp p7, 1, c4, c0, c0, 0" ::: "memory");
+    std::uint32_t result;
+    asm volatile("mrc p7, 0, %0, c4, c0, 0" : "=r"(result));
+    return result;
+  }
+
+  // dest[i] = matrix * src[i], matrix is 4x4 row major and Q16.16 fixed point, vectors are 4 x int32
+  static void transform_4x4(const std::int32_t *matrix, const std::int32_t *src, std::int32_t *dest, const std::uint32_t count)
+  {
+    asm volatile("mcr p7, 0, %0, c0, c0, 0" ::"r"(src));
+    asm volatile("mcr p7, 0, %0, c1, c0, 0" ::"r"(dest));
+    asm volatile("mcr p7, 0, %0, c2, c0, 0" ::"r"(count));
+    asm volatile("mcr p7, 0, %0, c3, c0, 0" ::"r"(matrix));
+    asm volatile("cdp p7, 2, c1, c0, c3, 0" ::: "memory");
+  }
+};
+
 }  // namespace cpp_box
 
 #endif
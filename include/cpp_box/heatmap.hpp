@@ -0,0 +1,88 @@
+#ifndef CPP_BOX_HEATMAP_HPP
+#define CPP_BOX_HEATMAP_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "compiler.hpp"
+#include "memory_map.hpp"
+
+namespace cpp_box::heatmap {
+
+struct Counts
+{
+  std::uint64_t reads{ 0 };
+  std::uint64_t writes{ 0 };
+
+  [[nodiscard]] constexpr std::uint64_t total() const noexcept { return reads + writes; }
+};
+
+// Memory_Observer of arm::System counting the loads and stores of every 4 KB page of guest memory.
+// Counting is an increment in a flat array, so a run with the heatmap stays close to full speed.
+// Words in an optional tracked range, usually the loaded image, are counted one by one to attribute
+// accesses to data symbols. Instruction fetches are not counted.
+struct Memory_Heatmap
+{
+  constexpr static std::uint32_t page_bits = 12;
+  constexpr static std::uint32_t page_size = 1u << page_bits;
+
+  explicit Memory_Heatmap(const std::uint32_t ram_size = system::TOTAL_RAM) : pages((ram_size + page_size - 1) >> page_bits) {}
+
+  void track_words(const std::uint32_t begin, const std::uint32_t end)
+  {
+    words_begin = begin;
+    words.assign(end > begin ? (end - begin + 3) / 4 : 0, Counts{});
+  }
+
+  template<typename System> [[nodiscard]] constexpr std::uint32_t fetch(const System & /*sys*/, const std::uint32_t /*pc*/) noexcept { return 0; }
+
+  template<typename System>
+  [[nodiscard]] std::uint32_t access(const System & /*sys*/,
+                                     const std::uint32_t /*pc*/,
+                                     const std::uint32_t loc,
+                                     const std::uint32_t /*size*/,
+                                     const bool write) noexcept
+  {
+    if (!enabled) { return 0; }
+    if (const auto page = loc >> page_bits; page < pages.size()) { ++(write ? pages[page].writes : pages[page].reads); }
+    // wraps around below words_begin
+    if (const auto word = (loc - words_begin) >> 2; word < words.size()) { ++(write ? words[word].writes : words[word].reads); }
+    return 0;
+  }
+
+  void reset() noexcept
+  {
+    std::fill(pages.begin(), pages.end(), Counts{});
+    std::fill(words.begin(), words.end(), Counts{});
+  }
+
+  bool enabled{ true };
+  std::vector<Counts> pages;
+  std::uint32_t words_begin{ 0 };
+  std::vector<Counts> words;
+};
+
+// an STT_OBJECT symbol of the ELF file, [begin, end) in guest addresses
+struct Data_Symbol
+{
+  std::string name;
+  std::uint32_t begin;
+  std::uint32_t end;
+};
+
+struct Symbol_Counts
+{
+  const Data_Symbol *symbol;
+  Counts counts;
+};
+
+[[nodiscard]] std::vector<Data_Symbol> data_symbols(const Loaded_Files &files);
+
+// accesses per symbol from the tracked words, most accessed first, symbols that were never accessed are left out
+[[nodiscard]] std::vector<Symbol_Counts> symbol_counts(const Memory_Heatmap &heatmap, const std::vector<Data_Symbol> &symbols);
+
+}  // namespace cpp_box::heatmap
+
+#endif
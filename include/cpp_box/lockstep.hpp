@@ -0,0 +1,178 @@
+#ifndef CPP_BOX_LOCKSTEP_HPP
+#define CPP_BOX_LOCKSTEP_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include "arm.hpp"
+
+namespace cpp_box {
+struct Loaded_Files;
+}  // namespace cpp_box
+
+namespace cpp_box::lockstep {
+
+// Differential checking of an execution engine against the reference interpreter: both run the same image block
+// by block, a block ending with the first instruction that does not continue with the next one, and their
+// registers and CPSR are compared after every block_interval blocks. Memory is compared by hash every
+// memory_interval instructions, and once more at the end. Engines that execute whole blocks at once provide
+// `std::uint32_t run_block()`, returning the address of the block's last instruction, any other engine is
+// stepped with next_operation like the reference.
+
+enum struct Difference {
+  NONE,
+  REGISTER,
+  CPSR,
+  MEMORY,
+  FINISHED  // one engine returned from main and the other did not
+};
+
+struct Settings
+{
+  std::uint64_t block_interval{ 1 };
+  std::uint64_t memory_interval{ 10'000'000 };  // 0 compares memory at the end only
+  std::uint64_t max_instructions{ std::numeric_limits<std::uint64_t>::max() };
+};
+
+struct Divergence
+{
+  constexpr static std::size_t max_block_words = 16;
+
+  Difference difference{ Difference::NONE };
+  std::size_t register_index{ 0 };  // of a REGISTER difference
+  std::uint64_t expected{ 0 };  // register, CPSR or memory hash of the reference
+  std::uint64_t actual{ 0 };
+  std::uint64_t instructions{ 0 };  // executed by the reference when the difference was found
+  std::uint64_t last_match{ 0 };  // instructions executed at the last comparison without differences
+
+  // the block executed last, up to its first max_block_words instructions as the reference's memory holds them
+  std::uint32_t block_begin{ 0 };
+  std::uint32_t block_last{ 0 };
+  std::array<std::uint32_t, max_block_words> block_words{};
+
+  [[nodiscard]] constexpr explicit operator bool() const noexcept { return difference != Difference::NONE; }
+};
+
+template<typename Engine, typename = void> struct Has_Run_Block : std::false_type
+{
+};
+
+template<typename Engine> struct Has_Run_Block<Engine, std::void_t<decltype(std::declval<Engine &>().run_block())>> : std::true_type
+{
+};
+
+template<typename Engine> [[nodiscard]] constexpr bool finished(const Engine &engine) noexcept
+{
+  return !engine.operations_remaining() || engine.stalled();
+}
+
+// returns the address of the block's last instruction
+template<typename Engine> constexpr std::uint32_t run_block(Engine &engine)
+{
+  if constexpr (Has_Run_Block<Engine>::value) {
+    return engine.run_block();
+  } else {
+    while (true) {
+      const auto pc = engine.PC() - 4;
+      engine.next_operation();
+      if (engine.PC() - 4 != pc + 4 || finished(engine)) { return pc; }
+    }
+  }
+}
+
+// FNV-1a of the RAM, bypassing MMIO
+template<typename Engine> [[nodiscard]] constexpr std::uint64_t memory_hash(const Engine &engine) noexcept
+{
+  std::uint64_t hash = 0xcbf2'9ce4'8422'2325;
+  for (std::size_t loc = 0; loc < engine.builtin_ram.size(); ++loc) {
+    hash ^= engine.builtin_ram[loc];
+    hash *= 0x100'0000'01b3;
+  }
+  return hash;
+}
+
+template<typename Reference, typename Candidate>
+[[nodiscard]] constexpr Divergence compare(const Reference &reference, const Candidate &candidate, const bool memory) noexcept
+{
+  Divergence divergence;
+  divergence.instructions = reference.instructions;
+
+  const auto differs = [&divergence](const Difference difference, const std::uint64_t expected, const std::uint64_t actual) {
+    divergence.difference = difference;
+    divergence.expected   = expected;
+    divergence.actual     = actual;
+    return divergence;
+  };
+
+  if (finished(reference) != finished(candidate)) { return differs(Difference::FINISHED, finished(reference), finished(candidate)); }
+
+  for (std::size_t reg = 0; reg < reference.registers.size(); ++reg) {
+    if (reference.registers[reg] != candidate.registers[reg]) {
+      divergence.register_index = reg;
+      return differs(Difference::REGISTER, reference.registers[reg], candidate.registers[reg]);
+    }
+  }
+
+  if (reference.CSPR != candidate.CSPR) { return differs(Difference::CPSR, reference.CSPR, candidate.CSPR); }
+
+  if (memory) {
+    if (const auto expected = memory_hash(reference), actual = memory_hash(candidate); expected != actual) {
+      return differs(Difference::MEMORY, expected, actual);
+    }
+  }
+
+  return divergence;
+}
+
+// Runs both from `entry` until either returns from main or stalls, the reference reaches settings.max_instructions,
+// or until the first comparison that finds a difference. A finished engine is not stepped any further, the
+// comparison right after it finished reports a FINISHED difference unless both did
+template<typename Reference, typename Candidate>
+[[nodiscard]] constexpr Divergence run(Reference &reference, Candidate &candidate, const std::uint32_t entry, const Settings settings = {})
+{
+  reference.setup_run(entry);
+  candidate.setup_run(entry);
+
+  std::uint64_t blocks      = 0;
+  std::uint64_t last_match  = 0;
+  std::uint64_t next_memory = settings.memory_interval;
+
+  while (true) {
+    const auto begin = reference.PC() - 4;
+    const auto last  = run_block(reference);
+    if (!finished(candidate)) { run_block(candidate); }
+
+    const auto done = finished(reference) || finished(candidate) || reference.instructions >= settings.max_instructions;
+    const auto check_memory = done || (settings.memory_interval != 0 && reference.instructions >= next_memory);
+
+    if (done || check_memory || ++blocks % std::max(settings.block_interval, std::uint64_t{ 1 }) == 0) {
+      auto divergence       = compare(reference, candidate, check_memory);
+      divergence.last_match = last_match;
+
+      if (divergence) {
+        divergence.block_begin = begin;
+        divergence.block_last  = last;
+        for (std::size_t idx = 0; idx < divergence.block_words.size() && begin + idx * 4 <= last; ++idx) {
+          divergence.block_words[idx] = reference.read_word(static_cast<std::uint32_t>(begin + idx * 4));
+        }
+        return divergence;
+      }
+
+      last_match = reference.instructions;
+      if (check_memory) { next_memory = reference.instructions + settings.memory_interval; }
+      if (done) { return divergence; }
+    }
+  }
+}
+
+// the difference and the disassembly of the block it was found after, from location_data when the files have it
+void write_divergence(std::ostream &os, const Divergence &divergence, const Loaded_Files &files);
+
+}  // namespace cpp_box::lockstep
+
+#endif
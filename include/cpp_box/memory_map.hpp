@@ -6,8 +6,7 @@ namespace cpp_box::system {
 constexpr static std::uint32_t TOTAL_RAM = 1024 * 1024 * 10;  // 10 MB
 
 enum struct Memory_Map : std::uint32_t {
-  // TODO: Add interrupt vectors here
-  //
+  // the exception vector table overlaps the registers, only IRQ_HANDLER and FIQ_HANDLER are in use
   REGISTER_START = 0x00000000,
   RAM_SIZE       = REGISTER_START + 0x0000,
   SCREEN_WIDTH   = REGISTER_START + 0x0004,  // 16bit screen width
@@ -30,12 +29,115 @@ enum struct Memory_Map : std::uint32_t {
   // 0xA000B,  // 8bit Vertical aspect
   SCREEN_BUFFER  = REGISTER_START + 0x000C,  // 32bit pointer to current framebuffer
   RANDOM_DEVICE  = REGISTER_START + 0x0010,  // 32bits of random data
+  IRQ_HANDLER    = REGISTER_START + 0x0018,  // 32bit address of the IRQ handler, see arm::Exception_Vector
+  FIQ_HANDLER    = REGISTER_START + 0x001C,  // 32bit address of the FIQ handler
+
+  INTERRUPT_STATUS     = REGISTER_START + 0x0020,  // 32bit raised Interrupt_Sources, write 1s to acknowledge
+  INTERRUPT_ENABLE     = REGISTER_START + 0x0024,  // 32bit Interrupt_Sources that are passed on to the core
+  INTERRUPT_FIQ_SELECT = REGISTER_START + 0x0028,  // 32bit Interrupt_Sources raising FIQ instead of IRQ
+  WAIT_FOR_INTERRUPT   = REGISTER_START + 0x002C,  // any write halts the core until an interrupt is raised
+
+  TIMER_0_LOAD    = REGISTER_START + 0x0030,  // 32bit period in cycles
+  TIMER_0_CONTROL = REGISTER_START + 0x0034,  // 32bit Timer_Control, writing (re)starts the timer
+  TIMER_0_VALUE   = REGISTER_START + 0x0038,  // 32bit read only, cycles until the timer expires
+  TIMER_1_LOAD    = REGISTER_START + 0x0040,
+  TIMER_1_CONTROL = REGISTER_START + 0x0044,
+  TIMER_1_VALUE   = REGISTER_START + 0x0048,
+
+  CORE_ID    = REGISTER_START + 0x0050,  // 32bit read only, index of the reading core
+  CORE_COUNT = REGISTER_START + 0x0054,  // 32bit read only
+  DOORBELL   = REGISTER_START + 0x0058,  // 32bit write a mask of cores to raise Interrupt_Source::DOORBELL on
+  MAILBOX_0  = REGISTER_START + 0x0060,  // MAILBOX_COUNT 32bit words shared by all cores, MAILBOX_0 + 4 * n
+
+  DMA_SOURCE      = REGISTER_START + 0x0080,  // 32bit source address, or the 32bit pattern to fill with
+  DMA_DESTINATION = REGISTER_START + 0x0084,  // 32bit destination address
+  DMA_LENGTH      = REGISTER_START + 0x0088,  // 32bit length in bytes
+  DMA_CONTROL     = REGISTER_START + 0x008C,  // 32bit Dma_Control, writing with START set begins a transfer
+  DMA_STATUS      = REGISTER_START + 0x0090,  // 32bit read only Dma_Status
+
+  BLITTER_RING_BASE = REGISTER_START + 0x00A0,  // 32bit address of a ring of Blit_Commands
+  BLITTER_RING_SIZE = REGISTER_START + 0x00A4,  // 32bit number of Blit_Commands in the ring
+  BLITTER_HEAD      = REGISTER_START + 0x00A8,  // 32bit index after the last queued command, writing runs the commands up to it.
+                                                 // Heads more than BLITTER_RING_SIZE commands ahead of the tail are ignored
+  BLITTER_TAIL      = REGISTER_START + 0x00AC,  // 32bit read only, index of the next command to run
+
+  // 64bit counters are two words, reading the low word latches the high word
+  PMU_CONTROL        = REGISTER_START + 0x00B0,  // 32bit Pmu_Control
+  PMU_INSTRUCTIONS   = REGISTER_START + 0x00B8,  // 64bit retired instructions
+  PMU_CYCLES         = REGISTER_START + 0x00C0,  // 64bit estimated cycles, one per instruction unless the cycle model is enabled
+  PMU_LOADS          = REGISTER_START + 0x00C8,  // 64bit load instructions
+  PMU_STORES         = REGISTER_START + 0x00D0,  // 64bit store instructions
+  PMU_BRANCHES_TAKEN = REGISTER_START + 0x00D8,  // 64bit taken branches
+
+  TRACE_BEGIN   = REGISTER_START + 0x00E0,  // 32bit write a marker id to begin a span, spans nest
+  TRACE_END     = REGISTER_START + 0x00E4,  // 32bit write the marker id of the span to end
+  TRACE_NAME_ID = REGISTER_START + 0x00E8,  // 32bit marker id the next TRACE_NAME write names
+  TRACE_NAME    = REGISTER_START + 0x00EC,  // 32bit address of a nul terminated name
+
   USER_RAM_START = REGISTER_START + 0x1000,  // leave more space for registers, this is where binaries will load
 };
 
+enum struct Interrupt_Source : std::uint32_t { TIMER_0 = 0b0001, TIMER_1 = 0b0010, DOORBELL = 0b0100, DMA = 0b1000 };
+
+constexpr static std::uint32_t MAX_CORES     = 8;
+constexpr static std::uint32_t MAILBOX_COUNT = 8;
+
+enum struct Timer_Control : std::uint32_t {
+  ENABLE   = 0b01,
+  PERIODIC = 0b10  // reload and keep running on expiry, otherwise the timer disables itself
+};
+
+enum struct Dma_Control : std::uint32_t {
+  START = 0b01,
+  FILL  = 0b10  // fill the destination with the pattern in DMA_SOURCE instead of copying
+};
+
+// a transfer completes after DMA_LENGTH / Dma::bytes_per_cycle cycles and raises Interrupt_Source::DMA
+enum struct Dma_Status : std::uint32_t {
+  BUSY  = 0b01,
+  ERROR = 0b10  // the last transfer was not entirely inside of RAM and was not done
+};
+
+// Blitter commands draw on the 32bpp screen at SCREEN_BUFFER, rectangles are clipped to the screen
+enum struct Blit_Operation : std::uint16_t {
+  FILL_RECT   = 0,  // fill with the color in source
+  COPY_RECT   = 1,
+  BLEND_RECT  = 2,  // blend the source over the screen by the source's alpha
+  SCALED_BLIT = 3   // nearest neighbor scaling of source_width x source_height to width x height
+};
+
+enum struct Blit_Flags : std::uint16_t {
+  COLOR_KEY = 0b1  // COPY_RECT and SCALED_BLIT skip source pixels equal to color_key
+};
+
+// ring indexes are free running, a command's entry is index % BLITTER_RING_SIZE
+struct Blit_Command
+{
+  Blit_Operation operation;
+  std::uint16_t flags;          // Blit_Flags
+  std::uint32_t source;         // address of the 32bit RGBA source image, or the FILL_RECT color
+  std::uint32_t color_key;
+  std::uint16_t source_stride;  // pixels per row of the source image
+  std::uint16_t source_width;
+  std::uint16_t source_height;
+  std::int16_t x;
+  std::int16_t y;
+  std::uint16_t width;
+  std::uint16_t height;
+  std::uint16_t reserved;
+};
+
+enum struct Pmu_Control : std::uint32_t {
+  ENABLE = 0b01,  // counters only count while enabled
+  RESET  = 0b10   // zero all counters
+};
+
 constexpr static std::uint32_t DEFAULT_SCREEN_BUFFER = TOTAL_RAM - (1024 * 1024 * 2);  // by default VRAM is 2 MB from top
 constexpr static std::uint32_t STACK_START           = TOTAL_RAM - 1;
 
+// coprocessor number of the host native kernel accelerator, see cpp_box::Accelerator
+constexpr static std::uint32_t ACCELERATOR_COPROCESSOR = 7;
+
 }  // namespace cpp_box
 
 #endif
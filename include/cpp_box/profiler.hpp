@@ -0,0 +1,277 @@
+#ifndef CPP_BOX_PROFILER_HPP
+#define CPP_BOX_PROFILER_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "compiler.hpp"
+#include "memory_map.hpp"
+
+namespace cpp_box::profiler {
+
+// Records the PC of every interval'th instruction, to be passed as the tracer of System::run or run_until.
+// Samples are counted per object offset, the key of Loaded_Files::location_data.
+struct Sampling_Profiler
+{
+  // prime, so that samples do not alias with the period of a guest loop
+  constexpr static std::uint32_t default_interval = 1009;
+
+  explicit Sampling_Profiler(const std::uint32_t t_interval = default_interval) noexcept
+    : interval{ t_interval == 0 ? 1 : t_interval }, countdown{ interval }
+  {
+  }
+
+  template<typename System, typename Instruction> void operator()(const System & /*sys*/, const std::uint32_t pc, const Instruction /*ins*/)
+  {
+    if (--countdown != 0) { return; }
+    countdown = interval;
+    ++samples;
+    ++hits[pc - static_cast<std::uint32_t>(system::Memory_Map::USER_RAM_START)];
+  }
+
+  void reset() noexcept
+  {
+    hits.clear();
+    samples   = 0;
+    countdown = interval;
+  }
+
+  std::uint32_t interval;
+  std::uint32_t countdown;
+  std::uint64_t samples{ 0 };
+  std::unordered_map<std::uint32_t, std::uint64_t> hits;
+};
+
+struct Profile_Entry
+{
+  std::string name;
+  std::uint64_t samples{};
+};
+
+// Samples summed up per instruction, source line and function, each sorted by samples, highest first
+struct Profile
+{
+  std::uint64_t samples{};
+  std::uint32_t interval{};
+  std::vector<Profile_Entry> instructions;
+  std::vector<Profile_Entry> lines;
+  std::vector<Profile_Entry> functions;
+};
+
+[[nodiscard]] Profile summarize(const Sampling_Profiler &profiler, const Loaded_Files &files);
+
+// Self time report, one section each for functions, lines and instructions
+void write_report(std::ostream &os, const Profile &profile, std::size_t max_entries = 50);
+
+// Samples per line number of `filename`, for annotating a source listing
+[[nodiscard]] std::unordered_map<int, std::uint64_t>
+  line_samples(const Sampling_Profiler &profiler, const Loaded_Files &files, const std::filesystem::path &filename);
+
+
+// Rebuilds the guest call stack from every retired instruction, to be passed as the tracer of System::run or run_until.
+// A branch taken right after BL or `mov lr, pc` is a call. A branch taken by `mov pc, lr`, `bx lr`, `ldr pc` or
+// `ldm` with PC returns to the innermost frame expecting that address, unwinding any frames in between.
+// Only a few compares on the raw instruction word are done per instruction, the stack is only touched on branches.
+struct Call_Graph_Profiler
+{
+  // deeper calls, eg runaway recursion, are counted in the frame at this depth
+  constexpr static std::size_t max_depth = 1024;
+
+  struct Node
+  {
+    std::uint32_t function;
+    std::uint32_t parent;
+    std::uint64_t self{ 0 };
+    std::vector<std::uint32_t> children{};
+  };
+
+  template<typename System, typename Instruction> void operator()(const System & /*sys*/, const std::uint32_t pc, const Instruction ins)
+  {
+    if (frames.empty()) {
+      start(pc);
+    } else if (pc != last_pc + 4) {
+      branch(pc);
+    } else if (pc == link_address) {
+      linked = false;
+    }
+
+    const auto word = ins.data();
+    if ((word & 0x0F00'0000) == 0x0B00'0000) {
+      // BL
+      linked       = true;
+      link_address = pc + 4;
+    } else if ((word & 0x0FFF'FFFF) == 0x01A0'E00F) {
+      // mov lr, pc, the call is the next instruction
+      linked       = true;
+      link_address = pc + 8;
+    }
+
+    returning = (word & 0x0FFF'FFFF) == 0x01A0'F00E      // mov pc, lr
+                || (word & 0x0FFF'FFFF) == 0x012F'FF1E   // bx lr
+                || (word & 0x0E10'8000) == 0x0810'8000   // ldm with pc in the list
+                || (word & 0x0C10'F000) == 0x0410'F000;  // ldr pc
+
+    last_pc = pc;
+    ++nodes[frames.back().node].self;
+  }
+
+  void reset() noexcept
+  {
+    nodes.clear();
+    frames.clear();
+    linked    = false;
+    returning = false;
+  }
+
+  // instructions executed in the node and in everything it called, indexed like nodes
+  [[nodiscard]] std::vector<std::uint64_t> inclusive() const;
+
+  // nodes[0] is the function the run started in, children always come after their parent
+  std::vector<Node> nodes;
+
+private:
+  struct Frame
+  {
+    std::uint32_t node;
+    std::uint32_t return_address;
+  };
+
+  void start(const std::uint32_t pc)
+  {
+    nodes.assign(1, Node{ pc, 0 });
+    frames.push_back(Frame{ 0, 0 });
+  }
+
+  void branch(const std::uint32_t pc)
+  {
+    if (linked) {
+      linked = false;
+      call(pc);
+    } else if (returning) {
+      for (auto frame = frames.size(); frame > 1; --frame) {
+        if (frames[frame - 1].return_address == pc) {
+          frames.resize(frame - 1);
+          return;
+        }
+      }
+    }
+  }
+
+  void call(const std::uint32_t function)
+  {
+    const auto parent = frames.back().node;
+    if (frames.size() >= max_depth) {
+      frames.push_back(Frame{ parent, link_address });
+      return;
+    }
+
+    for (const auto child : nodes[parent].children) {
+      if (nodes[child].function == function) {
+        frames.push_back(Frame{ child, link_address });
+        return;
+      }
+    }
+
+    const auto child = static_cast<std::uint32_t>(nodes.size());
+    nodes.push_back(Node{ function, parent });
+    nodes[parent].children.push_back(child);
+    frames.push_back(Frame{ child, link_address });
+  }
+
+  std::vector<Frame> frames;
+  std::uint32_t last_pc{ 0 };
+  std::uint32_t link_address{ 0 };
+  bool linked{ false };
+  bool returning{ false };
+};
+
+// Guest addresses of the functions in the ELF symbol table of `files`, demangled where possible
+[[nodiscard]] std::map<std::uint32_t, std::string> function_symbols(const Loaded_Files &files);
+
+// One line per call stack, `outer;inner;innermost count`, with the instructions executed in the innermost function.
+// This is the folded format read by flamegraph.pl, speedscope and similar tools.
+void write_folded_stacks(std::ostream &os, const Call_Graph_Profiler &profiler, const std::map<std::uint32_t, std::string> &symbols);
+
+// Indented call tree with inclusive and exclusive instruction counts, hottest callees first
+void write_call_tree(std::ostream &os, const Call_Graph_Profiler &profiler, const std::map<std::uint32_t, std::string> &symbols);
+
+
+// Counts how often the condition of each conditional instruction passed or failed, evaluated with the flags the
+// instruction sees, to be passed as the tracer of System::run or run_until. Instructions that may write the PC
+// (B, BL, BX, `ldr pc`, `ldm` with PC, data processing into PC) also get a histogram of the addresses they jumped to.
+// Flips count how often the outcome differed from the previous one, a branch passing half the time that flips
+// rarely is still predictable, one that flips on almost every execution is not.
+struct Branch_Profiler
+{
+  struct Branch
+  {
+    std::uint64_t passed{ 0 };
+    std::uint64_t failed{ 0 };
+    std::uint64_t flips{ 0 };
+    bool last_passed{ false };
+    std::map<std::uint32_t, std::uint64_t> targets{};
+  };
+
+  [[nodiscard]] static constexpr bool may_write_pc(const std::uint32_t word) noexcept
+  {
+    // TST, TEQ, CMP and CMN without S are MRS and MSR, whose Rd field is all ones
+    const bool data_processing = (word & 0x0C00'0000) == 0 && (word & 0x0190'0000) != 0x0100'0000;
+    return (word & 0x0E00'0000) == 0x0A00'0000                        // B, BL
+           || (word & 0x0FFF'FFF0) == 0x012F'FF10                     // BX
+           || (data_processing && (word & 0x0000'F000) == 0x0000'F000)  // data processing into pc
+           || (word & 0x0C10'F000) == 0x0410'F000                     // ldr pc
+           || (word & 0x0E10'8000) == 0x0810'8000;                    // ldm with pc in the list
+  }
+
+  template<typename System, typename Instruction> void operator()(const System &sys, const std::uint32_t pc, const Instruction ins)
+  {
+    if (jumping != nullptr && pc != jump_pc + 4) { ++jumping->targets[pc]; }
+    jumping = nullptr;
+
+    const bool conditional = !ins.unconditional();
+    const bool jump        = may_write_pc(ins.data());
+    if (!conditional && !jump) { return; }
+
+    auto &branch      = branches[pc];
+    const bool passed = !conditional || sys.check_condition(ins);
+    if (conditional) {
+      const auto executions = branch.passed + branch.failed;
+      if (executions != 0 && passed != branch.last_passed) { ++branch.flips; }
+      ++(passed ? branch.passed : branch.failed);
+      branch.last_passed = passed;
+    }
+
+    if (passed && jump) {
+      jumping = &branch;
+      jump_pc = pc;
+    }
+  }
+
+  void reset() noexcept
+  {
+    branches.clear();
+    jumping = nullptr;
+  }
+
+  // keyed by guest address, references into an unordered_map stay valid while it grows
+  std::unordered_map<std::uint32_t, Branch> branches;
+
+private:
+  Branch *jumping{ nullptr };
+  std::uint32_t jump_pc{ 0 };
+};
+
+// One row per profiled instruction, sorted by source line, with the targets as `address:count` separated by spaces
+void write_branch_csv(std::ostream &os, const Branch_Profiler &profiler, const Loaded_Files &files);
+
+// The same rows, grouped in an object keyed by source line
+void write_branch_json(std::ostream &os, const Branch_Profiler &profiler, const Loaded_Files &files);
+
+}  // namespace cpp_box::profiler
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef CPP_BOX_SMP_HPP
+#define CPP_BOX_SMP_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "devices.hpp"
+
+namespace cpp_box::smp {
+
+// RAM_Type for the cores of one machine, copies refer to the same bytes.
+//
+// Guest loads and stores are relaxed host atomics: aligned words and half words never tear, and
+// accesses of different cores are not ordered with respect to each other. Guests synchronize
+// through SWP, which is a sequentially consistent exchange, and must release locks through SWP
+// as well, a plain store does not publish the stores before it. Unaligned accesses are made of byte
+// accesses. DMA, the blitter and coprocessor kernels copy memory directly, guests must not
+// touch memory another core is transferring.
+//
+// The host is assumed to be little endian, like the guest.
+struct Shared_Memory
+{
+  Shared_Memory(const std::size_t size, const std::uint8_t value)
+    : bytes{ std::make_shared<std::vector<std::uint8_t>>(size, value) }, m_data{ bytes->data() }
+  {
+  }
+
+  [[nodiscard]] std::uint8_t &operator[](const std::size_t loc) noexcept { return m_data[loc]; }              // NOLINT
+  [[nodiscard]] const std::uint8_t &operator[](const std::size_t loc) const noexcept { return m_data[loc]; }  // NOLINT
+
+  [[nodiscard]] std::uint8_t *data() noexcept { return m_data; }
+  [[nodiscard]] const std::uint8_t *data() const noexcept { return m_data; }
+  [[nodiscard]] std::size_t size() const noexcept { return bytes->size(); }
+
+  template<typename Value> [[nodiscard]] Value load(const std::uint32_t loc) const noexcept
+  {
+    if (loc % sizeof(Value) != 0) {
+      Value value = 0;
+      for (std::uint32_t byte = 0; byte < sizeof(Value); ++byte) {
+        value = static_cast<Value>(value | (Value{ load<std::uint8_t>(loc + byte) } << (byte * 8)));
+      }
+      return value;
+    }
+
+    const auto *source = reinterpret_cast<const Value *>(&m_data[loc]);  // NOLINT
+#if defined(_MSC_VER)
+    return static_cast<Value>(load_volatile(source));
+#else
+    return __atomic_load_n(source, __ATOMIC_RELAXED);
+#endif
+  }
+
+  template<typename Value> void store(const std::uint32_t loc, const Value value) noexcept
+  {
+    if (loc % sizeof(Value) != 0) {
+      for (std::uint32_t byte = 0; byte < sizeof(Value); ++byte) { store(loc + byte, static_cast<std::uint8_t>(value >> (byte * 8))); }
+      return;
+    }
+
+    auto *target = reinterpret_cast<Value *>(&m_data[loc]);  // NOLINT
+#if defined(_MSC_VER)
+    store_volatile(target, value);
+#else
+    __atomic_store_n(target, value, __ATOMIC_RELAXED);
+#endif
+  }
+
+  // word exchanges are aligned down, as the guest is expected to only SWP aligned words
+  std::uint32_t exchange(const std::uint32_t loc, const std::uint32_t value, const bool byte) noexcept
+  {
+    if (byte) {
+      auto *target = &m_data[loc];  // NOLINT
+#if defined(_MSC_VER)
+      return static_cast<std::uint8_t>(_InterlockedExchange8(reinterpret_cast<volatile char *>(target), static_cast<char>(value)));
+#else
+      return __atomic_exchange_n(target, static_cast<std::uint8_t>(value), __ATOMIC_SEQ_CST);
+#endif
+    } else {
+      auto *target = reinterpret_cast<std::uint32_t *>(&m_data[loc & ~3u]);  // NOLINT
+#if defined(_MSC_VER)
+      return static_cast<std::uint32_t>(_InterlockedExchange(reinterpret_cast<volatile long *>(target), static_cast<long>(value)));
+#else
+      return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+#endif
+    }
+  }
+
+private:
+#if defined(_MSC_VER)
+  // plain aligned volatile accesses, which are single instructions and not reordered by the compiler
+  static std::uint8_t load_volatile(const std::uint8_t *source) noexcept
+  {
+    return static_cast<std::uint8_t>(__iso_volatile_load8(reinterpret_cast<const volatile char *>(source)));
+  }
+  static std::uint16_t load_volatile(const std::uint16_t *source) noexcept
+  {
+    return static_cast<std::uint16_t>(__iso_volatile_load16(reinterpret_cast<const volatile short *>(source)));
+  }
+  static std::uint32_t load_volatile(const std::uint32_t *source) noexcept
+  {
+    return static_cast<std::uint32_t>(__iso_volatile_load32(reinterpret_cast<const volatile int *>(source)));
+  }
+
+  static void store_volatile(std::uint8_t *target, const std::uint8_t value) noexcept
+  {
+    __iso_volatile_store8(reinterpret_cast<volatile char *>(target), static_cast<char>(value));
+  }
+  static void store_volatile(std::uint16_t *target, const std::uint16_t value) noexcept
+  {
+    __iso_volatile_store16(reinterpret_cast<volatile short *>(target), static_cast<short>(value));
+  }
+  static void store_volatile(std::uint32_t *target, const std::uint32_t value) noexcept
+  {
+    __iso_volatile_store32(reinterpret_cast<volatile int *>(target), static_cast<int>(value));
+  }
+#endif
+
+  std::shared_ptr<std::vector<std::uint8_t>> bytes;
+  std::uint8_t *m_data;
+};
+
+// N cores sharing the memory of the boot core. All cores start at the same entry point and
+// tell each other apart by reading Memory_Map::CORE_ID, each gets its own stack below the
+// stack of the previous core. The machine stops once core 0 returns.
+template<typename System> struct Machine
+{
+  constexpr static std::uint32_t core_stack_size = 256 * 1024;
+  // cycles between checks whether core 0 is done
+  constexpr static std::uint64_t time_slice = 10'000;
+
+  // configure(core, id) is called for each secondary core, eg to register coprocessors
+  template<typename Configure>
+  Machine(std::unique_ptr<System> boot_core, const std::uint32_t core_count, Configure &&configure)
+    : mailboxes{ std::make_shared<devices::Mailboxes>(core_count) }
+  {
+    cores.push_back(std::move(boot_core));
+
+    for (std::uint32_t id = 1; id < core_count; ++id) {
+      auto core = std::make_unique<System>(arm::Existing_RAM{}, cores.front()->builtin_ram);
+      configure(*core, id);
+      cores.push_back(std::move(core));
+    }
+  }
+
+  // Deterministic, cores take turns in order for quantum cycles each on the calling thread
+  void run_round_robin(const std::uint32_t entry, const std::uint64_t quantum = 1000)
+  {
+    setup(entry);
+
+    while (cores.front()->operations_remaining() && !cores.front()->stalled()) {
+      for (auto &core : cores) {
+        if (core->operations_remaining()) { core->run_until(core->cycles() + quantum); }
+      }
+    }
+  }
+
+  // One host thread per core, core 0 runs on the calling thread
+  void run_threaded(const std::uint32_t entry)
+  {
+    setup(entry);
+
+    std::atomic<bool> done{ false };
+    const auto run_core = [&done](System &core) {
+      while (!done && core.operations_remaining() && !core.stalled()) {
+        core.run_until(core.cycles() + time_slice);
+        if (core.waiting_for_interrupt) { std::this_thread::yield(); }
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (std::size_t id = 1; id < cores.size(); ++id) { threads.emplace_back(run_core, std::ref(*cores[id])); }
+
+    run_core(*cores.front());
+    done = true;
+
+    for (auto &thread : threads) { thread.join(); }
+  }
+
+  std::vector<std::unique_ptr<System>> cores;
+
+private:
+  void setup(const std::uint32_t entry)
+  {
+    for (std::uint32_t id = 0; id < cores.size(); ++id) {
+      auto &core = *cores[id];
+      core.setup_run(entry);
+      core.SP() -= id * core_stack_size;
+      core.mmio_callback.join(core, id, mailboxes);
+    }
+  }
+
+  std::shared_ptr<devices::Mailboxes> mailboxes;
+};
+
+}  // namespace cpp_box::smp
+
+#endif
@@ -0,0 +1,284 @@
+#ifndef CPP_BOX_SNAPSHOT_HPP
+#define CPP_BOX_SNAPSHOT_HPP
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "arm.hpp"
+
+namespace cpp_box::snapshot {
+
+// Save state of a single core, little endian throughout:
+//
+//   header        "CPPBOXSS", u32 version, u32 page_size, u64 RAM size, u64 FNV-1a of the image, u32 core_values,
+//                 u32 device count, u32 coprocessor count, u32 stored page count
+//   core          core_values u64, the fields of Core_State in the order of visit_fields
+//   devices       per device u32 word count and the words, then the same for each coprocessor
+//   page table    per stored page u32 page number, u32 encoded size and u64 file offset of its data
+//   page data     the page XORed with the base page, as runs of u16 zero bytes, u16 literal bytes, the literal bytes
+//
+// The base is RAM of zeros with the image at Memory_Map::USER_RAM_START, as the machine is before it runs. Pages equal
+// to the base are not stored. read maps the file and decodes the stored pages directly into RAM.
+//
+// Configuration is not part of the state: the cycle model's settings, skip_idle_loops, the coprocessors added and
+// the Memory_Observer are those of the System restored into. Idle loop detection starts over and the decoded
+// instruction cache is refilled, neither changes what the guest computes.
+constexpr static std::array<char, 8> magic{ 'C', 'P', 'P', 'B', 'O', 'X', 'S', 'S' };
+constexpr static std::uint32_t version   = 1;
+constexpr static std::uint32_t page_size = 4096;
+
+using Image = std::basic_string_view<std::uint8_t>;
+
+struct Core_State
+{
+  std::array<std::uint32_t, 16> registers{};
+  std::uint32_t CSPR{ 0 };
+  std::array<std::uint32_t, 5> user_r8_r12{};
+  std::array<std::uint32_t, 5> fiq_r8_r12{};
+  std::array<std::array<std::uint32_t, 2>, 6> r13_r14{};
+  std::array<std::uint32_t, 6> spsr{};
+
+  bool invalid_memory_write{ false };
+  bool irq{ false };
+  bool fiq{ false };
+  bool waiting_for_interrupt{ false };
+
+  std::uint64_t cycle{ 0 };
+  std::uint64_t idle_cycles{ 0 };
+  std::uint64_t instructions{ 0 };
+  std::uint64_t skipped_cycles{ 0 };  // in idle loops
+  std::uint64_t skipped_instructions{ 0 };
+  std::uint64_t event_count{ 0 };
+  std::array<arm::Scheduler::Event, arm::Scheduler::capacity> events{};
+
+  std::uint64_t loads{ 0 };
+  std::uint64_t stores{ 0 };
+  std::uint64_t branches_taken{ 0 };
+
+  std::array<std::uint64_t, arm::instruction_type_count> executed{};
+  std::uint64_t condition_failed{ 0 };
+  std::uint64_t i_cache_refills{ 0 };
+  std::uint64_t memory_reads{ 0 };
+  std::uint64_t memory_writes{ 0 };
+  std::uint64_t mmio_accesses{ 0 };
+
+  // of the cycle model
+  std::uint64_t sequential{ 0 };
+  std::uint64_t non_sequential{ 0 };
+  std::uint64_t internal{ 0 };
+  std::uint64_t coprocessor{ 0 };
+  std::uint64_t wait_states{ 0 };
+  std::uint64_t stalls{ 0 };
+};
+
+// calls visit with each field of the state, in the order they are stored
+template<typename State, typename Visitor> constexpr void visit_fields(State &state, Visitor &&visit)
+{
+  for (auto &value : state.registers) { visit(value); }
+  visit(state.CSPR);
+  for (auto &value : state.user_r8_r12) { visit(value); }
+  for (auto &value : state.fiq_r8_r12) { visit(value); }
+  for (auto &mode : state.r13_r14) {
+    for (auto &value : mode) { visit(value); }
+  }
+  for (auto &value : state.spsr) { visit(value); }
+
+  visit(state.invalid_memory_write);
+  visit(state.irq);
+  visit(state.fiq);
+  visit(state.waiting_for_interrupt);
+
+  visit(state.cycle);
+  visit(state.idle_cycles);
+  visit(state.instructions);
+  visit(state.skipped_cycles);
+  visit(state.skipped_instructions);
+  visit(state.event_count);
+  for (auto &event : state.events) {
+    visit(event.due);
+    visit(event.id);
+  }
+
+  visit(state.loads);
+  visit(state.stores);
+  visit(state.branches_taken);
+
+  for (auto &value : state.executed) { visit(value); }
+  visit(state.condition_failed);
+  visit(state.i_cache_refills);
+  visit(state.memory_reads);
+  visit(state.memory_writes);
+  visit(state.mmio_accesses);
+
+  visit(state.sequential);
+  visit(state.non_sequential);
+  visit(state.internal);
+  visit(state.coprocessor);
+  visit(state.wait_states);
+  visit(state.stalls);
+}
+
+template<typename System> [[nodiscard]] constexpr Core_State capture_core(const System &sys) noexcept
+{
+  Core_State state;
+  state.registers   = sys.registers;
+  state.CSPR        = sys.CSPR;
+  state.user_r8_r12 = sys.banked.user_r8_r12;
+  state.fiq_r8_r12  = sys.banked.fiq_r8_r12;
+  state.r13_r14     = sys.banked.r13_r14;
+  state.spsr        = sys.banked.spsr;
+
+  state.invalid_memory_write  = sys.invalid_memory_write;
+  state.irq                   = sys.interrupts.irq;
+  state.fiq                   = sys.interrupts.fiq;
+  state.waiting_for_interrupt = sys.waiting_for_interrupt;
+
+  state.cycle                = sys.scheduler.cycle;
+  state.idle_cycles          = sys.idle_cycles;
+  state.instructions         = sys.instructions;
+  state.skipped_cycles       = sys.idle_loop.skipped_cycles;
+  state.skipped_instructions = sys.idle_loop.skipped_instructions;
+  state.event_count          = sys.scheduler.size();
+  for (std::size_t idx = 0; idx < sys.scheduler.size(); ++idx) { state.events[idx] = sys.scheduler.event(idx); }
+
+  state.loads          = sys.counters.loads;
+  state.stores         = sys.counters.stores;
+  state.branches_taken = sys.counters.branches_taken;
+
+  state.executed         = sys.statistics.executed;
+  state.condition_failed = sys.statistics.condition_failed;
+  state.i_cache_refills  = sys.statistics.i_cache_refills;
+  state.memory_reads     = sys.statistics.memory_reads;
+  state.memory_writes    = sys.statistics.memory_writes;
+  state.mmio_accesses    = sys.statistics.mmio_accesses;
+
+  const auto &totals   = sys.cycle_model.totals;
+  state.sequential     = totals.sequential;
+  state.non_sequential = totals.non_sequential;
+  state.internal       = totals.internal;
+  state.coprocessor    = totals.coprocessor;
+  state.wait_states    = totals.wait_states;
+  state.stalls         = totals.stalls;
+  return state;
+}
+
+// the RAM must already hold the state's memory, the instruction cache is refilled from it
+template<typename System> constexpr void apply_core(System &sys, const Core_State &state) noexcept
+{
+  sys.registers                      = state.registers;
+  sys.CSPR                           = state.CSPR;
+  sys.banked.user_r8_r12             = state.user_r8_r12;
+  sys.banked.fiq_r8_r12              = state.fiq_r8_r12;
+  sys.banked.r13_r14                 = state.r13_r14;
+  sys.banked.spsr                    = state.spsr;
+  sys.invalid_memory_write           = state.invalid_memory_write;
+  sys.interrupts.irq                 = state.irq;
+  sys.interrupts.fiq                 = state.fiq;
+  sys.waiting_for_interrupt          = state.waiting_for_interrupt;
+  sys.idle_cycles                    = state.idle_cycles;
+  sys.instructions                   = state.instructions;
+  sys.idle_loop                      = {};
+  sys.idle_loop.skipped_cycles       = state.skipped_cycles;
+  sys.idle_loop.skipped_instructions = state.skipped_instructions;
+
+  sys.scheduler       = {};
+  sys.scheduler.cycle = state.cycle;
+  for (std::size_t idx = 0; idx < state.event_count && idx < state.events.size(); ++idx) {
+    sys.scheduler.schedule(state.events[idx].due, state.events[idx].id);
+  }
+
+  sys.counters.loads          = state.loads;
+  sys.counters.stores         = state.stores;
+  sys.counters.branches_taken = state.branches_taken;
+
+  sys.statistics.executed         = state.executed;
+  sys.statistics.condition_failed = state.condition_failed;
+  sys.statistics.i_cache_refills  = state.i_cache_refills;
+  sys.statistics.memory_reads     = state.memory_reads;
+  sys.statistics.memory_writes    = state.memory_writes;
+  sys.statistics.mmio_accesses    = state.mmio_accesses;
+
+  auto &totals          = sys.cycle_model.totals;
+  totals.sequential     = state.sequential;
+  totals.non_sequential = state.non_sequential;
+  totals.internal       = state.internal;
+  totals.coprocessor    = state.coprocessor;
+  totals.wait_states    = state.wait_states;
+  totals.stalls         = state.stalls;
+
+  sys.i_cache.fill_cache(sys);
+}
+
+struct State
+{
+  Core_State core;
+  std::vector<std::vector<std::uint32_t>> devices;  // devices::Devices::save_state
+  std::vector<std::vector<std::uint32_t>> coprocessors;  // coprocessor::Registry::save_state
+};
+
+// throws std::runtime_error if the file cannot be written
+void write(const std::filesystem::path &path, const State &state, const std::uint8_t *ram, std::size_t ram_size, Image image);
+
+// Decodes the RAM of the save state into ram and returns the rest of it. Throws std::runtime_error if the file is not
+// a save state, or one of another image or RAM size.
+[[nodiscard]] State read(const std::filesystem::path &path, std::uint8_t *ram, std::size_t ram_size, Image image);
+
+// MMIO and coprocessor callbacks with state provide save_state and restore_state, like devices::Devices
+template<typename Callback, typename = void> struct Has_State : std::false_type
+{
+};
+
+template<typename Callback>
+struct Has_State<Callback,
+                 std::void_t<decltype(std::declval<const Callback &>().save_state()),
+                             decltype(std::declval<Callback &>().restore_state(std::declval<const Callback &>().save_state()))>>
+  : std::true_type
+{
+};
+
+template<typename System> [[nodiscard]] State capture(const System &sys)
+{
+  State state{ capture_core(sys), {}, {} };
+  if constexpr (Has_State<std::decay_t<decltype(sys.mmio_callback)>>::value) { state.devices = sys.mmio_callback.save_state(); }
+  if constexpr (Has_State<std::decay_t<decltype(sys.coprocessors)>>::value) { state.coprocessors = sys.coprocessors.save_state(); }
+  return state;
+}
+
+// throws std::runtime_error if the devices or coprocessors of sys are not those the state was captured from
+template<typename System> void restore(System &sys, const State &state)
+{
+  const auto restore_callback = [](auto &callback, const auto &callback_state) {
+    if constexpr (Has_State<std::decay_t<decltype(callback)>>::value) {
+      return callback.restore_state(callback_state);
+    } else {
+      return callback_state.empty();
+    }
+  };
+
+  // devices last, refilling the instruction cache reads from those mapped in its range
+  apply_core(sys, state.core);
+  if (!restore_callback(sys.mmio_callback, state.devices)) { throw std::runtime_error("the save state is of other devices"); }
+  if (!restore_callback(sys.coprocessors, state.coprocessors)) { throw std::runtime_error("the save state is of other coprocessors"); }
+}
+
+// the image is that of the machine, as loaded at Memory_Map::USER_RAM_START
+template<typename System> void save(const std::filesystem::path &path, const System &sys, const Image image)
+{
+  write(path, capture(sys), sys.builtin_ram.data(), sys.builtin_ram.size(), image);
+}
+
+// sys should be set up for the same image as the one saved from, with the same devices and coprocessors added
+template<typename System> void load(const std::filesystem::path &path, System &sys, const Image image)
+{
+  restore(sys, read(path, sys.builtin_ram.data(), sys.builtin_ram.size(), image));
+}
+
+}  // namespace cpp_box::snapshot
+
+#endif
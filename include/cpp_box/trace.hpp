@@ -0,0 +1,269 @@
+#ifndef CPP_BOX_TRACE_HPP
+#define CPP_BOX_TRACE_HPP
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iosfwd>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cpp_box::trace {
+
+// Binary execution trace, one record per executed instruction:
+//
+//   file header    "CPPBOXTR", u32 version, u32 Flags, all little endian
+//   record         u8 tag, then the fields the tag bits announce, in this order
+//     PC_JUMP      zigzag varint of pc - (previous pc + 4), the pc is sequential otherwise
+//     REGISTERS    varint mask of the registers the instruction changed, bit 15 is the CPSR as r15 is the pc,
+//                  then the new value of each as u32
+//     ACCESSES     varint count, then per data access a u8 (bit 0 write, bits 1-2 log2 of the size) and the
+//                  zigzag varint of the address minus the previous access's address
+//   keyframe       u8 tag KEYFRAME before every keyframe_interval'th record, then the state the next record is
+//                  relative to as u32: the previous pc, the previous access's address and r0 - r14 and the CPSR
+//   end            u8 tag END, the u64 file offset of each keyframe, u32 keyframe_interval, u32 keyframe count
+//                  and "CPPBOXKF"
+//
+// Varints are LEB128, 7 bits per byte, least significant first. The first record's pc is relative to 0 - 4.
+// Traces whose writer did not finish have no end, they can only be read from the start.
+constexpr static std::array<char, 8> magic{ 'C', 'P', 'P', 'B', 'O', 'X', 'T', 'R' };
+constexpr static std::array<char, 8> keyframe_magic{ 'C', 'P', 'P', 'B', 'O', 'X', 'K', 'F' };
+constexpr static std::uint32_t version           = 2;
+constexpr static std::uint32_t keyframe_interval = 1u << 16;
+
+enum struct Flags : std::uint32_t {
+  MEMORY_ACCESSES = 0b1  // data accesses were recorded
+};
+
+enum struct Tag : std::uint8_t { PC_JUMP = 0b001, REGISTERS = 0b010, ACCESSES = 0b100, KEYFRAME = 0b1000, END = 0b1'0000 };
+
+struct Access
+{
+  std::uint32_t address;
+  std::uint8_t size;
+  bool write;
+};
+
+struct Record
+{
+  std::uint32_t pc{ 0 };
+  std::uint16_t changed{ 0 };  // mask, bit 15 is the CPSR
+  std::array<std::uint32_t, 16> registers{};  // r0 - r14 and the CPSR in 15, as of after the instruction
+  std::vector<Access> accesses{};
+};
+
+// Encodes the trace into chunks, which a background thread appends to the file. At most max_chunks chunks
+// are held in memory, when the disk falls behind the emulator waits for a free one. Pass the writer as tracer of
+// System::run or run_until, and as `writer` of an Access_Observer to record data accesses too.
+struct Writer
+{
+  constexpr static std::size_t default_chunk_size = 1024 * 1024;
+  constexpr static std::size_t default_max_chunks = 8;
+
+  // throws std::runtime_error if the file cannot be opened
+  Writer(const std::filesystem::path &path,
+         bool memory_accesses,
+         std::size_t t_chunk_size = default_chunk_size,
+         std::size_t t_max_chunks = default_max_chunks);
+  ~Writer();
+
+  Writer(const Writer &) = delete;
+  Writer(Writer &&)      = delete;
+  Writer &operator=(const Writer &) = delete;
+  Writer &operator=(Writer &&) = delete;
+
+  template<typename System, typename Instruction> void operator()(const System &sys, const std::uint32_t pc, const Instruction /*ins*/)
+  {
+    if (started) { end_record(sys.registers, sys.CSPR); }
+    started    = true;
+    pending_pc = pc;
+  }
+
+  void access(const std::uint32_t address, const std::uint32_t size, const bool write)
+  {
+    if (recording_accesses) { accesses.push_back(Access{ address, static_cast<std::uint8_t>(size), write }); }
+  }
+
+  // writes the record of the last instruction, with the registers it changed, and the keyframe table, then waits
+  // for the file to be written. throws std::runtime_error if writing failed
+  template<typename System> void finish(const System &sys)
+  {
+    if (started) { end_record(sys.registers, sys.CSPR); }
+    started  = false;
+    complete = true;
+    close();
+    if (failed) { throw std::runtime_error("writing the trace failed"); }
+  }
+
+  std::uint64_t records{ 0 };
+
+private:
+  void end_record(const std::array<std::uint32_t, 16> &registers, const std::uint32_t cpsr)
+  {
+    // tag, pc, mask, 16 values and the access count at their longest, and a keyframe
+    if (used + 96 + 80 + accesses.size() * 6 > chunk.size()) { submit(); }
+    if (records % keyframe_interval == 0) { put_keyframe(); }
+
+    const auto last_pc = std::exchange(previous_pc, pending_pc);
+
+    // branchless, so that the compiler can vectorize it
+    auto changed = static_cast<std::uint32_t>(cpsr != last_registers[15]) << 15;
+    for (std::size_t reg = 0; reg < 15; ++reg) { changed |= static_cast<std::uint32_t>(registers[reg] != last_registers[reg]) << reg; }
+
+    // bytes may alias anything, writing through a local pointer keeps `used` and the chunk's data out of memory
+    auto *const begin = chunk.data() + used;
+    auto *out         = begin + 1;
+    std::uint8_t tag  = 0;
+
+    if (pending_pc != last_pc + 4) {
+      tag |= static_cast<std::uint8_t>(Tag::PC_JUMP);
+      out = put_varint(out, zigzag(static_cast<std::int32_t>(pending_pc - (last_pc + 4))));
+    }
+
+    if (changed != 0) {
+      tag |= static_cast<std::uint8_t>(Tag::REGISTERS);
+      out = put_varint(out, changed);
+      for (std::size_t reg = 0; reg < 16; ++reg) {
+        if ((changed & (1u << reg)) != 0) {
+          last_registers[reg] = reg == 15 ? cpsr : registers[reg];
+          out                 = put_word(out, last_registers[reg]);
+        }
+      }
+    }
+
+    if (!accesses.empty()) {
+      tag |= static_cast<std::uint8_t>(Tag::ACCESSES);
+      out = put_varint(out, static_cast<std::uint32_t>(accesses.size()));
+      for (const auto &access : accesses) {
+        const std::uint8_t size_bits = access.size == 4 ? 2 : (access.size == 2 ? 1 : 0);
+        *out++                       = static_cast<std::uint8_t>((access.write ? 1 : 0) | (size_bits << 1));
+        out = put_varint(out, zigzag(static_cast<std::int32_t>(access.address - std::exchange(last_access, access.address))));
+      }
+      accesses.clear();
+    }
+
+    *begin = tag;
+    used += static_cast<std::size_t>(out - begin);
+    ++records;
+  }
+
+  void put_keyframe()
+  {
+    keyframes.push_back(written + used);
+
+    auto *const begin = chunk.data() + used;
+    auto *out         = begin;
+    *out++            = static_cast<std::uint8_t>(Tag::KEYFRAME);
+    out               = put_word(out, previous_pc);
+    out               = put_word(out, last_access);
+    for (const auto value : last_registers) { out = put_word(out, value); }
+    used += static_cast<std::size_t>(out - begin);
+  }
+
+  [[nodiscard]] static constexpr std::uint32_t zigzag(const std::int32_t value) noexcept
+  {
+    return (static_cast<std::uint32_t>(value) << 1) ^ static_cast<std::uint32_t>(value >> 31);
+  }
+
+  [[nodiscard]] static std::uint8_t *put_varint(std::uint8_t *out, std::uint32_t value) noexcept
+  {
+    while (value >= 0x80) {
+      *out++ = static_cast<std::uint8_t>(value | 0x80);
+      value >>= 7;
+    }
+    *out++ = static_cast<std::uint8_t>(value);
+    return out;
+  }
+
+  [[nodiscard]] static std::uint8_t *put_word(std::uint8_t *out, const std::uint32_t value) noexcept
+  {
+    for (std::size_t byte = 0; byte < 4; ++byte) { *out++ = static_cast<std::uint8_t>(value >> (byte * 8)); }
+    return out;
+  }
+
+  // hands the current chunk to the writer thread and takes a free one, waiting if none is
+  void submit();
+  void close();
+  void write_chunks();
+
+  bool recording_accesses;
+  bool started{ false };
+  bool complete{ false };  // the end is written on close
+  std::uint32_t pending_pc{ 0 };
+  std::uint32_t previous_pc{ static_cast<std::uint32_t>(-4) };
+  std::uint32_t last_access{ 0 };
+  std::array<std::uint32_t, 16> last_registers{};
+  std::vector<Access> accesses;
+  std::vector<std::uint64_t> keyframes;  // file offsets
+
+  std::vector<std::uint8_t> chunk;
+  std::size_t used{ 0 };
+  std::uint64_t written{ 0 };  // file offset of the chunk
+
+  std::ofstream file;
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::deque<std::vector<std::uint8_t>> full;  // waiting to be written, each one sized to its content
+  std::vector<std::vector<std::uint8_t>> spare;
+  std::size_t chunk_size;
+  std::size_t chunks_allocated{ 1 };
+  std::size_t max_chunks;
+  bool closing{ false };
+  bool closed{ false };
+  bool failed{ false };
+  std::thread thread;
+};
+
+// Memory_Observer of arm::System feeding data accesses to a Writer
+struct Access_Observer
+{
+  template<typename System> [[nodiscard]] constexpr std::uint32_t fetch(const System & /*sys*/, const std::uint32_t /*pc*/) noexcept { return 0; }
+
+  template<typename System>
+  [[nodiscard]] std::uint32_t
+    access(const System & /*sys*/, const std::uint32_t /*pc*/, const std::uint32_t loc, const std::uint32_t size, const bool write)
+  {
+    if (writer != nullptr) { writer->access(loc, size, write); }
+    return 0;
+  }
+
+  Writer *writer{ nullptr };
+};
+
+// Decodes a trace written by Writer, keeping the full register state up to date
+struct Reader
+{
+  // throws std::runtime_error if the stream does not start with a trace header
+  explicit Reader(std::istream &t_is);
+
+  // false at the end of the trace, throws std::runtime_error on a truncated record
+  [[nodiscard]] bool next(Record &record);
+
+  // Moves to the keyframe closest before the record with index, unless reading on from the current record is
+  // closer, and returns the index of the record next reads. Stays at the current record if the trace has no
+  // keyframes. The stream must be seekable. throws std::runtime_error on a corrupt keyframe table
+  std::uint64_t seek(std::uint64_t index);
+
+  [[nodiscard]] bool memory_accesses() const noexcept { return (flags & static_cast<std::uint32_t>(Flags::MEMORY_ACCESSES)) != 0; }
+
+private:
+  [[nodiscard]] std::uint32_t get_varint();
+  [[nodiscard]] std::uint32_t get_word();
+
+  std::istream &is;
+  std::uint64_t next_index{ 0 };
+  std::uint32_t flags{ 0 };
+  std::uint32_t previous_pc{ static_cast<std::uint32_t>(-4) };
+  std::uint32_t last_access{ 0 };
+  std::array<std::uint32_t, 16> registers{};
+};
+
+}  // namespace cpp_box::trace
+
+#endif
@@ -0,0 +1,105 @@
+#include "../include/cpp_box/cache.hpp"
+#include "../include/cpp_box/memory_map.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace cpp_box::cache {
+
+namespace {
+  [[nodiscard]] constexpr bool is_power_of_two(const std::uint32_t value) noexcept { return value != 0 && (value & (value - 1)) == 0; }
+
+  [[nodiscard]] constexpr std::uint32_t log2(std::uint32_t value) noexcept
+  {
+    std::uint32_t result = 0;
+    while (value > 1) {
+      value >>= 1;
+      ++result;
+    }
+    return result;
+  }
+
+  [[nodiscard]] double percent(const std::uint64_t part, const std::uint64_t whole) noexcept
+  {
+    return whole == 0 ? 0.0 : 100.0 * static_cast<double>(part) / static_cast<double>(whole);
+  }
+
+  void write_cache(std::ostream &os, const char *name, const Cache &cache)
+  {
+    const auto &config = cache.config;
+    const auto &stats  = cache.statistics;
+    os << name << ": " << std::dec << config.size << " bytes, " << config.associativity << " way, " << config.line_size << " byte lines, "
+       << (config.write_policy == Write_Policy::WRITE_BACK ? "write-back" : "write-through") << ", " << config.miss_penalty << " cycle miss penalty\n"
+       << std::fixed << std::setprecision(2) << "  reads  " << std::setw(12) << stats.reads << std::setw(12) << stats.read_misses << " misses "
+       << std::setw(7) << percent(stats.read_misses, stats.reads) << "%\n"
+       << "  writes " << std::setw(12) << stats.writes << std::setw(12) << stats.write_misses << " misses " << std::setw(7)
+       << percent(stats.write_misses, stats.writes) << "%\n"
+       << "  total  " << std::setw(12) << stats.accesses() << std::setw(12) << stats.misses() << " misses " << std::setw(7)
+       << percent(stats.misses(), stats.accesses()) << "%, hit rate " << 100.0 - percent(stats.misses(), stats.accesses()) << "%\n";
+    if (config.write_policy == Write_Policy::WRITE_BACK) { os << "  write backs " << stats.write_backs << '\n'; }
+  }
+}  // namespace
+
+Cache::Cache(const Cache_Config &t_config) : config{ t_config }
+{
+  if (!is_power_of_two(config.size) || !is_power_of_two(config.associativity) || !is_power_of_two(config.line_size)) {
+    throw std::invalid_argument("cache size, associativity and line size must be powers of two");
+  }
+
+  if (config.line_size < 4 || config.associativity > config.size / config.line_size) {
+    throw std::invalid_argument("cache lines must hold a word and the cache at least one set");
+  }
+
+  const auto sets = config.size / config.line_size / config.associativity;
+  line_bits       = log2(config.line_size);
+  set_mask        = sets - 1;
+  ways.resize(config.size / config.line_size);
+}
+
+void write_report(std::ostream &os, const Cache_Simulator &simulator, const Loaded_Files &files, const std::size_t max_lines)
+{
+  if (simulator.instruction_cache) { write_cache(os, "Instruction cache", *simulator.instruction_cache); }
+  if (simulator.data_cache) { write_cache(os, "Data cache", *simulator.data_cache); }
+
+  // location_data is keyed by object offset, instructions outside of it are reported by address
+  std::unordered_map<std::string, Cache_Simulator::Instruction_Statistics> lines;
+  for (const auto &[pc, counts] : simulator.per_instruction) {
+    const auto offset   = pc - static_cast<std::uint32_t>(system::Memory_Map::USER_RAM_START);
+    const auto location = files.location_data.find(offset);
+
+    std::string name;
+    if (location != files.location_data.end()) {
+      name = location->second.filename.filename().string() + ':' + std::to_string(location->second.line_number);
+    } else {
+      std::ostringstream ss;
+      ss << "0x" << std::hex << std::setw(8) << std::setfill('0') << pc;
+      name = ss.str();
+    }
+
+    auto &line = lines[name];
+    line.fetches += counts.fetches;
+    line.fetch_misses += counts.fetch_misses;
+    line.accesses += counts.accesses;
+    line.access_misses += counts.access_misses;
+  }
+
+  std::vector<std::pair<std::string, Cache_Simulator::Instruction_Statistics>> sorted{ lines.begin(), lines.end() };
+  const auto misses = [](const auto &entry) { return entry.second.fetch_misses + entry.second.access_misses; };
+  std::sort(sorted.begin(), sorted.end(), [&misses](const auto &lhs, const auto &rhs) {
+    return misses(lhs) != misses(rhs) ? misses(lhs) > misses(rhs) : lhs.first < rhs.first;
+  });
+
+  os << "\nLines by misses\n     fetches  i-misses   i-miss%    accesses  d-misses   d-miss%  line\n";
+  for (std::size_t idx = 0; idx < std::min(max_lines, sorted.size()) && misses(sorted[idx]) != 0; ++idx) {
+    const auto &[name, counts] = sorted[idx];
+    os << std::dec << std::fixed << std::setprecision(2) << std::setw(12) << counts.fetches << std::setw(10) << counts.fetch_misses << std::setw(9)
+       << percent(counts.fetch_misses, counts.fetches) << '%' << std::setw(12) << counts.accesses << std::setw(10) << counts.access_misses
+       << std::setw(9) << percent(counts.access_misses, counts.accesses) << "%  " << name << '\n';
+  }
+}
+
+}  // namespace cpp_box::cache
@@ -0,0 +1,153 @@
+#include "../include/cpp_box/coprocessor.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+namespace cpp_box::coprocessor {
+
+namespace {
+  constexpr auto make_crc32_tables() noexcept
+  {
+    // slicing-by-4 tables for the reflected IEEE polynomial
+    std::array<std::array<std::uint32_t, 256>, 4> tables{};
+
+    for (std::uint32_t byte = 0; byte < 256; ++byte) {
+      auto crc = byte;
+      for (int bit = 0; bit < 8; ++bit) { crc = (crc >> 1) ^ (0xEDB8'8320 & (0 - (crc & 1))); }
+      tables[0][byte] = crc;
+    }
+
+    for (std::size_t table = 1; table < tables.size(); ++table) {
+      for (std::size_t byte = 0; byte < 256; ++byte) {
+        const auto previous = tables[table - 1][byte];
+        tables[table][byte] = (previous >> 8) ^ tables[0][previous & 0xFF];
+      }
+    }
+
+    return tables;
+  }
+
+  constexpr auto crc32_tables = make_crc32_tables();
+
+  // guest and all supported hosts are little endian, so guest words can be copied out directly
+  template<typename T, std::size_t Count> void load_block(std::array<T, Count> &block, const std::uint8_t *src, const std::size_t count) noexcept
+  {
+    std::memcpy(block.data(), src, count * sizeof(T));
+  }
+
+  struct Accelerator
+  {
+    std::array<std::uint32_t, 16> registers{};
+
+    void status(const Accelerator_Status value) noexcept { registers[ACCELERATOR_STATUS_REGISTER] = static_cast<std::uint32_t>(value); }
+
+    void dot_product(const Guest_Memory memory) noexcept
+    {
+      const auto count = std::size_t{ registers[2] };
+      const auto *lhs  = memory.span(registers[0], count * 4);
+      const auto *rhs  = memory.span(registers[1], count * 4);
+      if (lhs == nullptr || rhs == nullptr) { return status(Accelerator_Status::BAD_ADDRESS); }
+
+      // blocks of fixed size so that the inner loop is trivially vectorizable
+      constexpr std::size_t block_size = 64;
+      std::array<std::int32_t, block_size> lhs_block{};
+      std::array<std::int32_t, block_size> rhs_block{};
+
+      std::int64_t result = 0;
+      for (std::size_t offset = 0; offset < count; offset += block_size) {
+        const auto length = std::min(block_size, count - offset);
+        load_block(lhs_block, lhs + offset * 4, length);  // NOLINT
+        load_block(rhs_block, rhs + offset * 4, length);  // NOLINT
+        for (std::size_t idx = 0; idx < length; ++idx) {
+          result += static_cast<std::int64_t>(lhs_block[idx]) * static_cast<std::int64_t>(rhs_block[idx]);
+        }
+      }
+
+      registers[4] = static_cast<std::uint32_t>(static_cast<std::uint64_t>(result) & 0xFFFF'FFFF);
+      registers[5] = static_cast<std::uint32_t>(static_cast<std::uint64_t>(result) >> 32);
+      status(Accelerator_Status::OK);
+    }
+
+    void crc32(const Guest_Memory memory) noexcept
+    {
+      const auto length = std::size_t{ registers[2] };
+      const auto *data  = memory.span(registers[0], length);
+      if (data == nullptr) { return status(Accelerator_Status::BAD_ADDRESS); }
+
+      auto crc = ~registers[3];
+
+      std::size_t idx = 0;
+      for (; idx + 4 <= length; idx += 4) {
+        std::uint32_t word{};
+        std::memcpy(&word, data + idx, sizeof(word));  // NOLINT
+        crc ^= word;
+        crc = crc32_tables[3][crc & 0xFF] ^ crc32_tables[2][(crc >> 8) & 0xFF] ^ crc32_tables[1][(crc >> 16) & 0xFF]
+              ^ crc32_tables[0][crc >> 24];
+      }
+
+      for (; idx < length; ++idx) { crc = (crc >> 8) ^ crc32_tables[0][(crc ^ data[idx]) & 0xFF]; }  // NOLINT
+
+      registers[4] = ~crc;
+      status(Accelerator_Status::OK);
+    }
+
+    void transform_4x4(const Guest_Memory memory) noexcept
+    {
+      const auto count   = std::size_t{ registers[2] };
+      const auto *src    = memory.span(registers[0], count * 16);
+      auto *dest         = memory.span(registers[1], count * 16);
+      const auto *matrix = memory.span(registers[3], 16 * 4);
+      if (src == nullptr || dest == nullptr || matrix == nullptr) { return status(Accelerator_Status::BAD_ADDRESS); }
+
+      std::array<std::int32_t, 16> m{};
+      load_block(m, matrix, m.size());
+
+      for (std::size_t vec = 0; vec < count; ++vec) {
+        std::array<std::int32_t, 4> in{};
+        load_block(in, src + vec * 16, in.size());  // NOLINT
+
+        std::array<std::int32_t, 4> out{};
+        for (std::size_t row = 0; row < 4; ++row) {
+          std::int64_t sum = 0;
+          for (std::size_t col = 0; col < 4; ++col) { sum += static_cast<std::int64_t>(m[row * 4 + col]) * in[col]; }
+          out[row] = static_cast<std::int32_t>(sum >> 16);
+        }
+
+        std::memcpy(dest + vec * 16, out.data(), sizeof(out));  // NOLINT
+      }
+
+      status(Accelerator_Status::OK);
+    }
+
+    void execute(const arm::Coprocessor_Data_Operation op, const Guest_Memory memory) noexcept
+    {
+      switch (static_cast<Accelerator_Kernel>(op.opcode_1())) {
+      case Accelerator_Kernel::DOT_PRODUCT: return dot_product(memory);
+      case Accelerator_Kernel::CRC32: return crc32(memory);
+      case Accelerator_Kernel::TRANSFORM_4X4: return transform_4x4(memory);
+      }
+
+      status(Accelerator_Status::UNKNOWN_KERNEL);
+    }
+  };
+}  // namespace
+
+Handlers make_accelerator()
+{
+  auto accelerator = std::make_shared<Accelerator>();
+
+  return { [accelerator](const arm::Coprocessor_Data_Operation op, const Guest_Memory memory) { accelerator->execute(op, memory); },
+           [accelerator](const arm::Coprocessor_Register_Transfer op) { return accelerator->registers[op.coprocessor_register()]; },
+           [accelerator](const arm::Coprocessor_Register_Transfer op, const std::uint32_t value) {
+             accelerator->registers[op.coprocessor_register()] = value;
+           },
+           [accelerator]() { return std::vector<std::uint32_t>(accelerator->registers.begin(), accelerator->registers.end()); },
+           [accelerator](const std::vector<std::uint32_t> &state) {
+             if (state.size() != accelerator->registers.size()) { return false; }
+             std::copy(state.begin(), state.end(), accelerator->registers.begin());
+             return true;
+           } };
+}
+
+}  // namespace cpp_box::coprocessor
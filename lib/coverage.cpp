@@ -0,0 +1,124 @@
+#include "../include/cpp_box/coverage.hpp"
+#include "../include/cpp_box/elf_reader.hpp"
+#include "../include/cpp_box/memory_map.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <map>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+namespace cpp_box::coverage {
+
+Coverage_Map::Coverage_Map(const std::uint32_t t_begin, const std::uint32_t t_end)
+  : begin{ t_begin }, words{ t_end > t_begin ? (t_end - t_begin + 3) / 4 : 0 }, bits((words + 63) / 64)
+{
+}
+
+std::uint32_t Coverage_Map::executed_words() const noexcept
+{
+  std::uint32_t count = 0;
+  for (auto word : bits) {
+    for (; word != 0; word &= word - 1) { ++count; }
+  }
+  return count;
+}
+
+Coverage_Map &Coverage_Map::merge(const Coverage_Map &other)
+{
+  if (other.begin != begin || other.words != words) { throw std::invalid_argument("coverage maps of different code cannot be merged"); }
+  std::transform(bits.begin(), bits.end(), other.bits.begin(), bits.begin(), [](const auto lhs, const auto rhs) { return lhs | rhs; });
+  return *this;
+}
+
+Coverage_Map make_coverage_map(const Loaded_Files &files)
+{
+  const auto ram_start = static_cast<std::uint32_t>(system::Memory_Map::USER_RAM_START);
+
+  // the whole file is loaded at USER_RAM_START, see load_unknown
+  auto begin = std::numeric_limits<std::uint64_t>::max();
+  auto end   = std::uint64_t{ 0 };
+
+  if (files.binary_file && files.binary_file->size() >= 64) {
+    const auto file_header = elf::File_Header{ { files.binary_file->data(), files.binary_file->size() } };
+    if (file_header.is_elf_file()) {
+      for (const auto &header : file_header.section_headers()) {
+        if ((header.flags() & static_cast<std::uint64_t>(elf::Section_Header::Flags::SHF_EXECINSTR)) == 0 || header.size() == 0) { continue; }
+        begin = std::min(begin, header.offset());
+        end   = std::max(end, header.offset() + header.size());
+      }
+    }
+  }
+
+  if (end == 0) {
+    begin = 0;
+    end   = files.image.size();
+  }
+
+  return Coverage_Map{ ram_start + static_cast<std::uint32_t>(begin), ram_start + static_cast<std::uint32_t>(end) };
+}
+
+void write_lcov(std::ostream &os, const Coverage_Map &map, const Loaded_Files &files, const std::string_view test_name)
+{
+  struct Function
+  {
+    int line;
+    bool executed;
+  };
+
+  struct Source_File
+  {
+    std::map<int, bool> lines;
+    std::map<std::string, Function> functions;
+  };
+
+  std::map<std::string, Source_File> sources;
+
+  for (const auto &[offset, location] : files.location_data) {
+    const auto address = offset + static_cast<std::uint32_t>(system::Memory_Map::USER_RAM_START);
+    // literal pools are disassembled as data and never executed
+    if (!map.contains(address) || location.line_number <= 0 || location.filename.empty() || location.disassembly.rfind(".word", 0) == 0) {
+      continue;
+    }
+
+    const auto executed = map.executed(address);
+    auto &source        = sources[location.filename.string()];
+    source.lines[location.line_number] |= executed;
+
+    // objdump labels end with a ':'
+    auto name = location.function_name;
+    if (!name.empty() && name.back() == ':') { name.pop_back(); }
+    if (name.empty()) { continue; }
+
+    auto &function    = source.functions.try_emplace(name, Function{ location.line_number, false }).first->second;
+    function.line     = std::min(function.line, location.line_number);
+    function.executed = function.executed || executed;
+  }
+
+  // lcov only accepts letters, digits and underscores in test names
+  std::string test{ test_name };
+  std::replace_if(test.begin(), test.end(), [](const char c) { return std::isalnum(static_cast<unsigned char>(c)) == 0; }, '_');
+
+  for (const auto &[filename, source] : sources) {
+    os << "TN:" << test << "\nSF:" << filename << '\n';
+
+    std::size_t functions_hit = 0;
+    for (const auto &[name, function] : source.functions) { os << "FN:" << function.line << ',' << name << '\n'; }
+    for (const auto &[name, function] : source.functions) {
+      os << "FNDA:" << (function.executed ? 1 : 0) << ',' << name << '\n';
+      if (function.executed) { ++functions_hit; }
+    }
+    os << "FNF:" << source.functions.size() << "\nFNH:" << functions_hit << '\n';
+
+    std::size_t lines_hit = 0;
+    for (const auto &[line, executed] : source.lines) {
+      os << "DA:" << line << ',' << (executed ? 1 : 0) << '\n';
+      if (executed) { ++lines_hit; }
+    }
+    os << "LF:" << source.lines.size() << "\nLH:" << lines_hit << "\nend_of_record\n";
+  }
+}
+
+}  // namespace cpp_box::coverage
@@ -0,0 +1,742 @@
+#include "../include/cpp_box/devices.hpp"
+
+#include <cstring>
+#include <limits>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+
+namespace cpp_box::devices {
+
+namespace {
+  using system::Memory_Map;
+
+  [[nodiscard]] constexpr std::uint32_t address(const Memory_Map loc) noexcept { return static_cast<std::uint32_t>(loc); }
+
+  // the devices' Register enums must agree with the Memory_Map
+  template<typename Register> constexpr bool at_offset(const Register reg, const Memory_Map base, const Memory_Map loc) noexcept
+  {
+    return static_cast<std::uint32_t>(reg) == address(loc) - address(base);
+  }
+
+  static_assert(at_offset(Interrupt_Controller::Register::ENABLE, Memory_Map::INTERRUPT_STATUS, Memory_Map::INTERRUPT_ENABLE));
+  static_assert(at_offset(Interrupt_Controller::Register::FIQ_SELECT, Memory_Map::INTERRUPT_STATUS, Memory_Map::INTERRUPT_FIQ_SELECT));
+  static_assert(at_offset(Interrupt_Controller::Register::WAIT_FOR_INTERRUPT, Memory_Map::INTERRUPT_STATUS, Memory_Map::WAIT_FOR_INTERRUPT));
+  static_assert(at_offset(Timer::Register::CONTROL, Memory_Map::TIMER_0_LOAD, Memory_Map::TIMER_0_CONTROL));
+  static_assert(at_offset(Timer::Register::VALUE, Memory_Map::TIMER_0_LOAD, Memory_Map::TIMER_0_VALUE));
+  static_assert(at_offset(Timer::Register::VALUE, Memory_Map::TIMER_1_LOAD, Memory_Map::TIMER_1_VALUE));
+  static_assert(at_offset(Core_Registers::Register::CORE_COUNT, Memory_Map::CORE_ID, Memory_Map::CORE_COUNT));
+  static_assert(at_offset(Core_Registers::Register::DOORBELL, Memory_Map::CORE_ID, Memory_Map::DOORBELL));
+  static_assert(at_offset(Core_Registers::Register::MAILBOX_0, Memory_Map::CORE_ID, Memory_Map::MAILBOX_0));
+  static_assert(at_offset(Dma::Register::DESTINATION, Memory_Map::DMA_SOURCE, Memory_Map::DMA_DESTINATION));
+  static_assert(at_offset(Dma::Register::LENGTH, Memory_Map::DMA_SOURCE, Memory_Map::DMA_LENGTH));
+  static_assert(at_offset(Dma::Register::CONTROL, Memory_Map::DMA_SOURCE, Memory_Map::DMA_CONTROL));
+  static_assert(at_offset(Dma::Register::STATUS, Memory_Map::DMA_SOURCE, Memory_Map::DMA_STATUS));
+  static_assert(at_offset(Blitter::Register::RING_SIZE, Memory_Map::BLITTER_RING_BASE, Memory_Map::BLITTER_RING_SIZE));
+  static_assert(at_offset(Blitter::Register::HEAD, Memory_Map::BLITTER_RING_BASE, Memory_Map::BLITTER_HEAD));
+  static_assert(at_offset(Blitter::Register::TAIL, Memory_Map::BLITTER_RING_BASE, Memory_Map::BLITTER_TAIL));
+
+  static_assert(at_offset(Pmu::Register::INSTRUCTIONS, Memory_Map::PMU_CONTROL, Memory_Map::PMU_INSTRUCTIONS));
+  static_assert(at_offset(Pmu::Register::CYCLES, Memory_Map::PMU_CONTROL, Memory_Map::PMU_CYCLES));
+  static_assert(at_offset(Pmu::Register::LOADS, Memory_Map::PMU_CONTROL, Memory_Map::PMU_LOADS));
+  static_assert(at_offset(Pmu::Register::STORES, Memory_Map::PMU_CONTROL, Memory_Map::PMU_STORES));
+  static_assert(at_offset(Pmu::Register::BRANCHES_TAKEN, Memory_Map::PMU_CONTROL, Memory_Map::PMU_BRANCHES_TAKEN));
+
+  static_assert(at_offset(Trace_Markers::Register::END, Memory_Map::TRACE_BEGIN, Memory_Map::TRACE_END));
+  static_assert(at_offset(Trace_Markers::Register::NAME_ID, Memory_Map::TRACE_BEGIN, Memory_Map::TRACE_NAME_ID));
+  static_assert(at_offset(Trace_Markers::Register::NAME, Memory_Map::TRACE_BEGIN, Memory_Map::TRACE_NAME));
+
+  static_assert(sizeof(system::Blit_Command) == 28, "Blit_Command is shared with the guest and must not contain padding");
+
+  constexpr std::size_t blit_block_size = 64;
+  using Pixels                          = std::array<std::uint32_t, blit_block_size>;
+
+  // guest and all supported hosts are little endian, so guest pixels can be copied out directly
+  void load_pixels(Pixels &block, const std::uint8_t *src, const std::size_t count) noexcept { std::memcpy(block.data(), src, count * 4); }
+  void store_pixels(std::uint8_t *dest, const Pixels &block, const std::size_t count) noexcept { std::memcpy(dest, block.data(), count * 4); }
+
+  // src over dest by src's alpha, two channels at a time, x / 255 ~= (x + 128 + (x + 128) / 256) / 256
+  [[nodiscard]] constexpr std::uint32_t blend(const std::uint32_t src, const std::uint32_t dest) noexcept
+  {
+    const auto alpha   = src >> 24;
+    const auto inverse = 255 - alpha;
+
+    const auto scale = [](const std::uint32_t channels) { return ((channels + ((channels >> 8) & 0x00FF'00FF)) >> 8) & 0x00FF'00FF; };
+
+    const auto red_blue    = (src & 0x00FF'00FF) * alpha + (dest & 0x00FF'00FF) * inverse + 0x0080'0080;
+    const auto green_alpha = ((src >> 8) & 0x00FF'00FF) * alpha + ((dest >> 8) & 0x00FF'00FF) * inverse + 0x0080'0080;
+    return scale(red_blue) | (scale(green_alpha) << 8);
+  }
+
+  static_assert(blend(0xFF12'3456, 0xFFAB'CDEF) == 0xFF12'3456);
+  static_assert(blend(0x0012'3456, 0xFFAB'CDEF) == 0xFFAB'CDEF);
+
+  template<typename T>[[nodiscard]] T load(Core_Context &core, const Memory_Map loc) noexcept
+  {
+    T value{};
+    if (const auto *data = core.memory(address(loc), sizeof(T)); data != nullptr) { std::memcpy(&value, data, sizeof(T)); }
+    return value;
+  }
+
+  // 64 bit values of save states are stored low word first
+  void put_wide(std::vector<std::uint32_t> &words, const std::uint64_t value)
+  {
+    words.push_back(static_cast<std::uint32_t>(value));
+    words.push_back(static_cast<std::uint32_t>(value >> 32));
+  }
+
+  [[nodiscard]] constexpr std::uint64_t wide(const std::uint32_t low, const std::uint32_t high) noexcept
+  {
+    return std::uint64_t{ low } | (std::uint64_t{ high } << 32);
+  }
+
+  void put_counters(std::vector<std::uint32_t> &words, const Core_Counters &counters)
+  {
+    for (const auto value : { counters.instructions, counters.cycles, counters.loads, counters.stores, counters.branches_taken }) {
+      put_wide(words, value);
+    }
+  }
+
+  [[nodiscard]] constexpr Core_Counters counters_at(const std::vector<std::uint32_t> &words, const std::size_t first) noexcept
+  {
+    const auto at = [&](const std::size_t idx) { return wide(words[first + idx * 2], words[first + idx * 2 + 1]); };
+    return { at(0), at(1), at(2), at(3), at(4) };
+  }
+}  // namespace
+
+void Device_Bus::map(const std::uint32_t begin, const std::uint32_t end, std::unique_ptr<Device> device)
+{
+  if (begin % 4 != 0 || end % 4 != 0 || end <= begin) { throw std::invalid_argument("device range must be non empty and word aligned"); }
+  if (mappings.size() == std::numeric_limits<std::uint8_t>::max()) { throw std::length_error("too many devices"); }
+
+  const auto index = static_cast<std::uint32_t>(mappings.size());
+  mappings.push_back(Mapping{ device.get(), begin, index });
+  owned.push_back(std::move(device));
+
+  for (auto loc = begin; loc != end; loc += 4) {
+    const auto page = loc >> page_bits;
+    if (page >= pages.size()) { pages.resize(page + 1); }
+
+    if (pages[page] == 0) {
+      words.emplace_back();
+      pages[page] = static_cast<std::uint16_t>(words.size());
+    }
+
+    auto &slot = words[pages[page] - 1u][(loc & (page_size - 1)) / 4];
+    if (slot != 0) { throw std::invalid_argument("device ranges overlap"); }
+    slot = static_cast<std::uint8_t>(index + 1);
+  }
+}
+
+Random_Device::Random_Device() : Random_Device(std::random_device{}()) {}
+
+void Random_Device::reseed(std::uint64_t seed) noexcept
+{
+  // splitmix64 to spread the seed over all lanes, as recommended for xoshiro
+  const auto splitmix64 = [&seed]() {
+    seed += 0x9E37'79B9'7F4A'7C15;
+    auto z = seed;
+    z      = (z ^ (z >> 30)) * 0xBF58'476D'1CE4'E5B9;
+    z      = (z ^ (z >> 27)) * 0x94D0'49BB'1331'11EB;
+    return z ^ (z >> 31);
+  };
+
+  for (std::size_t lane = 0; lane < lanes; ++lane) {
+    for (std::size_t word = 0; word < state.size(); word += 2) {
+      const auto value      = splitmix64();
+      state[word][lane]     = static_cast<std::uint32_t>(value);
+      state[word + 1][lane] = static_cast<std::uint32_t>(value >> 32);
+    }
+  }
+
+  position = buffer.size();
+}
+
+void Random_Device::refill() noexcept
+{
+  const auto rotl = [](const std::uint32_t value, const int shift) { return (value << shift) | (value >> (32 - shift)); };
+
+  auto &[s0, s1, s2, s3] = state;
+
+  for (std::size_t round = 0; round < buffer.size() / lanes; ++round) {
+    for (std::size_t lane = 0; lane < lanes; ++lane) {
+      buffer[round * lanes + lane] = rotl(s0[lane] + s3[lane], 7) + s0[lane];
+
+      const auto t = s1[lane] << 9;
+      s2[lane] ^= s0[lane];
+      s3[lane] ^= s1[lane];
+      s1[lane] ^= s2[lane];
+      s0[lane] ^= s3[lane];
+      s2[lane] ^= t;
+      s3[lane] = rotl(s3[lane], 11);
+    }
+  }
+
+  position = 0;
+}
+
+std::vector<std::uint32_t> Random_Device::save_state() const
+{
+  std::vector<std::uint32_t> words;
+  for (const auto &word : state) { words.insert(words.end(), word.begin(), word.end()); }
+  words.insert(words.end(), buffer.begin(), buffer.end());
+  words.push_back(static_cast<std::uint32_t>(position));
+  return words;
+}
+
+bool Random_Device::restore_state(const std::vector<std::uint32_t> &t_state) noexcept
+{
+  if (t_state.size() != state.size() * lanes + buffer.size() + 1 || t_state.back() > buffer.size()) { return false; }
+
+  auto word = t_state.begin();
+  for (auto &lane_words : state) {
+    std::copy_n(word, lanes, lane_words.begin());
+    word += lanes;
+  }
+  std::copy_n(word, buffer.size(), buffer.begin());
+  position = t_state.back();
+  return true;
+}
+
+void Interrupt_Controller::raise(Core_Context &core, const system::Interrupt_Source source) noexcept
+{
+  status |= static_cast<std::uint32_t>(source);
+  update(core);
+}
+
+void Interrupt_Controller::update(Core_Context &core) const noexcept
+{
+  const auto pending = status & enable;
+  core.set_interrupt_lines((pending & ~fiq_select) != 0, (pending & fiq_select) != 0);
+}
+
+std::uint32_t Interrupt_Controller::read([[maybe_unused]] const Core_View &core, const std::uint32_t offset) noexcept
+{
+  switch (static_cast<Register>(offset)) {
+  case Register::STATUS: return status;
+  case Register::ENABLE: return enable;
+  case Register::FIQ_SELECT: return fiq_select;
+  case Register::WAIT_FOR_INTERRUPT: return 0;
+  }
+  return 0;
+}
+
+void Interrupt_Controller::write(Core_Context &core, const std::uint32_t offset, const std::uint32_t value) noexcept
+{
+  switch (static_cast<Register>(offset)) {
+  case Register::STATUS: status &= ~value; return update(core);
+  case Register::ENABLE: enable = value; return update(core);
+  case Register::FIQ_SELECT: fiq_select = value; return update(core);
+  case Register::WAIT_FOR_INTERRUPT: return core.wait_for_interrupt();
+  }
+}
+
+std::vector<std::uint32_t> Interrupt_Controller::save_state() const { return { status, enable, fiq_select }; }
+
+bool Interrupt_Controller::restore_state(const std::vector<std::uint32_t> &state) noexcept
+{
+  if (state.size() != 3) { return false; }
+  status     = state[0];
+  enable     = state[1];
+  fiq_select = state[2];
+  return true;
+}
+
+std::uint32_t Timer::read(const Core_View &core, const std::uint32_t offset) noexcept
+{
+  switch (static_cast<Register>(offset)) {
+  case Register::LOAD: return load;
+  case Register::CONTROL: return control;
+  case Register::VALUE:
+    if (!enabled() || due <= core.cycles()) { return 0; }
+    return static_cast<std::uint32_t>(due - core.cycles());
+  }
+  return 0;
+}
+
+void Timer::write(Core_Context &core, const std::uint32_t offset, const std::uint32_t value) noexcept
+{
+  switch (static_cast<Register>(offset)) {
+  case Register::LOAD: load = value; return;
+  case Register::CONTROL:
+    // writing the control register (re)starts the timer
+    control = value;
+    core.cancel(0);
+    if (enabled()) {
+      due = core.cycles() + period();
+      core.schedule(due, 0);
+    }
+    return;
+  case Register::VALUE: return;
+  }
+}
+
+void Timer::event(Core_Context &core, [[maybe_unused]] const std::uint32_t id) noexcept
+{
+  interrupt_controller->raise(core, source);
+
+  if (periodic()) {
+    // relative to when it was due, so that late dispatch does not accumulate drift
+    due += period();
+    core.schedule(due, 0);
+  } else {
+    control &= ~static_cast<std::uint32_t>(system::Timer_Control::ENABLE);
+  }
+}
+
+std::vector<std::uint32_t> Timer::save_state() const
+{
+  std::vector<std::uint32_t> words{ load, control };
+  put_wide(words, due);
+  return words;
+}
+
+bool Timer::restore_state(const std::vector<std::uint32_t> &state) noexcept
+{
+  if (state.size() != 4) { return false; }
+  load    = state[0];
+  control = state[1];
+  due     = wide(state[2], state[3]);
+  return true;
+}
+
+std::uint32_t Dma::read([[maybe_unused]] const Core_View &core, const std::uint32_t offset) noexcept
+{
+  switch (static_cast<Register>(offset)) {
+  case Register::SOURCE: return source;
+  case Register::DESTINATION: return destination;
+  case Register::LENGTH: return length;
+  case Register::CONTROL: return 0;
+  case Register::STATUS: return status;
+  }
+  return 0;
+}
+
+void Dma::write(Core_Context &core, const std::uint32_t offset, const std::uint32_t value) noexcept
+{
+  switch (static_cast<Register>(offset)) {
+  case Register::SOURCE: source = value; return;
+  case Register::DESTINATION: destination = value; return;
+  case Register::LENGTH: length = value; return;
+  case Register::CONTROL:
+    if ((value & static_cast<std::uint32_t>(system::Dma_Control::START)) == 0) { return; }
+
+    // a new transfer replaces one still in flight
+    core.cancel(0);
+
+    if (!transfer(core, value)) {
+      status = static_cast<std::uint32_t>(system::Dma_Status::ERROR);
+      return;
+    }
+
+    status = static_cast<std::uint32_t>(system::Dma_Status::BUSY);
+    core.schedule(core.cycles() + std::max(length / bytes_per_cycle, 1u), 0);
+    return;
+  case Register::STATUS: return;
+  }
+}
+
+void Dma::event(Core_Context &core, [[maybe_unused]] const std::uint32_t id) noexcept
+{
+  status = 0;
+  interrupt_controller->raise(core, system::Interrupt_Source::DMA);
+}
+
+std::vector<std::uint32_t> Dma::save_state() const { return { source, destination, length, status }; }
+
+bool Dma::restore_state(const std::vector<std::uint32_t> &state) noexcept
+{
+  if (state.size() != 4) { return false; }
+  source      = state[0];
+  destination = state[1];
+  length      = state[2];
+  status      = state[3];
+  return true;
+}
+
+bool Dma::transfer(Core_Context &core, const std::uint32_t control) const noexcept
+{
+  auto *dest = core.memory(destination, length);
+  if (dest == nullptr) { return false; }
+
+  if ((control & static_cast<std::uint32_t>(system::Dma_Control::FILL)) == 0) {
+    const auto *src = core.memory(source, length);
+    if (src == nullptr) { return false; }
+    std::memmove(dest, src, length);
+    return true;
+  }
+
+  const auto byte = source & 0xFF;
+  if (source == byte * 0x0101'0101) {
+    std::memset(dest, static_cast<int>(byte), length);
+    return true;
+  }
+
+  // the pattern repeats on word boundaries of the destination
+  std::array<std::uint8_t, 4> pattern{};
+  for (std::size_t idx = 0; idx < pattern.size(); ++idx) { pattern[idx] = static_cast<std::uint8_t>(source >> (((destination + idx) % 4) * 8)); }
+  for (std::size_t idx = 0; idx < length; ++idx) { dest[idx] = pattern[idx % 4]; }  // NOLINT
+  return true;
+}
+
+std::uint32_t Blitter::read([[maybe_unused]] const Core_View &core, const std::uint32_t offset) noexcept
+{
+  switch (static_cast<Register>(offset)) {
+  case Register::RING_BASE: return ring_base;
+  case Register::RING_SIZE: return ring_size;
+  case Register::HEAD:
+  case Register::TAIL: return tail;
+  }
+  return 0;
+}
+
+void Blitter::write(Core_Context &core, const std::uint32_t offset, const std::uint32_t value) noexcept
+{
+  switch (static_cast<Register>(offset)) {
+  case Register::RING_BASE: ring_base = value; return;
+  case Register::RING_SIZE: ring_size = value; return;
+  case Register::HEAD:
+    // a head further ahead than the ring holds is not a queue of commands, running it could take forever
+    if (ring_size == 0 || value - tail > ring_size) { return; }
+
+    for (; tail != value; ++tail) {
+      const auto *entry = core.memory(ring_base + (tail % ring_size) * static_cast<std::uint32_t>(sizeof(system::Blit_Command)),
+                                      sizeof(system::Blit_Command));
+      if (entry == nullptr) { continue; }
+
+      system::Blit_Command command{};
+      std::memcpy(&command, entry, sizeof(command));
+      run(core, command);
+    }
+    return;
+  case Register::TAIL: return;
+  }
+}
+
+std::vector<std::uint32_t> Blitter::save_state() const { return { ring_base, ring_size, tail }; }
+
+bool Blitter::restore_state(const std::vector<std::uint32_t> &state) noexcept
+{
+  if (state.size() != 3) { return false; }
+  ring_base = state[0];
+  ring_size = state[1];
+  tail      = state[2];
+  return true;
+}
+
+void Blitter::run(Core_Context &core, const system::Blit_Command &command) noexcept
+{
+  const auto screen_width  = std::int32_t{ load<std::uint16_t>(core, Memory_Map::SCREEN_WIDTH) };
+  const auto screen_height = std::int32_t{ load<std::uint16_t>(core, Memory_Map::SCREEN_HEIGHT) };
+  const auto screen_size   = static_cast<std::size_t>(screen_width) * static_cast<std::size_t>(screen_height) * 4;
+  auto *screen             = core.memory(load<std::uint32_t>(core, Memory_Map::SCREEN_BUFFER), screen_size);
+  if (screen == nullptr) { return; }
+
+  const auto scaled = command.operation == system::Blit_Operation::SCALED_BLIT;
+  const auto keyed  = (command.flags & static_cast<std::uint16_t>(system::Blit_Flags::COLOR_KEY)) != 0
+                     && (command.operation == system::Blit_Operation::COPY_RECT || scaled);
+
+  // clipped to the screen
+  const auto left   = std::max(std::int32_t{ command.x }, 0);
+  const auto top    = std::max(std::int32_t{ command.y }, 0);
+  const auto right  = std::min(command.x + std::int32_t{ command.width }, screen_width);
+  const auto bottom = std::min(command.y + std::int32_t{ command.height }, screen_height);
+
+  Pixels src{};
+  Pixels dest{};
+
+  for (auto y = top; y < bottom; ++y) {
+    const auto row     = static_cast<std::uint32_t>(y - command.y);
+    auto *screen_row   = screen + static_cast<std::size_t>(y * screen_width) * 4;  // NOLINT
+    const auto src_row = [&]() -> const std::uint8_t * {
+      const auto source_row = scaled ? row * command.source_height / std::max(command.height, std::uint16_t{ 1 }) : row;
+      const auto width      = scaled ? command.source_width : command.width;
+      return core.memory(command.source + source_row * command.source_stride * 4u, std::size_t{ width } * 4);
+    }();
+
+    if (command.operation != system::Blit_Operation::FILL_RECT && src_row == nullptr) { return; }
+
+    for (auto x = left; x < right; x += static_cast<std::int32_t>(blit_block_size)) {
+      const auto count    = std::min(blit_block_size, static_cast<std::size_t>(right - x));
+      const auto column   = static_cast<std::uint32_t>(x - command.x);
+      auto *screen_pixels = screen_row + static_cast<std::size_t>(x) * 4;  // NOLINT
+
+      switch (command.operation) {
+      case system::Blit_Operation::FILL_RECT: src.fill(command.source); break;
+      case system::Blit_Operation::COPY_RECT:
+      case system::Blit_Operation::BLEND_RECT: load_pixels(src, src_row + column * 4, count); break;  // NOLINT
+      case system::Blit_Operation::SCALED_BLIT:
+        for (std::size_t idx = 0; idx < count; ++idx) {
+          const auto source_column = (column + idx) * command.source_width / command.width;
+          std::memcpy(&src[idx], src_row + source_column * 4, 4);  // NOLINT
+        }
+        break;
+      }
+
+      if (command.operation == system::Blit_Operation::BLEND_RECT) {
+        load_pixels(dest, screen_pixels, count);
+        for (std::size_t idx = 0; idx < blit_block_size; ++idx) { dest[idx] = blend(src[idx], dest[idx]); }
+        store_pixels(screen_pixels, dest, count);
+      } else if (keyed) {
+        load_pixels(dest, screen_pixels, count);
+        for (std::size_t idx = 0; idx < blit_block_size; ++idx) { dest[idx] = src[idx] == command.color_key ? dest[idx] : src[idx]; }
+        store_pixels(screen_pixels, dest, count);
+      } else {
+        store_pixels(screen_pixels, src, count);
+      }
+    }
+  }
+}
+
+Core_Counters Pmu::counters(const Core_View &core) const noexcept
+{
+  if (!enabled()) { return accumulated; }
+
+  const auto now = core.counters();
+  return { accumulated.instructions + now.instructions - started.instructions,
+           accumulated.cycles + now.cycles - started.cycles,
+           accumulated.loads + now.loads - started.loads,
+           accumulated.stores + now.stores - started.stores,
+           accumulated.branches_taken + now.branches_taken - started.branches_taken };
+}
+
+std::uint32_t Pmu::read(const Core_View &core, const std::uint32_t offset) noexcept
+{
+  if (static_cast<Register>(offset) == Register::CONTROL) { return control; }
+
+  // the high word of a counter follows its low word
+  if (offset % 8 == 4) { return latched_high; }
+
+  const auto value = [&, current = counters(core)]() -> std::uint64_t {
+    switch (static_cast<Register>(offset)) {
+    case Register::INSTRUCTIONS: return current.instructions;
+    case Register::CYCLES: return current.cycles;
+    case Register::LOADS: return current.loads;
+    case Register::STORES: return current.stores;
+    case Register::BRANCHES_TAKEN: return current.branches_taken;
+    case Register::CONTROL: break;
+    }
+    return 0;
+  }();
+
+  latched_high = static_cast<std::uint32_t>(value >> 32);
+  return static_cast<std::uint32_t>(value);
+}
+
+void Pmu::write(Core_Context &core, const std::uint32_t offset, const std::uint32_t value) noexcept
+{
+  if (static_cast<Register>(offset) != Register::CONTROL) { return; }
+
+  accumulated = counters(core);
+  if ((value & static_cast<std::uint32_t>(system::Pmu_Control::RESET)) != 0) { accumulated = Core_Counters{}; }
+
+  control = value & static_cast<std::uint32_t>(system::Pmu_Control::ENABLE);
+  started = core.counters();
+}
+
+std::vector<std::uint32_t> Pmu::save_state() const
+{
+  std::vector<std::uint32_t> words{ control, latched_high };
+  put_counters(words, accumulated);
+  put_counters(words, started);
+  return words;
+}
+
+bool Pmu::restore_state(const std::vector<std::uint32_t> &state) noexcept
+{
+  if (state.size() != 22) { return false; }
+  control      = state[0];
+  latched_high = state[1];
+  accumulated  = counters_at(state, 2);
+  started      = counters_at(state, 12);
+  return true;
+}
+
+std::uint32_t Trace_Markers::read([[maybe_unused]] const Core_View &core, const std::uint32_t offset) noexcept
+{
+  if (static_cast<Register>(offset) == Register::NAME_ID) { return name_id; }
+  return 0;
+}
+
+void Trace_Markers::write(Core_Context &core, const std::uint32_t offset, const std::uint32_t value) noexcept
+{
+  switch (static_cast<Register>(offset)) {
+  case Register::BEGIN:
+    if (open.size() == max_depth) { return; }
+    open.push_back(Span{ value, static_cast<std::uint32_t>(open.size()), core.counters().instructions, 0, now(), {} });
+    return;
+  case Register::END: {
+    // ending a span also ends the spans nested in it that were left open
+    const auto span = std::find_if(open.rbegin(), open.rend(), [value](const Span &s) { return s.id == value; });
+    if (span == open.rend()) { return; }
+
+    const auto remaining   = static_cast<std::size_t>(std::distance(span, open.rend())) - 1;
+    const auto instruction = core.counters().instructions;
+    const auto time        = now();
+    while (open.size() != remaining) {
+      auto ending            = open.back();
+      ending.end_instruction = instruction;
+      ending.end_time        = time;
+      open.pop_back();
+
+      if (ended.size() < capacity) {
+        ended.push_back(ending);
+      } else {
+        ended[next] = ending;
+        next        = (next + 1) % capacity;
+      }
+    }
+    return;
+  }
+  case Register::NAME_ID: name_id = value; return;
+  case Register::NAME: {
+    std::string name;
+    for (std::uint32_t loc = value; name.size() < max_name_length; ++loc) {
+      const auto *character = core.memory(loc, 1);
+      if (character == nullptr || *character == 0) { break; }
+      name.push_back(static_cast<char>(*character));
+    }
+    names[name_id] = std::move(name);
+    return;
+  }
+  }
+}
+
+std::vector<Trace_Markers::Span> Trace_Markers::spans() const
+{
+  std::vector<Span> result(ended.begin() + static_cast<std::ptrdiff_t>(next), ended.end());
+  result.insert(result.end(), ended.begin(), ended.begin() + static_cast<std::ptrdiff_t>(next));
+  return result;
+}
+
+std::string Trace_Markers::name(const std::uint32_t id) const
+{
+  if (const auto found = names.find(id); found != names.end()) { return found->second; }
+  return "marker " + std::to_string(id);
+}
+
+void write_chrome_trace(std::ostream &os, const std::vector<const Trace_Markers *> &cores, const Timeline timeline)
+{
+  const auto json_string = [](const std::string &str) {
+    std::string result{ '"' };
+    for (const auto character : str) {
+      if (character == '"' || character == '\\') {
+        result += '\\';
+        result += character;
+      } else if (static_cast<unsigned char>(character) < 0x20) {
+        result += ' ';
+      } else {
+        result += character;
+      }
+    }
+    return result + '"';
+  };
+
+  os << "{\"traceEvents\":[";
+
+  bool first = true;
+  for (std::size_t core = 0; core < cores.size(); ++core) {
+    for (const auto &span : cores[core]->spans()) {
+      const auto [begin, duration] = [&]() -> std::pair<double, double> {
+        if (timeline == Timeline::GUEST_INSTRUCTIONS) {
+          return { static_cast<double>(span.begin_instruction), static_cast<double>(span.end_instruction - span.begin_instruction) };
+        }
+        return { std::chrono::duration<double, std::micro>(span.begin_time).count(),
+                 std::chrono::duration<double, std::micro>(span.end_time - span.begin_time).count() };
+      }();
+
+      os << (first ? "\n" : ",\n") << "{\"name\":" << json_string(cores[core]->name(span.id)) << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << core
+         << ",\"ts\":" << begin << ",\"dur\":" << duration << ",\"args\":{\"instructions\":" << span.end_instruction - span.begin_instruction
+         << ",\"depth\":" << span.depth << "}}";
+      first = false;
+    }
+  }
+
+  os << "\n]}\n";
+}
+
+void Core_Registers::join(Core_Context &core, const std::uint32_t id, std::shared_ptr<Mailboxes> shared) noexcept
+{
+  core_id   = id;
+  mailboxes = std::move(shared);
+  core.schedule(core.cycles() + doorbell_poll_interval, 0);
+}
+
+std::uint32_t Core_Registers::read([[maybe_unused]] const Core_View &core, const std::uint32_t offset) noexcept
+{
+  if (offset >= static_cast<std::uint32_t>(Register::MAILBOX_0)) {
+    const auto mailbox = (offset - static_cast<std::uint32_t>(Register::MAILBOX_0)) / 4;
+    return mailboxes ? mailboxes->words[mailbox].load() : 0;
+  }
+
+  switch (static_cast<Register>(offset)) {
+  case Register::CORE_ID: return core_id;
+  case Register::CORE_COUNT: return mailboxes ? mailboxes->core_count : 1;
+  default: return 0;
+  }
+}
+
+void Core_Registers::write([[maybe_unused]] Core_Context &core, const std::uint32_t offset, const std::uint32_t value) noexcept
+{
+  if (!mailboxes) { return; }
+
+  if (offset >= static_cast<std::uint32_t>(Register::MAILBOX_0)) {
+    const auto mailbox = (offset - static_cast<std::uint32_t>(Register::MAILBOX_0)) / 4;
+    return mailboxes->words[mailbox].store(value);
+  }
+
+  if (static_cast<Register>(offset) == Register::DOORBELL) {
+    for (std::uint32_t other = 0; other < mailboxes->core_count; ++other) {
+      if ((value & (1u << other)) != 0) { mailboxes->doorbells[other].store(true); }
+    }
+  }
+}
+
+void Core_Registers::event(Core_Context &core, [[maybe_unused]] const std::uint32_t id) noexcept
+{
+  // only scheduled once joined, but a damaged save state may hold the event anyway
+  if (!mailboxes) { return; }
+  if (mailboxes->doorbells[core_id].exchange(false)) { interrupt_controller->raise(core, system::Interrupt_Source::DOORBELL); }
+  core.schedule(core.cycles() + doorbell_poll_interval, 0);
+}
+
+Devices::Devices()
+{
+  const auto end_of = [](const Memory_Map last_register) { return address(last_register) + 4; };
+
+  m_random               = &bus.add<Random_Device>(address(Memory_Map::RANDOM_DEVICE), end_of(Memory_Map::RANDOM_DEVICE));
+  m_interrupt_controller = &bus.add<Interrupt_Controller>(address(Memory_Map::INTERRUPT_STATUS), end_of(Memory_Map::WAIT_FOR_INTERRUPT));
+  m_timers[0] =
+    &bus.add<Timer>(address(Memory_Map::TIMER_0_LOAD), end_of(Memory_Map::TIMER_0_VALUE), *m_interrupt_controller, system::Interrupt_Source::TIMER_0);
+  m_timers[1] =
+    &bus.add<Timer>(address(Memory_Map::TIMER_1_LOAD), end_of(Memory_Map::TIMER_1_VALUE), *m_interrupt_controller, system::Interrupt_Source::TIMER_1);
+  m_core_registers =
+    &bus.add<Core_Registers>(address(Memory_Map::CORE_ID), address(Memory_Map::MAILBOX_0) + system::MAILBOX_COUNT * 4, *m_interrupt_controller);
+  m_dma           = &bus.add<Dma>(address(Memory_Map::DMA_SOURCE), end_of(Memory_Map::DMA_STATUS), *m_interrupt_controller);
+  m_blitter       = &bus.add<Blitter>(address(Memory_Map::BLITTER_RING_BASE), end_of(Memory_Map::BLITTER_TAIL));
+  m_pmu           = &bus.add<Pmu>(address(Memory_Map::PMU_CONTROL), end_of(Memory_Map::PMU_BRANCHES_TAKEN) + 4);
+  m_trace_markers = &bus.add<Trace_Markers>(address(Memory_Map::TRACE_BEGIN), end_of(Memory_Map::TRACE_NAME));
+}
+
+std::vector<std::vector<std::uint32_t>> Devices::save_state() const
+{
+  std::vector<std::vector<std::uint32_t>> state;
+  for (std::uint32_t index = 0; index < bus.size(); ++index) { state.push_back(bus.device(index).save_state()); }
+  return state;
+}
+
+bool Devices::restore_state(const std::vector<std::vector<std::uint32_t>> &state)
+{
+  if (state.size() != bus.size()) { return false; }
+
+  // no device is restored unless all of the sizes match
+  for (std::uint32_t index = 0; index < bus.size(); ++index) {
+    if (bus.device(index).save_state().size() != state[index].size()) { return false; }
+  }
+
+  bool restored = true;
+  for (std::uint32_t index = 0; index < bus.size(); ++index) { restored = bus.device(index).restore_state(state[index]) && restored; }
+  return restored;
+}
+
+}  // namespace cpp_box::devices
@@ -0,0 +1,51 @@
+#include "../include/cpp_box/heatmap.hpp"
+#include "../include/cpp_box/elf_reader.hpp"
+
+namespace cpp_box::heatmap {
+
+std::vector<Data_Symbol> data_symbols(const Loaded_Files &files)
+{
+  std::vector<Data_Symbol> symbols;
+  if (!files.good_binary || !files.binary_file) { return symbols; }
+
+  const auto file_header = elf::File_Header{ { files.binary_file->data(), files.binary_file->size() } };
+  if (!file_header.is_elf_file()) { return symbols; }
+
+  // the whole file is loaded at USER_RAM_START, see load_unknown
+  const auto string_table = file_header.string_table();
+  for (const auto &header : file_header.section_headers()) {
+    for (const auto &symbol : header.symbol_table_entries()) {
+      const auto section = symbol.section_header_table_index();
+      if (symbol.type() != elf::Symbol_Table_Entry::Type::STT_OBJECT || symbol.size() == 0 || section == 0
+          || section >= file_header.section_header_num_entries()) {
+        continue;
+      }
+
+      const auto begin = static_cast<std::uint32_t>(file_header.section_header(section).offset() + symbol.value()
+                                                    + static_cast<std::uint32_t>(system::Memory_Map::USER_RAM_START));
+      symbols.push_back(Data_Symbol{ std::string{ symbol.name(string_table) }, begin, begin + static_cast<std::uint32_t>(symbol.size()) });
+    }
+  }
+
+  return symbols;
+}
+
+std::vector<Symbol_Counts> symbol_counts(const Memory_Heatmap &heatmap, const std::vector<Data_Symbol> &symbols)
+{
+  std::vector<Symbol_Counts> result;
+  for (const auto &symbol : symbols) {
+    Counts counts;
+    for (auto loc = symbol.begin & ~3u; loc < symbol.end; loc += 4) {
+      if (const auto word = (loc - heatmap.words_begin) >> 2; word < heatmap.words.size()) {
+        counts.reads += heatmap.words[word].reads;
+        counts.writes += heatmap.words[word].writes;
+      }
+    }
+    if (counts.total() != 0) { result.push_back(Symbol_Counts{ &symbol, counts }); }
+  }
+
+  std::sort(result.begin(), result.end(), [](const auto &lhs, const auto &rhs) { return lhs.counts.total() > rhs.counts.total(); });
+  return result;
+}
+
+}  // namespace cpp_box::heatmap
@@ -0,0 +1,62 @@
+#include "../include/cpp_box/lockstep.hpp"
+#include "../include/cpp_box/compiler.hpp"
+#include "../include/cpp_box/memory_map.hpp"
+
+#include <iomanip>
+#include <ostream>
+
+namespace cpp_box::lockstep {
+
+void write_divergence(std::ostream &os, const Divergence &divergence, const Loaded_Files &files)
+{
+  constexpr std::array<const char *, 16> register_names{ "r0", "r1", "r2",  "r3",  "r4",  "r5", "r6", "r7",
+                                                         "r8", "r9", "r10", "r11", "r12", "sp", "lr", "pc" };
+
+  const auto hex = [&os](const std::uint64_t value, const int width) -> std::ostream & {
+    return os << "0x" << std::hex << std::setfill('0') << std::setw(width) << value << std::setfill(' ') << std::dec;
+  };
+
+  os << "Divergence after " << divergence.instructions << " instructions, the last comparison without differences was after "
+     << divergence.last_match << '\n';
+
+  switch (divergence.difference) {
+  case Difference::NONE: os << "  none\n"; return;
+  case Difference::REGISTER: os << "  " << register_names[divergence.register_index] << ": expected "; break;
+  case Difference::CPSR: os << "  CPSR: expected "; break;
+  case Difference::MEMORY: os << "  memory hash: expected "; break;
+  case Difference::FINISHED:
+    os << "  the " << (divergence.expected != 0 ? "reference" : "candidate") << " finished and the "
+       << (divergence.expected != 0 ? "candidate" : "reference") << " did not\n";
+    break;
+  }
+
+  if (divergence.difference != Difference::FINISHED) {
+    const auto width = divergence.difference == Difference::MEMORY ? 16 : 8;
+    hex(divergence.expected, width) << ", candidate has ";
+    hex(divergence.actual, width) << '\n';
+  }
+
+  os << "Last block executed:\n";
+  const auto user_ram_start = static_cast<std::uint32_t>(system::Memory_Map::USER_RAM_START);
+  for (std::size_t idx = 0; idx < divergence.block_words.size(); ++idx) {
+    const auto pc = static_cast<std::uint32_t>(divergence.block_begin + idx * 4);
+    if (pc > divergence.block_last) { break; }
+
+    const auto word = divergence.block_words[idx];
+    os << "  ";
+    hex(pc, 8) << ": ";
+    hex(word, 8) << "  ";
+
+    if (const auto location = files.location_data.find(pc - user_ram_start); location != files.location_data.end()) {
+      os << location->second.disassembly;
+      if (location->second.line_number != 0) { os << "  ; " << location->second.filename.string() << ':' << location->second.line_number; }
+    } else {
+      os << to_string(arm::System<>::decode(arm::Instruction{ word }));
+    }
+    os << '\n';
+  }
+
+  if (divergence.block_begin + divergence.block_words.size() * 4 <= divergence.block_last) { os << "  ...\n"; }
+}
+
+}  // namespace cpp_box::lockstep
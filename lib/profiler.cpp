@@ -0,0 +1,301 @@
+#include "../include/cpp_box/profiler.hpp"
+#include "../include/cpp_box/elf_reader.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <sstream>
+
+#if __has_include(<cxxabi.h>)
+#include <cxxabi.h>
+#endif
+
+namespace cpp_box::profiler {
+
+namespace {
+  [[nodiscard]] std::string address_of(const std::uint32_t object_offset)
+  {
+    std::ostringstream ss;
+    ss << "0x" << std::hex << std::setw(8) << std::setfill('0') << object_offset + static_cast<std::uint32_t>(system::Memory_Map::USER_RAM_START);
+    return ss.str();
+  }
+
+  // objdump labels end with a ':'
+  [[nodiscard]] std::string function_of(const Memory_Location &location)
+  {
+    auto name = location.function_name;
+    if (!name.empty() && name.back() == ':') { name.pop_back(); }
+    return name.empty() ? std::string{ "<unknown>" } : name;
+  }
+
+  [[nodiscard]] std::vector<Profile_Entry> sorted(const std::unordered_map<std::string, std::uint64_t> &samples)
+  {
+    std::vector<Profile_Entry> entries;
+    entries.reserve(samples.size());
+    for (const auto &[name, count] : samples) { entries.push_back(Profile_Entry{ name, count }); }
+
+    std::sort(entries.begin(), entries.end(), [](const auto &lhs, const auto &rhs) {
+      return lhs.samples != rhs.samples ? lhs.samples > rhs.samples : lhs.name < rhs.name;
+    });
+    return entries;
+  }
+
+  [[nodiscard]] std::string demangle(const std::string_view name)
+  {
+#if __has_include(<cxxabi.h>)
+    const std::string mangled{ name };
+    int status = 0;
+    const std::unique_ptr<char, decltype(&std::free)> demangled{ abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status), &std::free };
+    if (status == 0 && demangled) { return demangled.get(); }
+#endif
+    return std::string{ name };
+  }
+
+  // the symbol containing `address`, or the address itself if there is none
+  [[nodiscard]] std::string function_name(const std::map<std::uint32_t, std::string> &symbols, const std::uint32_t address)
+  {
+    std::ostringstream ss;
+    if (auto symbol = symbols.upper_bound(address); symbol != symbols.begin()) {
+      --symbol;
+      ss << symbol->second;
+      if (symbol->first != address) { ss << "+0x" << std::hex << address - symbol->first; }
+    } else {
+      ss << "0x" << std::hex << std::setw(8) << std::setfill('0') << address;
+    }
+    return ss.str();
+  }
+
+  [[nodiscard]] std::string json_string(const std::string &str)
+  {
+    std::string result{ '"' };
+    for (const auto character : str) {
+      if (character == '"' || character == '\\') {
+        result += '\\';
+        result += character;
+      } else if (static_cast<unsigned char>(character) < 0x20) {
+        result += ' ';
+      } else {
+        result += character;
+      }
+    }
+    return result + '"';
+  }
+
+  struct Branch_Row
+  {
+    std::string line;
+    std::string disassembly;
+    std::uint32_t offset;
+    const Branch_Profiler::Branch *branch;
+  };
+
+  // sorted by source line, then address, instructions without location data sort last as "<unknown>"
+  [[nodiscard]] std::vector<Branch_Row> branch_rows(const Branch_Profiler &profiler, const Loaded_Files &files)
+  {
+    std::vector<Branch_Row> rows;
+    rows.reserve(profiler.branches.size());
+    for (const auto &[address, branch] : profiler.branches) {
+      const auto offset = address - static_cast<std::uint32_t>(system::Memory_Map::USER_RAM_START);
+      if (const auto location = files.location_data.find(offset); location != files.location_data.end()) {
+        rows.push_back(Branch_Row{ location->second.filename.filename().string() + ':' + std::to_string(location->second.line_number),
+                                   location->second.disassembly,
+                                   offset,
+                                   &branch });
+      } else {
+        rows.push_back(Branch_Row{ "<unknown>", "", offset, &branch });
+      }
+    }
+
+    std::sort(rows.begin(), rows.end(), [](const auto &lhs, const auto &rhs) {
+      const bool lhs_unknown = lhs.line == "<unknown>";
+      const bool rhs_unknown = rhs.line == "<unknown>";
+      if (lhs_unknown != rhs_unknown) { return rhs_unknown; }
+      return lhs.line != rhs.line ? lhs.line < rhs.line : lhs.offset < rhs.offset;
+    });
+    return rows;
+  }
+
+  [[nodiscard]] double taken_percent(const Branch_Profiler::Branch &branch)
+  {
+    const auto executions = branch.passed + branch.failed;
+    return executions == 0 ? 100.0 : 100.0 * static_cast<double>(branch.passed) / static_cast<double>(executions);
+  }
+}  // namespace
+
+Profile summarize(const Sampling_Profiler &profiler, const Loaded_Files &files)
+{
+  std::unordered_map<std::string, std::uint64_t> instructions;
+  std::unordered_map<std::string, std::uint64_t> lines;
+  std::unordered_map<std::string, std::uint64_t> functions;
+
+  for (const auto &[offset, count] : profiler.hits) {
+    const auto location = files.location_data.find(offset);
+    if (location == files.location_data.end()) {
+      instructions[address_of(offset)] += count;
+      lines["<unknown>"] += count;
+      functions["<unknown>"] += count;
+      continue;
+    }
+
+    instructions[address_of(offset) + "  " + location->second.disassembly] += count;
+    lines[location->second.filename.filename().string() + ':' + std::to_string(location->second.line_number)] += count;
+    functions[function_of(location->second)] += count;
+  }
+
+  return Profile{ profiler.samples, profiler.interval, sorted(instructions), sorted(lines), sorted(functions) };
+}
+
+void write_report(std::ostream &os, const Profile &profile, const std::size_t max_entries)
+{
+  os << "Samples: " << std::dec << profile.samples << " (one every " << profile.interval << " instructions)\n";
+  if (profile.samples == 0) { return; }
+
+  const auto section = [&os, &profile, max_entries](const char *title, const std::vector<Profile_Entry> &entries) {
+    os << '\n' << title << "\n   self%    samples\n";
+    for (std::size_t idx = 0; idx < std::min(max_entries, entries.size()); ++idx) {
+      const auto percent = 100.0 * static_cast<double>(entries[idx].samples) / static_cast<double>(profile.samples);
+      os << std::fixed << std::setprecision(2) << std::setw(8) << percent << std::setw(11) << entries[idx].samples << "  " << entries[idx].name
+         << '\n';
+    }
+  };
+
+  section("Functions", profile.functions);
+  section("Lines", profile.lines);
+  section("Instructions", profile.instructions);
+}
+
+std::unordered_map<int, std::uint64_t>
+  line_samples(const Sampling_Profiler &profiler, const Loaded_Files &files, const std::filesystem::path &filename)
+{
+  std::unordered_map<int, std::uint64_t> result;
+  for (const auto &[offset, count] : profiler.hits) {
+    if (const auto location = files.location_data.find(offset); location != files.location_data.end() && location->second.filename == filename) {
+      result[location->second.line_number] += count;
+    }
+  }
+  return result;
+}
+
+
+std::vector<std::uint64_t> Call_Graph_Profiler::inclusive() const
+{
+  std::vector<std::uint64_t> result(nodes.size());
+  for (auto node = nodes.size(); node > 0; --node) {
+    result[node - 1] += nodes[node - 1].self;
+    if (node > 1) { result[nodes[node - 1].parent] += result[node - 1]; }
+  }
+  return result;
+}
+
+std::map<std::uint32_t, std::string> function_symbols(const Loaded_Files &files)
+{
+  std::map<std::uint32_t, std::string> symbols;
+  if (!files.good_binary || !files.binary_file) { return symbols; }
+
+  const auto file_header = elf::File_Header{ { files.binary_file->data(), files.binary_file->size() } };
+  if (!file_header.is_elf_file()) { return symbols; }
+
+  // the whole file is loaded at USER_RAM_START, see load_unknown
+  const auto string_table = file_header.string_table();
+  for (const auto &header : file_header.section_headers()) {
+    for (const auto &symbol : header.symbol_table_entries()) {
+      const auto section = symbol.section_header_table_index();
+      if (symbol.type() != elf::Symbol_Table_Entry::Type::STT_FUNC || section == 0 || section >= file_header.section_header_num_entries()) {
+        continue;
+      }
+
+      const auto offset = static_cast<std::uint32_t>(file_header.section_header(section).offset() + symbol.value());
+      symbols[offset + static_cast<std::uint32_t>(system::Memory_Map::USER_RAM_START)] = demangle(symbol.name(string_table));
+    }
+  }
+
+  return symbols;
+}
+
+void write_folded_stacks(std::ostream &os, const Call_Graph_Profiler &profiler, const std::map<std::uint32_t, std::string> &symbols)
+{
+  // stacks of the parents are always complete before their children are visited
+  std::vector<std::string> stacks(profiler.nodes.size());
+  for (std::size_t node = 0; node < profiler.nodes.size(); ++node) {
+    const auto &current = profiler.nodes[node];
+    const auto name     = function_name(symbols, current.function);
+    stacks[node]        = node == 0 ? name : stacks[current.parent] + ';' + name;
+    if (current.self != 0) { os << stacks[node] << ' ' << std::dec << current.self << '\n'; }
+  }
+}
+
+void write_call_tree(std::ostream &os, const Call_Graph_Profiler &profiler, const std::map<std::uint32_t, std::string> &symbols)
+{
+  if (profiler.nodes.empty()) { return; }
+
+  const auto inclusive = profiler.inclusive();
+  const auto total     = static_cast<double>(inclusive.front());
+
+  os << "  inclusive%   inclusive   exclusive  function\n";
+
+  std::vector<std::pair<std::uint32_t, std::size_t>> pending{ { 0, 0 } };
+  while (!pending.empty()) {
+    const auto [node, depth] = pending.back();
+    pending.pop_back();
+
+    os << std::fixed << std::setprecision(2) << std::setw(11) << 100.0 * static_cast<double>(inclusive[node]) / total << '%' << std::dec
+       << std::setw(12) << inclusive[node] << std::setw(12) << profiler.nodes[node].self << "  " << std::string(depth * 2, ' ')
+       << function_name(symbols, profiler.nodes[node].function) << '\n';
+
+    auto children = profiler.nodes[node].children;
+    std::sort(children.begin(), children.end(), [&inclusive](const auto lhs, const auto rhs) { return inclusive[lhs] < inclusive[rhs]; });
+    for (const auto child : children) { pending.emplace_back(child, depth + 1); }
+  }
+}
+
+void write_branch_csv(std::ostream &os, const Branch_Profiler &profiler, const Loaded_Files &files)
+{
+  os << "line,address,disassembly,passed,failed,taken_percent,flips,targets\n";
+  for (const auto &row : branch_rows(profiler, files)) {
+    // disassembly contains commas, quote it
+    std::string disassembly;
+    for (const auto character : row.disassembly) { disassembly += character == '"' ? std::string{ "\"\"" } : std::string{ character }; }
+
+    os << row.line << ',' << address_of(row.offset) << ",\"" << disassembly << "\"," << std::dec << row.branch->passed << ',' << row.branch->failed
+       << ',' << std::fixed << std::setprecision(2) << taken_percent(*row.branch) << ',' << row.branch->flips << ',';
+
+    bool first = true;
+    for (const auto &[target, count] : row.branch->targets) {
+      os << (first ? "" : " ") << "0x" << std::hex << std::setw(8) << std::setfill('0') << target << ':' << std::dec << count;
+      first = false;
+    }
+    os << '\n';
+  }
+}
+
+void write_branch_json(std::ostream &os, const Branch_Profiler &profiler, const Loaded_Files &files)
+{
+  os << '{';
+
+  const auto rows = branch_rows(profiler, files);
+  for (std::size_t idx = 0; idx < rows.size(); ++idx) {
+    const auto &row       = rows[idx];
+    const bool first_line = idx == 0 || rows[idx - 1].line != row.line;
+    const bool last_line  = idx + 1 == rows.size() || rows[idx + 1].line != row.line;
+
+    if (first_line) { os << (idx == 0 ? "\n" : ",\n") << json_string(row.line) << ":["; }
+    os << (first_line ? "\n" : ",\n") << "{\"address\":\"" << address_of(row.offset) << "\",\"disassembly\":" << json_string(row.disassembly)
+       << ",\"passed\":" << std::dec << row.branch->passed << ",\"failed\":" << row.branch->failed << ",\"flips\":" << row.branch->flips
+       << ",\"targets\":{";
+
+    bool first = true;
+    for (const auto &[target, count] : row.branch->targets) {
+      os << (first ? "\"0x" : ",\"0x") << std::hex << std::setw(8) << std::setfill('0') << target << "\":" << std::dec << count;
+      first = false;
+    }
+    os << "}}";
+
+    if (last_line) { os << "\n]"; }
+  }
+
+  os << "\n}\n";
+}
+
+}  // namespace cpp_box::profiler
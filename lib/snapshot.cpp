@@ -0,0 +1,307 @@
+#include "../include/cpp_box/snapshot.hpp"
+#include "../include/cpp_box/memory_map.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+
+#if defined(_WIN32)
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace cpp_box::snapshot {
+
+namespace {
+  constexpr std::size_t header_size     = 48;
+  constexpr std::size_t page_entry_size = 16;
+
+  // zero bytes ending a literal run, shorter runs of zeros are cheaper as literals than as a new run header
+  constexpr std::size_t min_zero_run = 4;
+  constexpr std::size_t max_run      = std::numeric_limits<std::uint16_t>::max();
+
+  [[nodiscard]] std::uint64_t hash(const Image image) noexcept
+  {
+    std::uint64_t result = 0xcbf2'9ce4'8422'2325;
+    for (const auto byte : image) {
+      result ^= byte;
+      result *= 0x100'0000'01b3;
+    }
+    return result;
+  }
+
+  // the byte at loc of RAM before the machine ran
+  struct Base
+  {
+    Image image;
+    std::size_t image_start{ static_cast<std::size_t>(system::Memory_Map::USER_RAM_START) };
+
+    [[nodiscard]] std::uint8_t operator[](const std::size_t loc) const noexcept
+    {
+      return loc >= image_start && loc - image_start < image.size() ? image[loc - image_start] : 0;
+    }
+
+    // RAM as it is before the machine runs
+    void fill(std::uint8_t *ram, const std::size_t ram_size) const noexcept
+    {
+      std::memset(ram, 0, ram_size);
+      if (image_start < ram_size) { std::memcpy(ram + image_start, image.data(), std::min(image.size(), ram_size - image_start)); }  // NOLINT
+    }
+  };
+
+  struct Output
+  {
+    std::vector<std::uint8_t> bytes;
+
+    void put(const std::uint64_t value, const std::size_t size)
+    {
+      for (std::size_t byte = 0; byte < size; ++byte) { bytes.push_back(static_cast<std::uint8_t>(value >> (byte * 8))); }
+    }
+
+    void put_words(const std::vector<std::vector<std::uint32_t>> &state)
+    {
+      for (const auto &words : state) {
+        put(words.size(), 4);
+        for (const auto word : words) { put(word, 4); }
+      }
+    }
+  };
+
+  // bounds checked reads of the mapped file
+  struct Input
+  {
+    const std::uint8_t *data;
+    std::size_t size;
+    std::size_t position{ 0 };
+
+    [[nodiscard]] std::uint64_t get(const std::size_t value_size)
+    {
+      if (value_size > size - position) { throw std::runtime_error("the save state is truncated"); }
+      std::uint64_t value = 0;
+      for (std::size_t byte = 0; byte < value_size; ++byte) { value |= std::uint64_t{ data[position++] } << (byte * 8); }  // NOLINT
+      return value;
+    }
+
+    [[nodiscard]] std::vector<std::vector<std::uint32_t>> get_words(const std::uint64_t count)
+    {
+      std::vector<std::vector<std::uint32_t>> state;
+      for (std::uint64_t idx = 0; idx < count; ++idx) {
+        const auto word_count = get(4);
+        if (word_count > (size - position) / 4) { throw std::runtime_error("the save state is truncated"); }
+
+        auto &words = state.emplace_back();
+        for (std::uint64_t word = 0; word < word_count; ++word) { words.push_back(static_cast<std::uint32_t>(get(4))); }
+      }
+      return state;
+    }
+  };
+
+  // the page XORed with the base, empty if it is equal to the base
+  [[nodiscard]] std::vector<std::uint8_t> encode_page(const std::uint8_t *page, const std::size_t begin, const std::size_t length, const Base &base)
+  {
+    std::vector<std::uint8_t> delta(length);
+    bool changed = false;
+    for (std::size_t idx = 0; idx < length; ++idx) {
+      delta[idx] = static_cast<std::uint8_t>(page[idx] ^ base[begin + idx]);  // NOLINT
+      changed    = changed || delta[idx] != 0;
+    }
+    if (!changed) { return {}; }
+
+    const auto zeros_at = [&](const std::size_t loc) {
+      std::size_t count = 0;
+      while (loc + count < length && delta[loc + count] == 0 && count < max_run) { ++count; }
+      return count;
+    };
+
+    std::vector<std::uint8_t> encoded;
+    for (std::size_t loc = 0; loc < length;) {
+      const auto zeros = zeros_at(loc);
+      loc += zeros;
+
+      auto literals = std::size_t{ 0 };
+      while (loc + literals < length && literals < max_run && (delta[loc + literals] != 0 || zeros_at(loc + literals) < min_zero_run)) {
+        ++literals;
+      }
+
+      for (const auto value : { zeros, literals }) {
+        encoded.push_back(static_cast<std::uint8_t>(value));
+        encoded.push_back(static_cast<std::uint8_t>(value >> 8));
+      }
+      encoded.insert(encoded.end(), delta.begin() + static_cast<std::ptrdiff_t>(loc), delta.begin() + static_cast<std::ptrdiff_t>(loc + literals));
+      loc += literals;
+    }
+    return encoded;
+  }
+
+  void decode_page(std::uint8_t *page, const std::size_t length, const std::uint8_t *encoded, const std::size_t encoded_size)
+  {
+    std::size_t loc = 0;
+    for (std::size_t pos = 0; pos < encoded_size;) {
+      if (encoded_size - pos < 4) { throw std::runtime_error("the save state has a corrupt page"); }
+      const auto zeros    = std::size_t{ encoded[pos] } | (std::size_t{ encoded[pos + 1] } << 8);      // NOLINT
+      const auto literals = std::size_t{ encoded[pos + 2] } | (std::size_t{ encoded[pos + 3] } << 8);  // NOLINT
+      pos += 4;
+
+      loc += zeros;
+      if (literals > length || loc > length - literals || literals > encoded_size - pos) {
+        throw std::runtime_error("the save state has a corrupt page");
+      }
+      for (std::size_t idx = 0; idx < literals; ++idx) { page[loc + idx] ^= encoded[pos + idx]; }  // NOLINT
+      loc += literals;
+      pos += literals;
+    }
+  }
+
+  // the whole file, mapped read only where the platform supports it
+  struct Mapped_File
+  {
+    explicit Mapped_File(const std::filesystem::path &path)
+    {
+#if defined(_WIN32)
+      std::ifstream file{ path, std::ios::binary };
+      if (!file) { throw std::runtime_error("unable to open save state " + path.string()); }
+      contents.assign(std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{});
+      data = reinterpret_cast<const std::uint8_t *>(contents.data());  // NOLINT
+      size = contents.size();
+#else
+      const auto fd = ::open(path.c_str(), O_RDONLY);  // NOLINT
+      if (fd < 0) { throw std::runtime_error("unable to open save state " + path.string()); }
+
+      struct stat info
+      {
+      };
+      if (::fstat(fd, &info) != 0 || info.st_size <= 0) {
+        ::close(fd);
+        throw std::runtime_error("unable to read save state " + path.string());
+      }
+
+      size          = static_cast<std::size_t>(info.st_size);
+      auto *mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ::close(fd);
+      if (mapping == MAP_FAILED) { throw std::runtime_error("unable to map save state " + path.string()); }  // NOLINT
+      data = static_cast<const std::uint8_t *>(mapping);
+#endif
+    }
+
+    ~Mapped_File()
+    {
+#if !defined(_WIN32)
+      ::munmap(const_cast<std::uint8_t *>(data), size);  // NOLINT
+#endif
+    }
+
+    Mapped_File(const Mapped_File &) = delete;
+    Mapped_File(Mapped_File &&)      = delete;
+    Mapped_File &operator=(const Mapped_File &) = delete;
+    Mapped_File &operator=(Mapped_File &&) = delete;
+
+    const std::uint8_t *data{ nullptr };
+    std::size_t size{ 0 };
+
+#if defined(_WIN32)
+  private:
+    std::string contents;
+#endif
+  };
+
+  [[nodiscard]] constexpr std::uint64_t core_values() noexcept
+  {
+    Core_State state;
+    std::uint64_t count = 0;
+    visit_fields(state, [&count](const auto & /*value*/) { ++count; });
+    return count;
+  }
+}  // namespace
+
+void write(const std::filesystem::path &path, const State &state, const std::uint8_t *ram, const std::size_t ram_size, const Image image)
+{
+  const Base base{ image };
+
+  std::vector<std::pair<std::uint32_t, std::vector<std::uint8_t>>> pages;
+  for (std::size_t begin = 0; begin < ram_size; begin += page_size) {
+    if (auto encoded = encode_page(ram + begin, begin, std::min<std::size_t>(page_size, ram_size - begin), base); !encoded.empty()) {  // NOLINT
+      pages.emplace_back(static_cast<std::uint32_t>(begin / page_size), std::move(encoded));
+    }
+  }
+
+  Output out;
+  out.bytes.insert(out.bytes.end(), magic.begin(), magic.end());
+  out.put(version, 4);
+  out.put(page_size, 4);
+  out.put(ram_size, 8);
+  out.put(hash(image), 8);
+  out.put(core_values(), 4);
+  out.put(state.devices.size(), 4);
+  out.put(state.coprocessors.size(), 4);
+  out.put(pages.size(), 4);
+
+  visit_fields(state.core, [&out](const auto &value) { out.put(static_cast<std::uint64_t>(value), 8); });
+  out.put_words(state.devices);
+  out.put_words(state.coprocessors);
+
+  auto offset = out.bytes.size() + pages.size() * page_entry_size;
+  for (const auto &[number, encoded] : pages) {
+    out.put(number, 4);
+    out.put(encoded.size(), 4);
+    out.put(offset, 8);
+    offset += encoded.size();
+  }
+
+  std::ofstream file{ path, std::ios::binary };
+  if (!file) { throw std::runtime_error("unable to open save state " + path.string()); }
+  file.write(reinterpret_cast<const char *>(out.bytes.data()), static_cast<std::streamsize>(out.bytes.size()));  // NOLINT
+  for (const auto &page : pages) {
+    file.write(reinterpret_cast<const char *>(page.second.data()), static_cast<std::streamsize>(page.second.size()));  // NOLINT
+  }
+  if (!file) { throw std::runtime_error("writing the save state failed"); }
+}
+
+State read(const std::filesystem::path &path, std::uint8_t *ram, const std::size_t ram_size, const Image image)
+{
+  const Mapped_File file{ path };
+  Input in{ file.data, file.size };
+
+  if (file.size < header_size || !std::equal(magic.begin(), magic.end(), file.data)) {
+    throw std::runtime_error(path.string() + " is not a save state");
+  }
+  in.position = magic.size();
+
+  if (in.get(4) != version || in.get(4) != page_size) { throw std::runtime_error("the save state is of an unsupported version"); }
+  if (in.get(8) != ram_size) { throw std::runtime_error("the save state is of a machine with a different RAM size"); }
+  if (in.get(8) != hash(image)) { throw std::runtime_error("the save state is of a different image"); }
+  if (in.get(4) != core_values()) { throw std::runtime_error("the save state is of an unsupported version"); }
+
+  const auto device_count      = in.get(4);
+  const auto coprocessor_count = in.get(4);
+  const auto page_count        = in.get(4);
+
+  State state;
+  visit_fields(state.core, [&in](auto &value) { value = static_cast<std::remove_reference_t<decltype(value)>>(in.get(8)); });
+  if (state.core.event_count > state.core.events.size()) { throw std::runtime_error("the save state has too many events"); }
+  state.devices      = in.get_words(device_count);
+  state.coprocessors = in.get_words(coprocessor_count);
+
+  const Base base{ image };
+  base.fill(ram, ram_size);
+
+  for (std::uint64_t entry = 0; entry < page_count; ++entry) {
+    const auto begin        = in.get(4) * page_size;
+    const auto encoded_size = in.get(4);
+    const auto offset       = in.get(8);
+    if (begin >= ram_size || offset > file.size || encoded_size > file.size - offset) {
+      throw std::runtime_error("the save state has a corrupt page");
+    }
+
+    decode_page(ram + begin, std::min<std::size_t>(page_size, ram_size - begin), file.data + offset, encoded_size);  // NOLINT
+  }
+
+  return state;
+}
+
+}  // namespace cpp_box::snapshot
@@ -0,0 +1,241 @@
+#include "../include/cpp_box/trace.hpp"
+
+#include <algorithm>
+#include <istream>
+#include <stdexcept>
+
+namespace cpp_box::trace {
+
+namespace {
+  // tag, pc, mask and 16 values fit with room to spare, the accesses of an LDM or STM need more
+  constexpr std::size_t min_chunk_size = 4096;
+
+  [[nodiscard]] constexpr std::int32_t unzigzag(const std::uint32_t value) noexcept
+  {
+    return static_cast<std::int32_t>(value >> 1) ^ -static_cast<std::int32_t>(value & 1);
+  }
+
+  constexpr std::size_t header_size = magic.size() + 8;
+  // the end's u32 keyframe_interval, u32 keyframe count and magic
+  constexpr std::size_t trailer_size = 8 + keyframe_magic.size();
+
+  void put_header_word(std::ostream &os, const std::uint64_t value, const std::size_t size = 4)
+  {
+    for (std::size_t byte = 0; byte < size; ++byte) { os.put(static_cast<char>(value >> (byte * 8))); }
+  }
+}  // namespace
+
+Writer::Writer(const std::filesystem::path &path, const bool memory_accesses, const std::size_t t_chunk_size, const std::size_t t_max_chunks)
+  : recording_accesses{ memory_accesses }
+  , file{ path, std::ios::binary }
+  , chunk_size{ std::max(t_chunk_size, min_chunk_size) }
+  , max_chunks{ std::max(t_max_chunks, std::size_t{ 2 }) }
+{
+  if (!file) { throw std::runtime_error("unable to open trace file " + path.string()); }
+
+  file.write(magic.data(), magic.size());
+  put_header_word(file, version);
+  put_header_word(file, memory_accesses ? static_cast<std::uint32_t>(Flags::MEMORY_ACCESSES) : 0);
+  written = header_size;
+
+  chunk.resize(chunk_size);
+  thread = std::thread{ [this] { write_chunks(); } };
+}
+
+Writer::~Writer() { close(); }
+
+void Writer::submit()
+{
+  std::unique_lock<std::mutex> lock{ mutex };
+  written += used;
+  chunk.resize(used);
+  full.push_back(std::move(chunk));
+  condition.notify_all();
+
+  if (spare.empty() && chunks_allocated < max_chunks) {
+    ++chunks_allocated;
+    chunk = std::vector<std::uint8_t>(chunk_size);
+  } else {
+    condition.wait(lock, [this] { return !spare.empty(); });
+    chunk = std::move(spare.back());
+    spare.pop_back();
+    chunk.resize(chunk_size);
+  }
+
+  used = 0;
+}
+
+void Writer::close()
+{
+  if (closed) { return; }
+
+  {
+    const std::lock_guard<std::mutex> lock{ mutex };
+    if (used != 0) {
+      chunk.resize(used);
+      full.push_back(std::move(chunk));
+    }
+    closing = true;
+  }
+  condition.notify_all();
+
+  thread.join();
+
+  if (complete) {
+    file.put(static_cast<char>(Tag::END));
+    for (const auto offset : keyframes) { put_header_word(file, offset, 8); }
+    put_header_word(file, keyframe_interval);
+    put_header_word(file, keyframes.size());
+    file.write(keyframe_magic.data(), keyframe_magic.size());
+  }
+  file.close();
+  failed = failed || !file;
+  closed = true;
+}
+
+void Writer::write_chunks()
+{
+  std::unique_lock<std::mutex> lock{ mutex };
+  while (true) {
+    condition.wait(lock, [this] { return !full.empty() || closing; });
+    if (full.empty()) { return; }
+
+    auto data = std::move(full.front());
+    full.pop_front();
+
+    lock.unlock();
+    file.write(static_cast<const char *>(static_cast<const void *>(data.data())), static_cast<std::streamsize>(data.size()));
+    lock.lock();
+
+    failed = failed || !file;
+    spare.push_back(std::move(data));
+    condition.notify_all();
+  }
+}
+
+
+Reader::Reader(std::istream &t_is) : is{ t_is }
+{
+  std::array<char, magic.size()> header{};
+  if (!is.read(header.data(), header.size()) || header != magic) { throw std::runtime_error("not a cpp_box trace"); }
+
+  // version 1 is the same without keyframes and end
+  if (const auto file_version = get_word(); file_version != version && file_version != 1) {
+    throw std::runtime_error("unsupported trace version");
+  }
+  flags = get_word();
+}
+
+bool Reader::next(Record &record)
+{
+  auto tag = is.get();
+  while (tag == static_cast<int>(Tag::KEYFRAME)) {
+    previous_pc = get_word();
+    last_access = get_word();
+    for (auto &value : registers) { value = get_word(); }
+    tag = is.get();
+  }
+  if (tag == std::istream::traits_type::eof() || tag == static_cast<int>(Tag::END)) {
+    // the keyframe table follows the end
+    is.setstate(std::ios::eofbit);
+    return false;
+  }
+  ++next_index;
+
+  auto pc = previous_pc + 4;
+  if ((tag & static_cast<int>(Tag::PC_JUMP)) != 0) { pc += static_cast<std::uint32_t>(unzigzag(get_varint())); }
+  record.pc = previous_pc = pc;
+
+  record.changed = 0;
+  if ((tag & static_cast<int>(Tag::REGISTERS)) != 0) {
+    record.changed = static_cast<std::uint16_t>(get_varint());
+    for (std::size_t reg = 0; reg < registers.size(); ++reg) {
+      if ((record.changed & (1u << reg)) != 0) { registers[reg] = get_word(); }
+    }
+  }
+  record.registers = registers;
+
+  record.accesses.clear();
+  if ((tag & static_cast<int>(Tag::ACCESSES)) != 0) {
+    const auto count = get_varint();
+    for (std::uint32_t access = 0; access < count; ++access) {
+      const auto bits = is.get();
+      if (bits == std::istream::traits_type::eof()) { throw std::runtime_error("truncated trace"); }
+      last_access += static_cast<std::uint32_t>(unzigzag(get_varint()));
+      record.accesses.push_back(Access{ last_access, static_cast<std::uint8_t>(1u << ((bits >> 1) & 0b11)), (bits & 1) != 0 });
+    }
+  }
+
+  return true;
+}
+
+std::uint64_t Reader::seek(const std::uint64_t index)
+{
+  const auto resume = is.tellg();
+  const auto at     = [&](const std::streamoff offset) {
+    is.clear();
+    is.seekg(offset);
+  };
+
+  is.clear();
+  is.seekg(0, std::ios::end);
+  const auto size = static_cast<std::uint64_t>(is.tellg());
+  if (!is || size < header_size + 1 + trailer_size) {
+    at(resume);
+    return next_index;
+  }
+
+  at(static_cast<std::streamoff>(size - trailer_size));
+  const auto interval = get_word();
+  const auto count    = get_word();
+  std::array<char, keyframe_magic.size()> trailer_magic{};
+  is.read(trailer_magic.data(), trailer_magic.size());
+  if (trailer_magic != keyframe_magic || interval == 0 || count == 0) {
+    at(resume);
+    return next_index;
+  }
+
+  if (count > (size - header_size - 1 - trailer_size) / 8) { throw std::runtime_error("corrupt trace keyframe table"); }
+  const auto table = size - trailer_size - count * 8;
+
+  const auto keyframe = std::min<std::uint64_t>(index / interval, count - 1);
+  if (keyframe * interval <= next_index && next_index <= index) {
+    at(resume);
+    return next_index;
+  }
+
+  at(static_cast<std::streamoff>(table + keyframe * 8));
+  const auto offset = get_word() | (std::uint64_t{ get_word() } << 32);
+  if (offset < header_size || offset >= table) { throw std::runtime_error("corrupt trace keyframe table"); }
+
+  // next reads the keyframe's state
+  at(static_cast<std::streamoff>(offset));
+  if (is.peek() != static_cast<int>(Tag::KEYFRAME)) { throw std::runtime_error("corrupt trace keyframe table"); }
+  next_index = keyframe * interval;
+  return next_index;
+}
+
+std::uint32_t Reader::get_varint()
+{
+  std::uint32_t value = 0;
+  for (std::uint32_t shift = 0; shift < 35; shift += 7) {
+    const auto byte = is.get();
+    if (byte == std::istream::traits_type::eof()) { throw std::runtime_error("truncated trace"); }
+    value |= static_cast<std::uint32_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) { return value; }
+  }
+  throw std::runtime_error("corrupt trace");
+}
+
+std::uint32_t Reader::get_word()
+{
+  std::uint32_t value = 0;
+  for (std::uint32_t byte = 0; byte < 4; ++byte) {
+    const auto character = is.get();
+    if (character == std::istream::traits_type::eof()) { throw std::runtime_error("truncated trace"); }
+    value |= static_cast<std::uint32_t>(character) << (byte * 8);
+  }
+  return value;
+}
+
+}  // namespace cpp_box::trace
@@ -1,17 +1,34 @@
+#include <chrono>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
 
+#include <clara.hpp>
+
 #include "rang.hpp"
 
 #include "../include/cpp_box/arm.hpp"
+#include "../include/cpp_box/cache.hpp"
 #include "../include/cpp_box/compiler.hpp"
+#include "../include/cpp_box/coprocessor.hpp"
+#include "../include/cpp_box/coverage.hpp"
+#include "../include/cpp_box/devices.hpp"
+#include "../include/cpp_box/lockstep.hpp"
 #include "../include/cpp_box/memory_map.hpp"
+#include "../include/cpp_box/profiler.hpp"
+#include "../include/cpp_box/smp.hpp"
+#include "../include/cpp_box/snapshot.hpp"
+#include "../include/cpp_box/trace.hpp"
 
 template<typename Cont> void dump_rom(const Cont &c)
 {
@@ -52,40 +69,510 @@ template<typename System, typename Registers> void dump_state(const System &sys,
   std::cout << '\n';
 }
 
-int main(const int argc, const char *argv[]) // NOLINT
+template<typename System>
+std::unique_ptr<System>
+  make_system(const cpp_box::Loaded_Files &loaded_files, const std::uint64_t seed, const bool skip_idle_loops, spdlog::logger &logger)
+{
+  auto sys = std::make_unique<System>(loaded_files.image, static_cast<std::uint32_t>(cpp_box::system::Memory_Map::USER_RAM_START));
+  sys->coprocessors.add(cpp_box::system::ACCELERATOR_COPROCESSOR, cpp_box::coprocessor::make_accelerator());
+  sys->skip_idle_loops = skip_idle_loops;
+  if (seed != 0) { sys->mmio_callback.random().reseed(seed); }
+
+  logger.trace("setting up registers");
+  sys->write_word(static_cast<std::uint32_t>(cpp_box::system::Memory_Map::RAM_SIZE), cpp_box::system::TOTAL_RAM);
+  sys->write_half_word(static_cast<std::uint32_t>(cpp_box::system::Memory_Map::SCREEN_WIDTH), 64);
+  sys->write_half_word(static_cast<std::uint32_t>(cpp_box::system::Memory_Map::SCREEN_HEIGHT), 64);
+  sys->write_byte(static_cast<std::uint32_t>(cpp_box::system::Memory_Map::SCREEN_BPP), 32);
+  sys->write_word(static_cast<std::uint32_t>(cpp_box::system::Memory_Map::SCREEN_BUFFER), cpp_box::system::DEFAULT_SCREEN_BUFFER);
+  return sys;
+}
+
+template<typename System> void print_cycles(const System &sys)
+{
+  std::cout << "Total cycles: " << std::dec << sys.cycles() << " (" << sys.idle_cycles << " waiting for interrupts, "
+            << sys.idle_loop.skipped_cycles << " skipped in idle loops)\n";
+
+  if (sys.cycle_model.enabled) {
+    const auto &totals = sys.cycle_model.totals;
+    std::cout << "Estimated ARM7TDMI cycles: " << sys.estimated_cycles() << " (" << totals.sequential << " S, " << totals.non_sequential << " N, "
+              << totals.internal << " I, " << totals.coprocessor << " C, " << totals.wait_states << " wait states, " << totals.stalls
+              << " cache stalls)\n";
+  }
+}
+
+// MIPS count only the instructions executed, not those skipped in idle loops, so that it measures the interpreter
+template<typename System> void print_statistics(std::ostream &os, const std::vector<const System *> &cores, const double seconds, const bool json)
+{
+  std::uint64_t executed = 0;
+  std::uint64_t skipped  = 0;
+  for (const auto *core : cores) {
+    executed += core->instructions - core->idle_loop.skipped_instructions;
+    skipped += core->idle_loop.skipped_instructions;
+  }
+  const auto mips = seconds > 0 ? static_cast<double>(executed) / seconds / 1'000'000 : 0.0;
+
+  if (!json) {
+    os << "Wall clock: " << std::fixed << std::setprecision(3) << seconds << " s, " << std::setprecision(2) << mips << " MIPS, " << skipped
+       << " instructions skipped in idle loops\n";
+    for (std::size_t idx = 0; idx < cores.size(); ++idx) {
+      const auto &stats = cores[idx]->statistics;
+      os << "Core " << idx << " executed by type:";
+      for (std::size_t type = 0; type < stats.executed.size(); ++type) {
+        if (stats.executed[type] == 0) { continue; }
+        os << ' ' << cpp_box::arm::to_string(static_cast<cpp_box::arm::Instruction_Type>(type)) << '=' << stats.executed[type];
+      }
+      os << "\n  condition failed: " << stats.condition_failed << ", i-cache hits: " << stats.i_cache_hits() << ", refills: " << stats.i_cache_refills
+         << "\n  memory reads: " << stats.memory_reads << ", writes: " << stats.memory_writes << ", MMIO accesses: " << stats.mmio_accesses << '\n';
+    }
+    return;
+  }
+
+  os << "{\n  \"seconds\": " << std::setprecision(6) << seconds << ",\n  \"mips\": " << mips << ",\n  \"skipped_instructions\": " << skipped
+     << ",\n  \"cores\": [";
+  for (std::size_t idx = 0; idx < cores.size(); ++idx) {
+    const auto &core  = *cores[idx];
+    const auto &stats = core.statistics;
+    os << (idx == 0 ? "" : ",") << "\n    {\n      \"instructions\": " << core.instructions << ",\n      \"skipped_instructions\": "
+       << core.idle_loop.skipped_instructions << ",\n      \"cycles\": " << core.cycles() << ",\n      \"executed\": {";
+    for (std::size_t type = 0; type < stats.executed.size(); ++type) {
+      const auto name = cpp_box::arm::to_string(static_cast<cpp_box::arm::Instruction_Type>(type));
+      os << (type == 0 ? "" : ", ") << '"' << name << "\": " << stats.executed[type];
+    }
+    os << "},\n      \"condition_failed\": " << stats.condition_failed << ",\n      \"i_cache_hits\": " << stats.i_cache_hits()
+       << ",\n      \"i_cache_refills\": " << stats.i_cache_refills << ",\n      \"memory_reads\": " << stats.memory_reads
+       << ",\n      \"memory_writes\": " << stats.memory_writes << ",\n      \"mmio_accesses\": " << stats.mmio_accesses << "\n    }";
+  }
+  os << "\n  ]\n}\n";
+}
+
+// "begin,end,sequential,non_sequential", numbers may be given in hex with 0x
+std::optional<std::array<std::uint32_t, 4>> parse_wait_states(const std::string &spec)
+{
+  std::array<std::uint32_t, 4> values{};
+  std::istringstream ss{ spec };
+  std::size_t count = 0;
+  for (std::string field; std::getline(ss, field, ',');) {
+    if (count == values.size()) { return std::nullopt; }
+    try {
+      values[count++] = static_cast<std::uint32_t>(std::stoul(field, nullptr, 0));
+    } catch (const std::exception &) {
+      return std::nullopt;
+    }
+  }
+
+  if (count != values.size() || values[1] <= values[0]) { return std::nullopt; }
+  return values;
+}
+
+// "size,associativity,line_size[,wb|wt[,miss_penalty]]"
+std::optional<cpp_box::cache::Cache_Config> parse_cache(const std::string &spec)
 {
-  std::vector<std::string> args{ argv, argv + argc };
+  cpp_box::cache::Cache_Config config;
+  std::istringstream ss{ spec };
+  std::vector<std::string> fields;
+  for (std::string field; std::getline(ss, field, ',');) { fields.push_back(field); }
+  if (fields.size() < 3 || fields.size() > 5) { return std::nullopt; }
+
+  try {
+    config.size          = static_cast<std::uint32_t>(std::stoul(fields[0], nullptr, 0));
+    config.associativity = static_cast<std::uint32_t>(std::stoul(fields[1], nullptr, 0));
+    config.line_size     = static_cast<std::uint32_t>(std::stoul(fields[2], nullptr, 0));
+    if (fields.size() > 4) { config.miss_penalty = static_cast<std::uint32_t>(std::stoul(fields[4], nullptr, 0)); }
+  } catch (const std::exception &) {
+    return std::nullopt;
+  }
+
+  if (fields.size() > 3) {
+    if (fields[3] == "wb") {
+      config.write_policy = cpp_box::cache::Write_Policy::WRITE_BACK;
+    } else if (fields[3] == "wt") {
+      config.write_policy = cpp_box::cache::Write_Policy::WRITE_THROUGH;
+    } else {
+      return std::nullopt;
+    }
+  }
+
+  return config;
+}
+
+template<typename System> void enable_cycle_model(System &sys, const std::vector<std::array<std::uint32_t, 4>> &wait_states)
+{
+  sys.cycle_model.enabled = true;
+  for (const auto &[begin, end, sequential, non_sequential] : wait_states) { sys.cycle_model.add_region({ begin, end, sequential, non_sequential }); }
+}
+
+int main(const int argc, const char *argv[])  // NOLINT
+{
+  using clara::Arg;
+  using clara::Args;
+  using clara::Help;
+  using clara::Opt;
+  bool show_help{ false };
+  std::filesystem::path input_file;
+  std::uint32_t core_count{ 1 };
+  bool round_robin{ false };
+  std::uint64_t seed{ 0 };
+  std::string trace_markers_file;
+  bool trace_guest_time{ false };
+  std::string profile_file;
+  std::uint32_t profile_interval{ cpp_box::profiler::Sampling_Profiler::default_interval };
+  std::string folded_stacks_file;
+  std::string call_tree_file;
+  std::filesystem::path branch_profile_file;
+  std::string coverage_file;
+  bool cycle_model{ false };
+  std::vector<std::string> wait_states_specs;
+  std::string icache_spec;
+  std::string dcache_spec;
+  std::string cache_report_file;
+  std::filesystem::path trace_file;
+  bool trace_memory{ false };
+  std::string stats_format;
+  bool lockstep{ false };
+  std::uint64_t lockstep_interval{ cpp_box::lockstep::Settings{}.block_interval };
+  std::uint64_t lockstep_memory_interval{ cpp_box::lockstep::Settings{}.memory_interval };
+  std::filesystem::path save_state_file;
+  std::filesystem::path load_state_file;
+  std::uint64_t stop_at{ cpp_box::arm::Scheduler::never };
+  bool no_skip_idle_loops{ false };
+
+  auto cli = Help(show_help) | Arg(input_file, "file")("binary or ELF object to run")
+             | Opt(core_count, "count")["--cores"]("number of cores sharing memory, 1 - 8")
+             | Opt(round_robin)["--round-robin"]("run cores in turn on one thread, deterministic")
+             | Opt(seed, "value")["--seed"]("fixed seed for RANDOM_DEVICE, core n uses value + n. 0 seeds randomly")
+             | Opt(trace_markers_file, "file")["--trace-markers"]("write the spans marked by the guest as Chrome trace JSON")
+             | Opt(trace_guest_time)["--trace-guest-time"]("time trace markers in guest instructions instead of host time")
+             | Opt(profile_file, "file")["--profile"]("sample the PC and write a report of the hottest functions, lines and instructions")
+             | Opt(profile_interval, "count")["--profile-interval"]("instructions between two profiler samples")
+             | Opt(folded_stacks_file, "file")["--folded-stacks"]("write the instructions executed per call stack, for flamegraph tools")
+             | Opt(call_tree_file, "file")["--call-tree"]("write the call tree with inclusive and exclusive instruction counts")
+             | Opt(branch_profile_file, "file")["--branch-profile"]("write how often each condition passed and where branches went, "
+                                                                    "as JSON if the file ends in .json, CSV otherwise")
+             | Opt(coverage_file, "file")["--coverage"]("write the source lines executed as lcov tracefile")
+             | Opt(cycle_model)["--cycle-model"]("estimate the cycles an ARM7TDMI would take")
+             | Opt(wait_states_specs, "begin,end,s,n")["--wait-states"]("wait states of sequential and non-sequential accesses to a region, "
+                                                                         "implies --cycle-model, may be repeated")
+             | Opt(icache_spec, "size,ways,line[,wb|wt[,penalty]]")["--icache"]("simulate an instruction cache, implies --cycle-model")
+             | Opt(dcache_spec, "size,ways,line[,wb|wt[,penalty]]")["--dcache"]("simulate a data cache, implies --cycle-model")
+             | Opt(cache_report_file, "file")["--cache-report"]("write the cache hit rates and the source lines with the most misses")
+             | Opt(trace_file, "file")["--trace"]("write a binary trace of every instruction and the registers it changed")
+             | Opt(trace_memory)["--trace-memory"]("add the data accesses of each instruction to the trace")
+             | Opt(stats_format, "text|json")["--stats"]("print what the emulator did: instruction types, i-cache, memory accesses and MIPS")
+             | Opt(lockstep)["--lockstep"]("run the shared memory engine next to the reference and report where they first differ")
+             | Opt(lockstep_interval, "blocks")["--lockstep-interval"]("blocks between two comparisons of the registers")
+             | Opt(lockstep_memory_interval, "count")["--lockstep-memory-interval"]("instructions between two comparisons of the memory, "
+                                                                                   "0 compares it at the end only")
+             | Opt(save_state_file, "file")["--save-state"]("write a save state of the machine when the run stops")
+             | Opt(load_state_file, "file")["--load-state"]("continue from a save state of the same binary instead of starting it")
+             | Opt(stop_at, "cycles")["--stop-at"]("stop once this many cycles have passed, eg to save the state after a warm up")
+             | Opt(no_skip_idle_loops)["--no-skip-idle-loops"]("execute every iteration of loops polling for an event, "
+                                                                "eg for MMIO registers with read side effects");
+
+  const auto result = cli.parse(Args(argc, argv));
+  if (!result) {
+    std::cerr << "Error in command line: " << result.errorMessage() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  if (show_help || input_file.empty()) {
+    std::cout << cli << '\n';
+    return show_help ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  if (!stats_format.empty() && stats_format != "text" && stats_format != "json") {
+    std::cerr << "--stats must be text or json\n";
+    return EXIT_FAILURE;
+  }
+
+  if (core_count < 1 || core_count > cpp_box::system::MAX_CORES) {
+    std::cerr << "Core count must be between 1 and " << cpp_box::system::MAX_CORES << '\n';
+    return EXIT_FAILURE;
+  }
+
+  const bool sampling   = !profile_file.empty();
+  const bool call_graph = !folded_stacks_file.empty() || !call_tree_file.empty();
+  const bool branches   = !branch_profile_file.empty();
+  const bool coverage   = !coverage_file.empty();
+  const bool caches     = !icache_spec.empty() || !dcache_spec.empty();
+  const bool tracing    = !trace_file.empty();
+  const bool states     = !save_state_file.empty() || !load_state_file.empty();
+
+  // Skipping an idle loop leaves what the guest computes alone, but its iterations are not executed one by one.
+  // Traces need a record per instruction and the profilers see each instruction, coverage only needs the loop to
+  // run once. Lockstep skips in both engines, so it checks the skipping as well.
+  const bool skip_idle_loops = !no_skip_idle_loops && !tracing && !sampling && !call_graph && !branches;
+
+  if ((sampling || call_graph || branches || coverage || caches || tracing || lockstep || states) && core_count != 1) {
+    std::cerr << "Profiling, coverage, cache simulation, tracing, lockstep and save states are only supported with a single core\n";
+    return EXIT_FAILURE;
+  }
+
+  if (lockstep && states) {
+    std::cerr << "--lockstep cannot be combined with save states\n";
+    return EXIT_FAILURE;
+  }
+
+  if (trace_memory && (!tracing || caches)) {
+    std::cerr << "--trace-memory requires --trace and cannot be combined with cache simulation\n";
+    return EXIT_FAILURE;
+  }
+
+  std::optional<cpp_box::cache::Cache> instruction_cache;
+  std::optional<cpp_box::cache::Cache> data_cache;
+  for (const auto &[spec, cache] : { std::pair{ &icache_spec, &instruction_cache }, std::pair{ &dcache_spec, &data_cache } }) {
+    if (spec->empty()) { continue; }
+    const auto config = parse_cache(*spec);
+    if (!config) {
+      std::cerr << "Invalid cache '" << *spec << "', expected size,associativity,line_size[,wb|wt[,miss_penalty]]\n";
+      return EXIT_FAILURE;
+    }
+    try {
+      cache->emplace(*config);
+    } catch (const std::invalid_argument &e) {
+      std::cerr << "Invalid cache '" << *spec << "': " << e.what() << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::vector<std::array<std::uint32_t, 4>> wait_states;
+  for (const auto &spec : wait_states_specs) {
+    if (const auto region = parse_wait_states(spec); region) {
+      wait_states.push_back(*region);
+    } else {
+      std::cerr << "Invalid wait states '" << spec << "', expected begin,end,sequential,non_sequential\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (wait_states.size() > cpp_box::arm::System<>::Cycle_Model::max_regions) {
+    std::cerr << "At most " << cpp_box::arm::System<>::Cycle_Model::max_regions << " wait state regions are supported\n";
+    return EXIT_FAILURE;
+  }
+
+  cycle_model = cycle_model || !wait_states.empty() || caches;
+
+  std::optional<cpp_box::trace::Writer> trace_writer;
+  if (tracing) {
+    try {
+      trace_writer.emplace(trace_file, trace_memory);
+    } catch (const std::runtime_error &e) {
+      std::cerr << e.what() << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+
   auto logger = spdlog::stdout_color_mt("console");
 
+  std::cerr << "Attempting to load file: " << input_file << '\n';
 
-  if (args.size() == 2) {
-    std::cerr << "Attempting to load file: " << args[1] << '\n';
+  const auto loaded_files{ cpp_box::load_unknown(input_file, *logger) };
+  const auto entry_point =
+    static_cast<std::uint32_t>(loaded_files.entry_point) + static_cast<std::uint32_t>(cpp_box::system::Memory_Map::USER_RAM_START);
 
-    const auto loaded_files{ cpp_box::load_unknown(std::filesystem::path{ args[1] }, *logger) };
+  const auto write_trace_markers = [&](const std::vector<const cpp_box::devices::Trace_Markers *> &markers) {
+    if (trace_markers_file.empty()) { return; }
+    std::ofstream os{ trace_markers_file };
+    const auto timeline = trace_guest_time ? cpp_box::devices::Timeline::GUEST_INSTRUCTIONS : cpp_box::devices::Timeline::HOST;
+    cpp_box::devices::write_chrome_trace(os, markers, timeline);
+  };
 
-    auto sys = std::make_unique<cpp_box::arm::System<cpp_box::system::TOTAL_RAM, std::vector<std::uint8_t>>>(
-      loaded_files.image, static_cast<std::uint32_t>(cpp_box::system::Memory_Map::USER_RAM_START));
+  const auto timed = [](auto &&run) {
+    const auto start = std::chrono::steady_clock::now();
+    run();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  };
 
+  // the memory observer is a template parameter of System, so the cache simulator only costs when it is asked for
+  const auto run_single_core = [&](auto sys) {
+    if (cycle_model) { enable_cycle_model(*sys, wait_states); }
+
+    if (load_state_file.empty()) {
+      sys->setup_run(entry_point);
+    } else {
+      try {
+        cpp_box::snapshot::load(load_state_file, *sys, loaded_files.image);
+        std::cout << "Loaded state at cycle " << sys->cycles() << " from " << load_state_file << '\n';
+      } catch (const std::runtime_error &e) {
+        std::cerr << e.what() << '\n';
+        return false;
+      }
+    }
 
-    logger->trace("setting up registers");
-    sys->write_word(static_cast<std::uint32_t>(cpp_box::system::Memory_Map::RAM_SIZE), cpp_box::system::TOTAL_RAM);
-    sys->write_half_word(static_cast<std::uint32_t>(cpp_box::system::Memory_Map::SCREEN_WIDTH), 64);
-    sys->write_half_word(static_cast<std::uint32_t>(cpp_box::system::Memory_Map::SCREEN_HEIGHT), 64);
-    sys->write_byte(static_cast<std::uint32_t>(cpp_box::system::Memory_Map::SCREEN_BPP), 32);
-    sys->write_word(static_cast<std::uint32_t>(cpp_box::system::Memory_Map::SCREEN_BUFFER), cpp_box::system::DEFAULT_SCREEN_BUFFER);
     //dump_rom(RAM);
 
-//    auto last_registers = sys->registers;
-    int opcount         = 0;
-    const auto tracer =
-      [&opcount]([[maybe_unused]] const auto & /*t_sys*/, [[maybe_unused]] const auto /*t_pc*/, [[maybe_unused]] const auto /*t_ins*/) { ++opcount; };
+    //    auto last_registers = sys->registers;
+    double seconds = 0;
+
+    //    cpp_box::utility::runtime_assert(sys->SP() == cpp_box::system::STACK_START);
+    if constexpr (std::is_same_v<decltype(sys->memory_observer), cpp_box::trace::Access_Observer>) {
+      sys->memory_observer.writer = &*trace_writer;
+    }
+
+    if (!sampling && !call_graph && !branches && !coverage && !tracing) {
+      seconds = timed([&] { sys->run_until(stop_at); });
+    } else {
+      cpp_box::profiler::Sampling_Profiler profiler{ profile_interval };
+      cpp_box::profiler::Call_Graph_Profiler call_graph_profiler;
+      cpp_box::profiler::Branch_Profiler branch_profiler;
+      auto coverage_map = cpp_box::coverage::make_coverage_map(loaded_files);
+      seconds = timed([&] {
+        sys->run_until(stop_at, [&](const auto &t_sys, const auto t_pc, const auto t_ins) {
+          if (sampling) { profiler(t_sys, t_pc, t_ins); }
+          if (call_graph) { call_graph_profiler(t_sys, t_pc, t_ins); }
+          if (branches) { branch_profiler(t_sys, t_pc, t_ins); }
+          if (coverage) { coverage_map(t_sys, t_pc, t_ins); }
+          if (tracing) { (*trace_writer)(t_sys, t_pc, t_ins); }
+        });
+      });
+
+      if (tracing) {
+        try {
+          trace_writer->finish(*sys);
+          std::cout << "Trace: " << trace_writer->records << " instructions written to " << trace_file << '\n';
+        } catch (const std::runtime_error &e) {
+          std::cerr << e.what() << '\n';
+        }
+      }
+
+      if (coverage) {
+        std::cout << "Coverage: " << coverage_map.executed_words() << " of " << coverage_map.words << " code words executed\n";
+        std::ofstream os{ coverage_file };
+        cpp_box::coverage::write_lcov(os, coverage_map, loaded_files, input_file.stem().string());
+      }
+
+      if (sampling) {
+        std::ofstream os{ profile_file };
+        cpp_box::profiler::write_report(os, cpp_box::profiler::summarize(profiler, loaded_files));
+      }
+
+      if (branches) {
+        std::ofstream os{ branch_profile_file };
+        if (branch_profile_file.extension() == ".json") {
+          cpp_box::profiler::write_branch_json(os, branch_profiler, loaded_files);
+        } else {
+          cpp_box::profiler::write_branch_csv(os, branch_profiler, loaded_files);
+        }
+      }
 
-//    cpp_box::utility::runtime_assert(sys->SP() == cpp_box::system::STACK_START);
-    sys->run(static_cast<std::uint32_t>(loaded_files.entry_point) + static_cast<std::uint32_t>(cpp_box::system::Memory_Map::USER_RAM_START), tracer);
+      const auto symbols = cpp_box::profiler::function_symbols(loaded_files);
+      if (!folded_stacks_file.empty()) {
+        std::ofstream os{ folded_stacks_file };
+        cpp_box::profiler::write_folded_stacks(os, call_graph_profiler, symbols);
+      }
+      if (!call_tree_file.empty()) {
+        std::ofstream os{ call_tree_file };
+        cpp_box::profiler::write_call_tree(os, call_graph_profiler, symbols);
+      }
+    }
+
+    if (!save_state_file.empty()) {
+      try {
+        cpp_box::snapshot::save(save_state_file, *sys, loaded_files.image);
+        std::cout << "Saved state at cycle " << sys->cycles() << " to " << save_state_file << '\n';
+      } catch (const std::runtime_error &e) {
+        std::cerr << e.what() << '\n';
+        return false;
+      }
+    }
 
-    std::cout << "Total instructions executed: " << opcount << '\n';
+    std::cout << "Total instructions executed: " << sys->instructions << '\n';
+    print_cycles(*sys);
+
+    write_trace_markers({ &sys->mmio_callback.trace_markers() });
+
+    if constexpr (std::is_same_v<decltype(sys->memory_observer), cpp_box::cache::Cache_Simulator>) {
+      if (!cache_report_file.empty()) {
+        std::ofstream os{ cache_report_file };
+        cpp_box::cache::write_report(os, sys->memory_observer, loaded_files);
+      }
+    }
+
+    if (!stats_format.empty()) { print_statistics(std::cout, std::vector{ &std::as_const(*sys) }, seconds, stats_format == "json"); }
 
     //dump_state(sys, last_registers);
-    // if ((++opcount) % 1000 == 0) { std::cout << opcount << '\n'; }
+    return true;
+  };
+
+  if (lockstep) {
+    // both engines have to see the same random numbers
+    const auto lockstep_seed = seed != 0 ? seed : 1;
+    auto reference           = make_system<
+      cpp_box::arm::System<cpp_box::system::TOTAL_RAM, std::vector<std::uint8_t>, cpp_box::devices::Devices, cpp_box::coprocessor::Registry>>(
+      loaded_files, lockstep_seed, skip_idle_loops, *logger);
+    auto candidate = make_system<
+      cpp_box::arm::System<cpp_box::system::TOTAL_RAM, cpp_box::smp::Shared_Memory, cpp_box::devices::Devices, cpp_box::coprocessor::Registry>>(
+      loaded_files, lockstep_seed, skip_idle_loops, *logger);
+
+    cpp_box::lockstep::Settings settings;
+    settings.block_interval  = lockstep_interval;
+    settings.memory_interval = lockstep_memory_interval;
+
+    const auto divergence = cpp_box::lockstep::run(*reference, *candidate, entry_point, settings);
+    if (divergence) {
+      cpp_box::lockstep::write_divergence(std::cout, divergence, loaded_files);
+      return EXIT_FAILURE;
+    }
+
+    std::cout << "Lockstep: no divergence in " << reference->instructions << " instructions\n";
+  } else if (core_count == 1) {
+    bool succeeded = false;
+    if (trace_memory) {
+      succeeded = run_single_core(make_system<cpp_box::arm::System<cpp_box::system::TOTAL_RAM,
+                                                                   std::vector<std::uint8_t>,
+                                                                   cpp_box::devices::Devices,
+                                                                   cpp_box::coprocessor::Registry,
+                                                                   cpp_box::trace::Access_Observer>>(loaded_files, seed, skip_idle_loops, *logger));
+    } else if (!caches) {
+      succeeded = run_single_core(make_system<
+        cpp_box::arm::System<cpp_box::system::TOTAL_RAM, std::vector<std::uint8_t>, cpp_box::devices::Devices, cpp_box::coprocessor::Registry>>(
+        loaded_files, seed, skip_idle_loops, *logger));
+    } else {
+      auto sys = make_system<cpp_box::arm::System<cpp_box::system::TOTAL_RAM,
+                                                  std::vector<std::uint8_t>,
+                                                  cpp_box::devices::Devices,
+                                                  cpp_box::coprocessor::Registry,
+                                                  cpp_box::cache::Cache_Simulator>>(loaded_files, seed, skip_idle_loops, *logger);
+      sys->memory_observer.instruction_cache = std::move(instruction_cache);
+      sys->memory_observer.data_cache        = std::move(data_cache);
+      succeeded = run_single_core(std::move(sys));
+    }
+    if (!succeeded) { return EXIT_FAILURE; }
+  } else {
+    using System =
+      cpp_box::arm::System<cpp_box::system::TOTAL_RAM, cpp_box::smp::Shared_Memory, cpp_box::devices::Devices, cpp_box::coprocessor::Registry>;
+
+    const auto configure = [seed, cycle_model, skip_idle_loops, &wait_states](System &core, const std::uint32_t id) {
+      core.coprocessors.add(cpp_box::system::ACCELERATOR_COPROCESSOR, cpp_box::coprocessor::make_accelerator());
+      core.skip_idle_loops = skip_idle_loops;
+      if (seed != 0) { core.mmio_callback.random().reseed(seed + id); }
+      if (cycle_model) { enable_cycle_model(core, wait_states); }
+    };
+
+    auto boot_core = make_system<System>(loaded_files, seed, skip_idle_loops, *logger);
+    if (cycle_model) { enable_cycle_model(*boot_core, wait_states); }
+    cpp_box::smp::Machine<System> machine{ std::move(boot_core), core_count, configure };
+
+    const auto seconds = timed([&] {
+      if (round_robin) {
+        machine.run_round_robin(entry_point);
+      } else {
+        machine.run_threaded(entry_point);
+      }
+    });
+
+    for (std::size_t core = 0; core < machine.cores.size(); ++core) {
+      std::cout << "Core " << std::dec << core << ": " << machine.cores[core]->instructions << " instructions executed\n";
+      print_cycles(*machine.cores[core]);
+    }
+
+    std::vector<const cpp_box::devices::Trace_Markers *> markers;
+    for (const auto &core : machine.cores) { markers.push_back(&core->mmio_callback.trace_markers()); }
+    write_trace_markers(markers);
+
+    if (!stats_format.empty()) {
+      std::vector<const System *> cores;
+      for (const auto &core : machine.cores) { cores.push_back(core.get()); }
+      print_statistics(std::cout, cores, seconds, stats_format == "json");
+    }
   }
 }
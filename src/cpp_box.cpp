@@ -1,10 +1,16 @@
 #include "../include/cpp_box/arm.hpp"
 #include "../include/cpp_box/compiler.hpp"
+#include "../include/cpp_box/coprocessor.hpp"
+#include "../include/cpp_box/devices.hpp"
 #include "../include/cpp_box/elf_reader.hpp"
+#include "../include/cpp_box/heatmap.hpp"
 #include "../include/cpp_box/memory_map.hpp"
+#include "../include/cpp_box/profiler.hpp"
+#include "../include/cpp_box/snapshot.hpp"
 #include "../include/cpp_box/state_machine.hpp"
 #include "../include/cpp_box/utility.hpp"
 
+#include <array>
 #include <cmath>
 #include <filesystem>
 #include <fstream>
@@ -34,37 +40,6 @@
 #include <spdlog/spdlog.h>
 
 
-struct MMIO_Devices
-{
-  struct Random_Generator
-  {
-    std::uniform_int_distribution<std::uint32_t> random_word;
-
-    std::random_device r;
-    std::default_random_engine generator{ r() };
-  };
-
-  std::unique_ptr<Random_Generator> generator = std::make_unique<Random_Generator>();
-
-  [[nodiscard]] constexpr bool is_mmio_range(const std::uint32_t loc) const noexcept
-  {
-    return loc == static_cast<std::uint32_t>(cpp_box::system::Memory_Map::RANDOM_DEVICE);
-  }
-
-  [[nodiscard]] std::uint32_t read_word([[maybe_unused]] const std::uint32_t loc) const noexcept
-  {
-    return generator->random_word(generator->generator);
-  }
-  [[nodiscard]] std::uint16_t read_half_word([[maybe_unused]] const std::uint32_t loc) const noexcept
-  {
-    return static_cast<std::uint16_t>(generator->random_word(generator->generator));
-  }
-  [[nodiscard]] std::uint8_t read_byte([[maybe_unused]] const std::uint32_t loc) const noexcept
-  {
-    return static_cast<std::uint8_t>(generator->random_word(generator->generator));
-  }
-};
-
 struct Box
 {
 
@@ -73,6 +48,8 @@ struct Box
     bool reset_pressed{ false };
     bool step_pressed{ false };
     bool source_changed{ false };
+    bool save_state_pressed{ false };
+    bool load_state_pressed{ false };
   };
 
   struct Goal;
@@ -106,10 +83,18 @@ struct Box
 
 
     cpp_box::Loaded_Files loaded_files;
+    std::filesystem::path state_file;  // next to the initial file
     Timer static_timer{ 0.5f };
 
     bool build_good() const noexcept { return loaded_files.good_binary; }
-    std::unique_ptr<cpp_box::arm::System<cpp_box::system::TOTAL_RAM, std::vector<std::uint8_t>, MMIO_Devices>> sys;
+    using System = cpp_box::arm::System<cpp_box::system::TOTAL_RAM,
+                                        std::vector<std::uint8_t>,
+                                        cpp_box::devices::Devices,
+                                        cpp_box::coprocessor::Registry,
+                                        cpp_box::heatmap::Memory_Heatmap>;
+    std::unique_ptr<System> sys;
+    cpp_box::profiler::Sampling_Profiler profiler;
+    std::vector<cpp_box::heatmap::Data_Symbol> data_symbols;
     std::vector<Goal> goals;
     std::size_t current_goal{ 0 };
 
@@ -166,8 +151,9 @@ struct Box
     void reset()
     {
       m_logger.trace("reset()");
-      sys =
-        std::make_unique<decltype(sys)::element_type>(loaded_files.image, static_cast<std::uint32_t>(cpp_box::system::Memory_Map::USER_RAM_START));
+      sys = make_system(loaded_files);
+      profiler.reset();
+      data_symbols = cpp_box::heatmap::data_symbols(loaded_files);
 
       sys->setup_run(static_cast<std::uint32_t>(loaded_files.entry_point) + static_cast<std::uint32_t>(cpp_box::system::Memory_Map::USER_RAM_START));
       cpp_box::utility::runtime_assert(sys->SP() == cpp_box::system::STACK_START);
@@ -181,6 +167,39 @@ struct Box
 
     void reset_static_timer() { static_timer.reset(); }
 
+    void save_state()
+    {
+      try {
+        cpp_box::snapshot::save(state_file, *sys, loaded_files.image);
+        m_logger.info("Saved state at cycle {} to {}", sys->cycles(), state_file.string());
+      } catch (const std::runtime_error &e) {
+        m_logger.error("Unable to save state: {}", e.what());
+      }
+    }
+
+    // a save state of another build of the program cannot be loaded, the program is reset instead
+    void load_state()
+    {
+      reset();
+      try {
+        cpp_box::snapshot::load(state_file, *sys, loaded_files.image);
+        m_logger.info("Loaded state at cycle {} from {}", sys->cycles(), state_file.string());
+      } catch (const std::runtime_error &e) {
+        m_logger.error("Unable to load state: {}", e.what());
+        reset();
+      }
+    }
+
+    static std::unique_ptr<System> make_system(const cpp_box::Loaded_Files &files)
+    {
+      auto system = std::make_unique<System>(files.image, static_cast<std::uint32_t>(cpp_box::system::Memory_Map::USER_RAM_START));
+      system->coprocessors.add(cpp_box::system::ACCELERATOR_COPROCESSOR, cpp_box::coprocessor::make_accelerator());
+      system->cycle_model.enabled = true;
+      const auto image_start      = static_cast<std::uint32_t>(cpp_box::system::Memory_Map::USER_RAM_START);
+      system->memory_observer.track_words(image_start, image_start + static_cast<std::uint32_t>(files.image.size()));
+      return system;
+    }
+
     void rescale_display(const float new_scale_factor, const float new_sprite_scale_factor)
     {
       if (scale_factor != new_scale_factor || sprite_scale_factor != new_sprite_scale_factor) {
@@ -194,8 +213,8 @@ struct Box
     Status(spdlog::logger &logger, const std::filesystem::path &path, std::vector<Goal> t_goals)
       : m_logger{ logger }
       , loaded_files{ cpp_box::load_unknown(path, m_logger) }
-      , sys{ std::make_unique<decltype(sys)::element_type>(loaded_files.image,
-                                                           static_cast<std::uint32_t>(cpp_box::system::Memory_Map::USER_RAM_START)) }
+      , state_file{ std::filesystem::path{ path.empty() ? "cpp_box" : path }.concat(".state") }
+      , sys{ make_system(loaded_files) }
       , goals{ std::move(t_goals) }
     {
       m_logger.trace("Creating Status Object");
@@ -292,12 +311,24 @@ struct Box
       ImGui::SameLine();
       inputs.reset_pressed = ImGui::Button("Reset");
 
+      if (status.build_good()) {
+        inputs.save_state_pressed = ImGui::Button("Save State");
+        ImGui::SameLine();
+        inputs.load_state_pressed = ImGui::Button("Load State");
+      }
+
       auto scale_factor        = status.scale_factor;
       auto sprite_scale_factor = status.sprite_scale_factor;
       ImGui::InputFloat("Zoom", &scale_factor, 0.5f, 0.0f, 1);
       ImGui::InputFloat("Output Zoom", &sprite_scale_factor, 0.5f, 0.0f, 1);
       const auto elapsedSeconds = status.framerateClock.restart().asSeconds();
       text(true, "{:2.2f} FPS ~{:2.2f} Mhz", 1 / elapsedSeconds, status.opsPerFrame / elapsedSeconds / 1000000);
+      text(true, "{} cycles, {} idle, {} in idle loops", status.sys->cycles(), status.sys->idle_cycles, status.sys->idle_loop.skipped_cycles);
+      const auto instructions = std::max(status.sys->instructions, std::uint64_t{ 1 });
+      text(true,
+           "~{} ARM7TDMI cycles, {:2.2f} per instruction",
+           status.sys->estimated_cycles(),
+           static_cast<double>(status.sys->estimated_cycles()) / static_cast<double>(instructions));
 
       status.rescale_display(scale_factor, sprite_scale_factor);
     }
@@ -366,6 +397,11 @@ struct Box
         const auto pc              = status.sys->PC() - 4;
         const auto object_loc      = pc - static_cast<uint32_t>(cpp_box::system::Memory_Map::USER_RAM_START);
         const auto current_linenum = status.loaded_files.location_data[object_loc].line_number;
+        // lines of the file that main() is defined in, annotated with the share of profiler samples
+        const auto main_location = status.loaded_files.location_data.find(static_cast<std::uint32_t>(status.loaded_files.entry_point));
+        const auto line_samples  = main_location == status.loaded_files.location_data.end()
+                                    ? std::unordered_map<int, std::uint64_t>{}
+                                    : cpp_box::profiler::line_samples(status.profiler, status.loaded_files, main_location->second.filename);
         ImGui::BeginChild("Active Source", { ImGui::GetContentRegionAvailWidth(), 300 });
         std::size_t endl  = 0;
         std::size_t begin = 0;
@@ -374,7 +410,12 @@ struct Box
           begin                   = std::exchange(endl, status.loaded_files.src.find('\n', endl));
           const auto line         = status.loaded_files.src.substr(begin, endl - begin);
           const auto current_line = linenum == current_linenum;
-          text(current_line, "{:4}: {}", linenum, line);
+          if (const auto samples = line_samples.find(linenum); samples != line_samples.end()) {
+            const auto percent = 100.0 * static_cast<double>(samples->second) / static_cast<double>(status.profiler.samples);
+            text(current_line, "{:5.1f}% {:4}: {}", percent, linenum, line);
+          } else {
+            text(current_line, "       {:4}: {}", linenum, line);
+          }
           if (current_line) { ImGui::SetScrollHere(); }
           if (endl != std::string::npos) { ++endl; }
           ++linenum;
@@ -385,6 +426,100 @@ struct Box
     ImGui::End();
 
 
+    ImGui::Begin("Memory Heatmap", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+    {
+      auto &heatmap = status.sys->memory_observer;
+      ImGui::Checkbox("Record", &heatmap.enabled);
+      ImGui::SameLine();
+      if (ImGui::Button("Clear")) { heatmap.reset(); }
+
+      struct Region
+      {
+        const char *name;
+        std::uint32_t begin;
+        std::uint32_t end;
+        ImU32 color;
+      };
+
+      const auto screen_begin = status.sys->read_word(static_cast<std::uint32_t>(cpp_box::system::Memory_Map::SCREEN_BUFFER));
+      const auto screen_size  = std::uint32_t{ status.sys->read_half_word(static_cast<std::uint32_t>(cpp_box::system::Memory_Map::SCREEN_WIDTH)) }
+                               * status.sys->read_half_word(static_cast<std::uint32_t>(cpp_box::system::Memory_Map::SCREEN_HEIGHT)) * 4;
+      const auto user_begin   = static_cast<std::uint32_t>(cpp_box::system::Memory_Map::USER_RAM_START);
+      const std::array<Region, 4> regions{
+        Region{ "registers", 0, user_begin, IM_COL32(160, 160, 160, 255) },
+        Region{ "user RAM", user_begin, user_begin + static_cast<std::uint32_t>(status.loaded_files.image.size()), IM_COL32(80, 160, 255, 255) },
+        Region{ "screen buffer", screen_begin, screen_begin + screen_size, IM_COL32(255, 0, 255, 255) },
+        Region{ "stack", status.sys->SP(), cpp_box::system::STACK_START + 1, IM_COL32(255, 255, 0, 255) }
+      };
+
+      const auto region_of = [&regions](const std::uint32_t page_begin) -> const Region * {
+        for (const auto &region : regions) {
+          if (region.begin < page_begin + cpp_box::heatmap::Memory_Heatmap::page_size && page_begin < region.end) { return &region; }
+        }
+        return nullptr;
+      };
+
+      std::uint64_t most_accessed = 1;
+      for (const auto &page : heatmap.pages) { most_accessed = std::max(most_accessed, page.total()); }
+
+      // one cell per page, brighter is more accesses on a log scale, green are reads and red are writes
+      constexpr std::size_t columns = 64;
+      const auto cell               = 4.0f * status.scale_factor;
+      const auto origin             = ImGui::GetCursorScreenPos();
+      auto *draw_list               = ImGui::GetWindowDrawList();
+      for (std::size_t page = 0; page < heatmap.pages.size(); ++page) {
+        const ImVec2 top_left{ origin.x + static_cast<float>(page % columns) * cell, origin.y + static_cast<float>(page / columns) * cell };
+        const ImVec2 bottom_right{ top_left.x + cell - 1, top_left.y + cell - 1 };
+        const auto &counts = heatmap.pages[page];
+
+        auto color = IM_COL32(32, 32, 32, 255);
+        if (counts.total() != 0) {
+          const auto intensity   = std::log1p(static_cast<double>(counts.total())) / std::log1p(static_cast<double>(most_accessed));
+          const auto write_share = static_cast<double>(counts.writes) / static_cast<double>(counts.total());
+          const auto red         = static_cast<int>(intensity * (64 + 191 * write_share));
+          const auto green       = static_cast<int>(intensity * (64 + 191 * (1 - write_share)));
+          color                  = IM_COL32(red, green, 32, 255);
+        }
+        draw_list->AddRectFilled(top_left, bottom_right, color);
+
+        if (const auto *region = region_of(static_cast<std::uint32_t>(page) << cpp_box::heatmap::Memory_Heatmap::page_bits); region != nullptr) {
+          draw_list->AddRect(top_left, bottom_right, region->color);
+        }
+      }
+
+      const auto rows = (heatmap.pages.size() + columns - 1) / columns;
+      ImGui::Dummy({ static_cast<float>(columns) * cell, static_cast<float>(rows) * cell });
+      if (ImGui::IsItemHovered()) {
+        const auto mouse  = ImGui::GetMousePos();
+        const auto column = static_cast<std::size_t>((mouse.x - origin.x) / cell);
+        const auto page   = static_cast<std::size_t>((mouse.y - origin.y) / cell) * columns + std::min(column, columns - 1);
+        if (page < heatmap.pages.size()) {
+          const auto page_begin = static_cast<std::uint32_t>(page) << cpp_box::heatmap::Memory_Heatmap::page_bits;
+          const auto *region    = region_of(page_begin);
+          ImGui::SetTooltip("%s",
+                            fmt::format("{:08x} - {:08x} {}\n{} reads, {} writes",
+                                        page_begin,
+                                        page_begin + cpp_box::heatmap::Memory_Heatmap::page_size - 1,
+                                        region == nullptr ? "" : region->name,
+                                        heatmap.pages[page].reads,
+                                        heatmap.pages[page].writes)
+                              .c_str());
+        }
+      }
+
+      for (const auto &region : regions) {
+        const auto label = fmt::format("{:08x} - {:08x} {}", region.begin, region.end, region.name);
+        ImGui::TextColored(ImGui::ColorConvertU32ToFloat4(region.color), "%s", label.c_str());
+      }
+
+      if (ImGui::CollapsingHeader("Data Symbols")) {
+        for (const auto &[symbol, counts] : cpp_box::heatmap::symbol_counts(heatmap, status.data_symbols)) {
+          text(true, "{:10} reads {:10} writes  {:08x} {}", counts.reads, counts.writes, symbol->begin, symbol->name);
+        }
+      }
+    }
+    ImGui::End();
+
     ImGui::Begin("C++");
     {
       if (status.loaded_files.src.size() - strlen(status.loaded_files.src.c_str()) < 256) {
@@ -502,11 +637,19 @@ struct Box
 
       ImGui::SFML::Update(window, deltaClock.restart());
 
-      switch (status.next_state(draw_interface(status))) {
+      const auto inputs = draw_interface(status);
+      if (inputs.save_state_pressed) { status.save_state(); }
+      if (inputs.load_state_pressed) {
+        status.load_state();
+        status.update_display();
+      }
+
+      switch (status.next_state(inputs)) {
       case Status::States::Running:
-        status.last_registers = status.sys->registers;
-        status.last_CSPR      = status.sys->CSPR;
-        for (int i = 0; i < status.opsPerFrame && status.sys->operations_remaining(); ++i) { status.sys->next_operation(); }
+        status.last_registers       = status.sys->registers;
+        status.last_CSPR            = status.sys->CSPR;
+        status.sys->skip_idle_loops = true;
+        status.sys->run_until(status.sys->cycles() + status.opsPerFrame, status.profiler);
         status.update_display();
         break;
       case Status::States::Begin_Build:
@@ -540,8 +683,9 @@ struct Box
       case Status::States::Reset_Timer: status.reset_static_timer(); break;
       case Status::States::Step_One:
         if (status.sys->operations_remaining()) {
-          status.last_registers = status.sys->registers;
-          status.last_CSPR      = status.sys->CSPR;
+          status.last_registers       = status.sys->registers;
+          status.last_CSPR            = status.sys->CSPR;
+          status.sys->skip_idle_loops = false;
           status.sys->next_operation();
           status.update_display();
         }
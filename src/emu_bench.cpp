@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if !defined(_MSC_VER)
+#include <sys/resource.h>
+#endif
+
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include <clara.hpp>
+
+#include "../include/cpp_box/arm.hpp"
+#include "../include/cpp_box/compiler.hpp"
+#include "../include/cpp_box/coprocessor.hpp"
+#include "../include/cpp_box/devices.hpp"
+#include "../include/cpp_box/memory_map.hpp"
+
+namespace {
+
+using System =
+  cpp_box::arm::System<cpp_box::system::TOTAL_RAM, std::vector<std::uint8_t>, cpp_box::devices::Devices, cpp_box::coprocessor::Registry>;
+
+struct Summary
+{
+  double min{ 0 };
+  double median{ 0 };
+  double mean{ 0 };
+  double stddev{ 0 };
+};
+
+[[nodiscard]] Summary summarize(std::vector<double> samples)
+{
+  Summary summary;
+  if (samples.empty()) { return summary; }
+
+  std::sort(samples.begin(), samples.end());
+  const auto count = samples.size();
+  summary.min      = samples.front();
+  summary.median   = (count % 2) != 0 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+  summary.mean     = std::accumulate(samples.begin(), samples.end(), 0.0) / static_cast<double>(count);
+
+  if (count > 1) {
+    double squares = 0;
+    for (const auto sample : samples) { squares += (sample - summary.mean) * (sample - summary.mean); }
+    summary.stddev = std::sqrt(squares / static_cast<double>(count - 1));
+  }
+  return summary;
+}
+
+// peak resident set size of the whole process in KB, not available on Windows
+[[nodiscard]] std::optional<long> peak_rss_kb()
+{
+#if defined(_MSC_VER)
+  return std::nullopt;
+#else
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) { return std::nullopt; }
+#if defined(__APPLE__)
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+#endif
+}
+
+// one line per guest: name and median ns per instruction, lines starting with # are comments
+[[nodiscard]] std::map<std::string, double> read_baseline(const std::filesystem::path &path)
+{
+  std::map<std::string, double> baseline;
+  std::ifstream is{ path };
+  for (std::string line; std::getline(is, line);) {
+    if (line.empty() || line.front() == '#') { continue; }
+    std::istringstream ss{ line };
+    std::string name;
+    double ns_per_instruction{ 0 };
+    if (ss >> name >> ns_per_instruction) { baseline[name] = ns_per_instruction; }
+  }
+  return baseline;
+}
+
+void write_baseline(const std::filesystem::path &path, const std::map<std::string, double> &results)
+{
+  std::ofstream os{ path };
+  os << "# emu_bench baseline: guest, median ns per instruction\n";
+  for (const auto &[name, ns_per_instruction] : results) { os << name << ' ' << std::setprecision(6) << ns_per_instruction << '\n'; }
+}
+
+// the setup arm_emu gives a single core, except that idle loops are executed, so that every instruction
+// counted was interpreted, and the random device has a fixed seed
+[[nodiscard]] std::unique_ptr<System> make_system(const cpp_box::Loaded_Files &loaded_files)
+{
+  auto sys = std::make_unique<System>(loaded_files.image, static_cast<std::uint32_t>(cpp_box::system::Memory_Map::USER_RAM_START));
+  sys->coprocessors.add(cpp_box::system::ACCELERATOR_COPROCESSOR, cpp_box::coprocessor::make_accelerator());
+  sys->mmio_callback.random().reseed(1);
+
+  sys->write_word(static_cast<std::uint32_t>(cpp_box::system::Memory_Map::RAM_SIZE), cpp_box::system::TOTAL_RAM);
+  sys->write_half_word(static_cast<std::uint32_t>(cpp_box::system::Memory_Map::SCREEN_WIDTH), 64);
+  sys->write_half_word(static_cast<std::uint32_t>(cpp_box::system::Memory_Map::SCREEN_HEIGHT), 64);
+  sys->write_byte(static_cast<std::uint32_t>(cpp_box::system::Memory_Map::SCREEN_BPP), 32);
+  sys->write_word(static_cast<std::uint32_t>(cpp_box::system::Memory_Map::SCREEN_BUFFER), cpp_box::system::DEFAULT_SCREEN_BUFFER);
+  return sys;
+}
+
+}  // namespace
+
+int main(const int argc, const char *argv[])  // NOLINT
+{
+  using clara::Arg;
+  using clara::Args;
+  using clara::Help;
+  using clara::Opt;
+  bool show_help{ false };
+  std::vector<std::string> corpus;
+  std::size_t repetitions{ 5 };
+  std::uint64_t cycle_budget{ 100'000'000 };
+  std::filesystem::path baseline_file;
+  std::filesystem::path write_baseline_file;
+  double tolerance{ 5.0 };
+  std::filesystem::path user_provided_clang;
+  std::filesystem::path user_provided_freestanding_stdlib;
+  std::filesystem::path user_provided_hardware_lib;
+
+  auto cli = Help(show_help) | Arg(corpus, "files")("guest programs, C++ sources are compiled like cpp_box does, ELF objects are run as they are")
+             | Opt(repetitions, "count")["--repetitions"]("runs of each guest")
+             | Opt(cycle_budget, "cycles")["--cycles"]("cycles each run may take, most guests never return")
+             | Opt(baseline_file, "file")["--baseline"]("compare against a baseline, exits with failure if a guest got slower")
+             | Opt(write_baseline_file, "file")["--write-baseline"]("write the results as a new baseline")
+             | Opt(tolerance, "percent")["--tolerance"]("how much slower than the baseline still passes")
+             | Opt(user_provided_clang, "path")["--clang_compiler"]("compile C++ with <clang_compiler>")
+             | Opt(user_provided_freestanding_stdlib, "path")["--freestanding_stdlib"]("freestanding stdlib implementation to use")
+             | Opt(user_provided_hardware_lib, "path")["--hardware_lib"]("hardware lib implementation to use");
+
+  const auto result = cli.parse(Args(argc, argv));
+  if (!result) {
+    std::cerr << "Error in command line: " << result.errorMessage() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  if (show_help || corpus.empty() || repetitions == 0) {
+    std::cout << cli << '\n';
+    return show_help ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  auto logger = spdlog::stderr_color_mt("console");
+  logger->set_level(spdlog::level::warn);
+
+  const auto baseline = baseline_file.empty() ? std::map<std::string, double>{} : read_baseline(baseline_file);
+  if (!baseline_file.empty() && baseline.empty()) { std::cerr << "Baseline " << baseline_file << " is missing or empty, not comparing\n"; }
+
+  std::map<std::string, double> results;
+  bool regressed = false;
+
+  for (const auto &file : corpus) {
+    // the stem, so that a guest's source and its object of the corpus share a baseline
+    const auto name = std::filesystem::path{ file }.stem().string();
+    auto loaded     = cpp_box::load_unknown(file, *logger);
+
+    if (!loaded.good_binary) {
+      const auto clang_compiler =
+        cpp_box::find_clang(user_provided_clang, R"(C:\Program Files\LLVM\bin\clang++)", "/usr/local/bin/clang++", "/usr/bin/clang++");
+      if (clang_compiler.empty()) {
+        std::cerr << "Unable to locate a viable clang compiler for " << file << '\n';
+        return EXIT_FAILURE;
+      }
+      loaded = cpp_box::compile(loaded.src, clang_compiler, user_provided_freestanding_stdlib, user_provided_hardware_lib, "3", "c++2a", *logger);
+      if (!loaded.good_binary) {
+        std::cerr << "Unable to compile " << file << '\n';
+        return EXIT_FAILURE;
+      }
+    }
+
+    const auto entry_point = static_cast<std::uint32_t>(loaded.entry_point) + static_cast<std::uint32_t>(cpp_box::system::Memory_Map::USER_RAM_START);
+
+    std::vector<double> ns_per_instruction;
+    std::uint64_t instructions = 0;
+    for (std::size_t run = 0; run < repetitions; ++run) {
+      // a fresh system every run, so each run starts from the same state
+      auto sys = make_system(loaded);
+      sys->setup_run(entry_point);
+
+      const auto start = std::chrono::steady_clock::now();
+      sys->run_until(cycle_budget);
+      const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+      instructions = sys->instructions;
+      ns_per_instruction.push_back(elapsed / static_cast<double>(std::max(instructions, std::uint64_t{ 1 })));
+    }
+
+    const auto summary = summarize(ns_per_instruction);
+    results[name]      = summary.median;
+
+    std::cout << name << ": " << instructions << " instructions per run, " << repetitions << " runs\n"
+              << std::fixed << std::setprecision(3) << "  ns/instruction  min " << summary.min << "  median " << summary.median << "  mean "
+              << summary.mean << "  stddev " << summary.stddev << '\n'
+              << std::setprecision(2) << "  MIPS            max " << 1'000 / summary.min << "  median " << 1'000 / summary.median << '\n';
+
+    if (const auto expected = baseline.find(name); expected != baseline.end()) {
+      const auto change = (summary.median / expected->second - 1) * 100;
+      const auto slower = change > tolerance;
+      regressed         = regressed || slower;
+      std::cout << "  baseline        " << std::setprecision(3) << expected->second << " ns/instruction, " << std::showpos << std::setprecision(1)
+                << change << std::noshowpos << "%" << (slower ? "  REGRESSION" : "") << '\n';
+    }
+  }
+
+  // the high-water mark of the whole process, which includes every guest run so far
+  if (const auto rss = peak_rss_kb(); rss) { std::cout << "Peak RSS of all runs: " << *rss << " KB\n"; }
+
+  if (!write_baseline_file.empty()) { write_baseline(write_baseline_file, results); }
+
+  return regressed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
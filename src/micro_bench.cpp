@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <clara.hpp>
+
+#include "../include/cpp_box/arm.hpp"
+
+namespace {
+
+using System = cpp_box::arm::System<1024 * 1024, std::vector<std::uint8_t>>;
+
+using cpp_box::arm::Instruction_Type;
+using cpp_box::arm::OpCode;
+
+// Registers every stream starts with: r0 destination, r1 first operand, r2 second operand, r3 shift amount,
+// r4 the CPSR for MSR, r5 base and r6 offset of data transfers, r7 - r12 values for LDM and STM
+constexpr std::uint32_t base_address = 0x8'0000;
+constexpr std::uint32_t initial_cpsr = static_cast<std::uint32_t>(cpp_box::arm::Mode::System) | System::i_bit | System::f_bit;
+constexpr std::array<std::uint32_t, 16> initial_registers{ 0, 0x1234'5678, 0x0F0F'00FF, 5,  initial_cpsr, base_address, 8, 7,
+                                                           8, 9,           10,          11, 12,           0x10'0000,    0, 0 };
+
+// cond AL, the bits every encoding below shares
+constexpr std::uint32_t always = 0xE000'0000;
+
+struct Case
+{
+  Instruction_Type type;
+  std::string variant;
+  std::uint32_t word;
+};
+
+[[nodiscard]] std::vector<Case> make_cases()
+{
+  std::vector<Case> cases;
+
+  constexpr std::array<const char *, 16> opcodes{ "AND", "EOR", "SUB", "RSB", "ADD", "ADC", "SBC", "RSC",
+                                                  "TST", "TEQ", "CMP", "CMN", "ORR", "MOV", "BIC", "MVN" };
+  constexpr std::array<const char *, 4> shifts{ "LSL", "LSR", "ASR", "ROR" };
+
+  for (std::uint32_t opcode = 0; opcode < opcodes.size(); ++opcode) {
+    // the comparisons must set the flags, without S they are the encodings of MRS and MSR
+    const auto compare = opcode >= static_cast<std::uint32_t>(OpCode::TST) && opcode <= static_cast<std::uint32_t>(OpCode::CMN);
+    const auto word    = always | opcode << 21 | (compare ? 1u << 20 : 0u) | 1u << 16;
+    const std::string name{ opcodes[opcode] };
+
+    cases.push_back({ Instruction_Type::Data_Processing, name + " #imm", word | 1u << 25 | 0x3F });
+    for (std::uint32_t shift = 0; shift < shifts.size(); ++shift) {
+      cases.push_back({ Instruction_Type::Data_Processing, name + " reg " + shifts[shift] + " #imm", word | 3u << 7 | shift << 5 | 2u });
+    }
+    for (std::uint32_t shift = 0; shift < shifts.size(); ++shift) {
+      cases.push_back({ Instruction_Type::Data_Processing, name + " reg " + shifts[shift] + " reg", word | 3u << 8 | shift << 5 | 1u << 4 | 2u });
+    }
+  }
+
+  // MOVS, the flags of the shifter carry out are set too
+  cases.push_back({ Instruction_Type::Data_Processing, "MOVS reg ROR #imm", always | 0b1101u << 21 | 1u << 20 | 3u << 7 | 0b11u << 5 | 2u });
+
+  cases.push_back({ Instruction_Type::MRS, "MRS r0, CPSR", always | 0x010F'0000 });
+  cases.push_back({ Instruction_Type::MSR, "MSR CPSR, r4", always | 0x0129'F004 });
+  cases.push_back({ Instruction_Type::MSRF, "MSR CPSR_f, #imm", always | 0x0328'F20F });
+
+  cases.push_back({ Instruction_Type::Multiply_Long, "UMULL", always | 0x0080'0090 | 9u << 16 | 3u << 8 | 2u });
+  cases.push_back({ Instruction_Type::Multiply_Long, "UMLAL", always | 0x00A0'0090 | 9u << 16 | 3u << 8 | 2u });
+  cases.push_back({ Instruction_Type::Multiply_Long, "SMULL", always | 0x00C0'0090 | 9u << 16 | 3u << 8 | 2u });
+  cases.push_back({ Instruction_Type::Multiply_Long, "SMLAL", always | 0x00E0'0090 | 9u << 16 | 3u << 8 | 2u });
+
+  cases.push_back({ Instruction_Type::Single_Data_Swap, "SWP", always | 0x0100'0090 | 5u << 16 | 1u });
+  cases.push_back({ Instruction_Type::Single_Data_Swap, "SWPB", always | 0x0140'0090 | 5u << 16 | 1u });
+
+  // loads into r0, stores r1, always relative to r5
+  for (const auto load : { true, false }) {
+    for (const auto byte : { false, true }) {
+      const auto word = always | 1u << 26 | (byte ? 1u << 22 : 0u) | (load ? 1u << 20 : 1u << 12) | 5u << 16;
+      const auto name = std::string{ load ? "LDR" : "STR" } + (byte ? "B" : "");
+
+      cases.push_back({ Instruction_Type::Single_Data_Transfer, name + " [rn, #imm]", word | 1u << 24 | 1u << 23 | 8u });
+      cases.push_back({ Instruction_Type::Single_Data_Transfer, name + " [rn, #imm]!", word | 1u << 24 | 1u << 23 | 1u << 21 | 8u });
+      cases.push_back({ Instruction_Type::Single_Data_Transfer, name + " [rn], #imm", word | 1u << 23 | 8u });
+      cases.push_back({ Instruction_Type::Single_Data_Transfer, name + " [rn, rm]", word | 1u << 25 | 1u << 24 | 1u << 23 | 6u });
+      cases.push_back({ Instruction_Type::Single_Data_Transfer, name + " [rn, rm, LSL #2]", word | 1u << 25 | 1u << 24 | 1u << 23 | 2u << 7 | 6u });
+      cases.push_back({ Instruction_Type::Single_Data_Transfer, name + " [rn, -rm]", word | 1u << 25 | 1u << 24 | 6u });
+    }
+  }
+
+  for (const auto load : { true, false }) {
+    const auto word = always | 0b100u << 25 | (load ? 1u << 20 : 0u) | 5u << 16;
+    const auto name = std::string{ load ? "LDM" : "STM" };
+
+    cases.push_back({ Instruction_Type::Load_And_Store_Multiple, name + "IA 1 register", word | 1u << 23 | 0x0080 });
+    cases.push_back({ Instruction_Type::Load_And_Store_Multiple, name + "IA 4 registers", word | 1u << 23 | 0x0780 });
+    cases.push_back({ Instruction_Type::Load_And_Store_Multiple, name + "IA 8 registers", word | 1u << 23 | 0x1F83 });
+    cases.push_back({ Instruction_Type::Load_And_Store_Multiple, name + "IA! 4 registers", word | 1u << 23 | 1u << 21 | 0x0780 });
+    cases.push_back({ Instruction_Type::Load_And_Store_Multiple, name + "DB 4 registers", word | 1u << 24 | 0x0780 });
+  }
+
+  // offsets of -1 word, the target is the next instruction
+  cases.push_back({ Instruction_Type::Branch, "B", always | 0x0A00'0000 | 0xFF'FFFF });
+  cases.push_back({ Instruction_Type::Branch, "BL", always | 0x0B00'0000 | 0xFF'FFFF });
+
+  // MOVEQ with Z clear, the cost of a failed condition
+  cases.push_back({ Instruction_Type::Data_Processing, "MOVEQ condition failed", 0x01A0'0002 });
+
+  return cases;
+}
+
+// ns per instruction of the fastest of `repetitions` runs. Each run processes `blocks` straight-line streams
+// of the same instruction, the registers are reset between streams so that write back stays in range.
+[[nodiscard]] double measure(System &sys, const Case &test, const std::size_t blocks, const std::size_t repetitions)
+{
+  constexpr std::size_t block_size = 256;
+
+  const auto instruction = cpp_box::arm::Instruction{ test.word };
+  auto best              = std::numeric_limits<double>::max();
+
+  for (std::size_t repetition = 0; repetition < repetitions; ++repetition) {
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t block = 0; block < blocks; ++block) {
+      sys.registers = initial_registers;
+      sys.CSPR      = initial_cpsr;
+      for (std::size_t idx = 0; idx < block_size; ++idx) { sys.process(instruction, test.type); }
+    }
+    const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    best               = std::min(best, elapsed / static_cast<double>(blocks * block_size));
+  }
+
+  return best;
+}
+
+constexpr std::size_t name_width = 60;
+
+[[nodiscard]] std::string row_name(const Case &test)
+{
+  std::ostringstream os;
+  os << std::left << std::setw(26) << cpp_box::arm::to_string(test.type) << test.variant;
+  return os.str();
+}
+
+// the table this program writes, names fill the first name_width columns
+[[nodiscard]] std::map<std::string, double> read_table(const std::filesystem::path &path)
+{
+  std::map<std::string, double> table;
+  std::ifstream is{ path };
+  for (std::string line; std::getline(is, line);) {
+    if (line.size() <= name_width || line.front() == '#') { continue; }
+    try {
+      auto name = line.substr(0, name_width);
+      name.erase(name.find_last_not_of(' ') + 1);
+      table[name] = std::stod(line.substr(name_width));
+    } catch (const std::exception &) {
+      continue;
+    }
+  }
+  return table;
+}
+
+}  // namespace
+
+int main(const int argc, const char *argv[])  // NOLINT
+{
+  using clara::Args;
+  using clara::Help;
+  using clara::Opt;
+  bool show_help{ false };
+  std::size_t blocks{ 4096 };
+  std::size_t repetitions{ 5 };
+  std::string filter;
+  std::filesystem::path compare_file;
+
+  auto cli = Help(show_help) | Opt(blocks, "count")["--blocks"]("streams of 256 instructions per run")
+             | Opt(repetitions, "count")["--repetitions"]("runs per instruction, the fastest one counts")
+             | Opt(filter, "text")["--filter"]("only instructions whose row contains the text")
+             | Opt(compare_file, "file")["--compare"]("a table written by an earlier run, adds the change to each row");
+
+  const auto result = cli.parse(Args(argc, argv));
+  if (!result) {
+    std::cerr << "Error in command line: " << result.errorMessage() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  if (show_help) {
+    std::cout << cli << '\n';
+    return EXIT_SUCCESS;
+  }
+
+  const auto previous = compare_file.empty() ? std::map<std::string, double>{} : read_table(compare_file);
+  auto sys            = std::make_unique<System>();
+
+  std::cout << "# micro_bench: ns per instruction through System::process, fastest of " << repetitions << " runs of " << blocks * 256
+            << " instructions\n";
+
+  for (const auto &test : make_cases()) {
+    const auto name = row_name(test);
+    if (name.find(filter) == std::string::npos) { continue; }
+
+    if (System::decode(cpp_box::arm::Instruction{ test.word }) != test.type) {
+      std::cerr << "Encoding of '" << name << "' decodes as " << cpp_box::arm::to_string(System::decode(cpp_box::arm::Instruction{ test.word }))
+                << '\n';
+      return EXIT_FAILURE;
+    }
+
+    const auto ns = measure(*sys, test, blocks, repetitions);
+    std::cout << std::left << std::setw(name_width) << name << std::right << std::fixed << std::setprecision(3) << std::setw(8) << ns;
+    if (const auto before = previous.find(name); before != previous.end()) {
+      std::cout << std::showpos << std::setprecision(1) << std::setw(9) << (ns / before->second - 1) * 100 << '%' << std::noshowpos;
+    }
+    std::cout << '\n';
+  }
+}
@@ -76,6 +76,10 @@ int main(const int argc, const char *argv[])
                                                "c++2a",
                                                *spdlog::stdout_color_mt("console"));
 
+  if (!compile_result.good_binary) {
+    std::cerr << "Unable to compile " << inputFile << '\n';
+    return EXIT_FAILURE;
+  }
 
   cpp_box::utility::write_binary_file(outputFile, compile_result.image);
 }
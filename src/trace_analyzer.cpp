@@ -0,0 +1,355 @@
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include <clara.hpp>
+
+#include "../include/cpp_box/arm.hpp"
+#include "../include/cpp_box/compiler.hpp"
+#include "../include/cpp_box/memory_map.hpp"
+#include "../include/cpp_box/profiler.hpp"
+#include "../include/cpp_box/trace.hpp"
+
+namespace {
+
+// registers written are counted per window of this many instructions, as a measure of register pressure
+constexpr std::size_t window_size = 64;
+// batches are a multiple of the window size, so no window spans two batches
+constexpr std::size_t batch_size = window_size * 1024;
+
+// the part of the records the statistics need, decoded sequentially and analyzed in parallel
+struct Batch
+{
+  std::uint64_t first_index{ 0 };
+  std::uint32_t previous_pc{ 0 };
+  std::vector<std::uint32_t> pcs;
+  std::vector<std::uint16_t> changed;
+};
+
+struct Statistics
+{
+  std::unordered_map<std::uint32_t, std::uint64_t> executions;  // per pc
+  std::map<std::pair<std::uint32_t, std::uint32_t>, std::uint64_t> back_edges;  // (target, source) of backwards jumps
+  std::array<std::uint64_t, 16> register_writes{};  // r0 - r14 and the CPSR, only writes that changed the value
+  std::array<std::uint64_t, 17> working_set{};  // histogram of the number of registers written per window
+
+  void add(const Batch &batch)
+  {
+    auto previous = batch.previous_pc;
+    for (std::size_t idx = 0; idx < batch.pcs.size(); ++idx) {
+      const auto pc = batch.pcs[idx];
+      ++executions[pc];
+      if (pc <= previous && batch.first_index + idx != 0) { ++back_edges[{ pc, previous }]; }
+      previous = pc;
+    }
+
+    for (std::size_t window = 0; window < batch.changed.size(); window += window_size) {
+      std::uint32_t written = 0;
+      for (std::size_t idx = window; idx < std::min(window + window_size, batch.changed.size()); ++idx) {
+        written |= batch.changed[idx];
+        for (std::uint32_t mask = batch.changed[idx]; mask != 0; mask &= mask - 1) {
+          ++register_writes[static_cast<std::size_t>(__builtin_ctz(mask))];
+        }
+      }
+      ++working_set[static_cast<std::size_t>(__builtin_popcount(written))];
+    }
+  }
+
+  void merge(const Statistics &other)
+  {
+    for (const auto &[pc, count] : other.executions) { executions[pc] += count; }
+    for (const auto &[edge, count] : other.back_edges) { back_edges[edge] += count; }
+    for (std::size_t reg = 0; reg < register_writes.size(); ++reg) { register_writes[reg] += other.register_writes[reg]; }
+    for (std::size_t count = 0; count < working_set.size(); ++count) { working_set[count] += other.working_set[count]; }
+  }
+};
+
+// Workers take batches off a bounded queue, each into its own Statistics, which are merged at the end
+struct Analyzer
+{
+  explicit Analyzer(const std::size_t thread_count) : results(thread_count)
+  {
+    for (std::size_t thread = 0; thread < thread_count; ++thread) {
+      threads.emplace_back([this, thread] { work(results[thread]); });
+    }
+  }
+
+  void push(Batch batch)
+  {
+    std::unique_lock<std::mutex> lock{ mutex };
+    condition.wait(lock, [this] { return pending.size() < threads.size() * 2; });
+    pending.push_back(std::move(batch));
+    condition.notify_all();
+  }
+
+  Statistics finish()
+  {
+    {
+      const std::lock_guard<std::mutex> lock{ mutex };
+      done = true;
+    }
+    condition.notify_all();
+    for (auto &thread : threads) { thread.join(); }
+
+    Statistics total;
+    for (const auto &result : results) { total.merge(result); }
+    return total;
+  }
+
+private:
+  void work(Statistics &statistics)
+  {
+    std::unique_lock<std::mutex> lock{ mutex };
+    while (true) {
+      condition.wait(lock, [this] { return !pending.empty() || done; });
+      if (pending.empty()) { return; }
+
+      auto batch = std::move(pending.front());
+      pending.pop_front();
+      condition.notify_all();
+
+      lock.unlock();
+      statistics.add(batch);
+      lock.lock();
+    }
+  }
+
+  std::vector<Statistics> results;
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::deque<Batch> pending;
+  bool done{ false };
+};
+
+using System = cpp_box::arm::System<>;
+
+constexpr std::array<const char *, 16> opcode_names{ "AND", "EOR", "SUB", "RSB", "ADD", "ADC", "SBC", "RSC",
+                                                     "TST", "TEQ", "CMP", "CMN", "ORR", "MOV", "BIC", "MVN" };
+
+constexpr std::array<const char *, 16> register_names{ "r0", "r1", "r2",  "r3",  "r4",  "r5", "r6", "r7",
+                                                       "r8", "r9", "r10", "r11", "r12", "sp", "lr", "cpsr" };
+
+// the instruction word at `pc` of the image as loaded at USER_RAM_START, as arm_emu does
+[[nodiscard]] std::optional<cpp_box::arm::Instruction> instruction_at(const cpp_box::Loaded_Files &files, const std::uint32_t pc)
+{
+  const auto offset = static_cast<std::size_t>(pc) - static_cast<std::size_t>(cpp_box::system::Memory_Map::USER_RAM_START);
+  if (pc < static_cast<std::uint32_t>(cpp_box::system::Memory_Map::USER_RAM_START) || offset + 4 > files.image.size()) { return std::nullopt; }
+  return cpp_box::arm::Instruction{ static_cast<std::uint32_t>(files.image[offset]) | static_cast<std::uint32_t>(files.image[offset + 1]) << 8
+                                    | static_cast<std::uint32_t>(files.image[offset + 2]) << 16
+                                    | static_cast<std::uint32_t>(files.image[offset + 3]) << 24 };
+}
+
+[[nodiscard]] std::string function_of(const std::map<std::uint32_t, std::string> &symbols, const std::uint32_t pc)
+{
+  if (auto symbol = symbols.upper_bound(pc); symbol != symbols.begin()) { return std::prev(symbol)->second; }
+  return "<unknown>";
+}
+
+template<typename Key>
+void print_counts(const char *title, const std::map<Key, std::uint64_t> &counts, const std::uint64_t total, const std::size_t top)
+{
+  std::vector<std::pair<Key, std::uint64_t>> sorted{ counts.begin(), counts.end() };
+  std::sort(sorted.begin(), sorted.end(), [](const auto &lhs, const auto &rhs) { return lhs.second > rhs.second; });
+
+  std::cout << '\n' << title << "\n  instructions  percent\n";
+  for (std::size_t idx = 0; idx < std::min(top, sorted.size()); ++idx) {
+    std::cout << std::setw(14) << sorted[idx].second << std::setw(8) << std::fixed << std::setprecision(2)
+              << 100.0 * static_cast<double>(sorted[idx].second) / static_cast<double>(std::max(total, std::uint64_t{ 1 })) << "%  "
+              << sorted[idx].first << '\n';
+  }
+}
+
+void print_report(const Statistics &statistics, const cpp_box::Loaded_Files &files, const std::uint64_t total, const std::size_t top)
+{
+  const auto symbols = cpp_box::profiler::function_symbols(files);
+
+  std::map<std::string, std::uint64_t> types;
+  std::map<std::string, std::uint64_t> opcodes;
+  std::map<std::string, std::uint64_t> functions;
+  for (const auto &[pc, count] : statistics.executions) {
+    functions[function_of(symbols, pc)] += count;
+
+    const auto instruction = instruction_at(files, pc);
+    if (!instruction) {
+      types["<outside of the image>"] += count;
+      continue;
+    }
+
+    const auto type = System::decode(*instruction);
+    types[std::string{ cpp_box::arm::to_string(type) }] += count;
+    if (type == cpp_box::arm::Instruction_Type::Data_Processing) {
+      opcodes[opcode_names[static_cast<std::size_t>(cpp_box::arm::Data_Processing{ *instruction }.get_opcode())]] += count;
+    }
+  }
+
+  print_counts("Instruction types", types, total, top);
+  print_counts("Data processing opcodes", opcodes, total, top);
+  print_counts("Functions", functions, total, top);
+
+  // a loop is the range from a backwards jump's target to the jump, its cost the instructions executed in that range
+  struct Loop
+  {
+    std::uint32_t begin;
+    std::uint32_t end;
+    std::uint64_t iterations;
+    std::uint64_t instructions;
+  };
+
+  std::vector<Loop> loops;
+  for (const auto &[edge, iterations] : statistics.back_edges) {
+    std::uint64_t instructions = 0;
+    for (auto pc = edge.first; pc <= edge.second && pc >= edge.first; pc += 4) {
+      if (const auto count = statistics.executions.find(pc); count != statistics.executions.end()) { instructions += count->second; }
+    }
+    loops.push_back(Loop{ edge.first, edge.second, iterations, instructions });
+  }
+  std::sort(loops.begin(), loops.end(), [](const auto &lhs, const auto &rhs) { return lhs.instructions > rhs.instructions; });
+
+  std::cout << "\nHot loops\n  instructions  percent    iterations  range\n";
+  for (std::size_t idx = 0; idx < std::min(top, loops.size()); ++idx) {
+    const auto &loop = loops[idx];
+    std::cout << std::dec << std::setw(14) << loop.instructions << std::setw(8) << std::fixed << std::setprecision(2)
+              << 100.0 * static_cast<double>(loop.instructions) / static_cast<double>(std::max(total, std::uint64_t{ 1 })) << '%'
+              << std::setw(14) << loop.iterations << "  " << std::hex << std::setfill('0') << std::setw(8) << loop.begin << " - " << std::setw(8)
+              << loop.end << std::setfill(' ') << std::dec << "  " << function_of(symbols, loop.begin) << '\n';
+  }
+
+  std::cout << "\nRegister changes, writing the value a register already holds is not recorded\n";
+  for (std::size_t reg = 0; reg < register_names.size(); ++reg) {
+    std::cout << std::setw(6) << register_names[reg] << std::setw(14) << statistics.register_writes[reg] << '\n';
+  }
+
+  std::uint64_t windows  = 0;
+  std::uint64_t weighted = 0;
+  for (std::size_t count = 0; count < statistics.working_set.size(); ++count) {
+    windows += statistics.working_set[count];
+    weighted += count * statistics.working_set[count];
+  }
+
+  std::cout << "\nRegisters changed per " << window_size << " instructions, average " << std::fixed << std::setprecision(2)
+            << static_cast<double>(weighted) / static_cast<double>(std::max(windows, std::uint64_t{ 1 })) << '\n';
+  for (std::size_t count = 0; count < statistics.working_set.size(); ++count) {
+    if (statistics.working_set[count] != 0) { std::cout << std::setw(6) << count << std::setw(14) << statistics.working_set[count] << '\n'; }
+  }
+}
+
+void print_state(const std::uint64_t index, const cpp_box::trace::Record &record, const cpp_box::Loaded_Files &files)
+{
+  std::cout << "Instruction " << std::dec << index << " at " << std::hex << std::setfill('0') << std::setw(8) << record.pc;
+  if (const auto instruction = instruction_at(files, record.pc); instruction) {
+    std::cout << ": " << std::setw(8) << instruction->data() << ' ' << cpp_box::arm::to_string(System::decode(*instruction));
+  }
+  std::cout << "\nRegisters after it executed, * were changed by it\n";
+
+  for (std::size_t reg = 0; reg < register_names.size(); ++reg) {
+    std::cout << std::setfill(' ') << std::setw(5) << register_names[reg] << ((record.changed & (1u << reg)) != 0 ? '*' : ' ') << ' '
+              << std::setfill('0') << std::setw(8) << record.registers[reg] << ((reg % 4) == 3 ? '\n' : ' ');
+  }
+
+  for (const auto &access : record.accesses) {
+    std::cout << (access.write ? "write " : "read  ") << std::dec << static_cast<int>(access.size) << " bytes at " << std::hex << std::setw(8)
+              << access.address << '\n';
+  }
+  std::cout << std::setfill(' ') << std::dec;
+}
+
+}  // namespace
+
+int main(const int argc, const char *argv[])  // NOLINT
+{
+  using clara::Arg;
+  using clara::Args;
+  using clara::Help;
+  using clara::Opt;
+  bool show_help{ false };
+  std::filesystem::path trace_file;
+  std::filesystem::path binary_file;
+  std::int64_t seek{ -1 };
+  std::size_t thread_count{ std::max(std::thread::hardware_concurrency(), 1u) };
+  std::size_t top{ 20 };
+
+  auto cli = Help(show_help) | Arg(trace_file, "trace")("trace written by arm_emu --trace") | Arg(binary_file, "file")("the binary that was traced")
+             | Opt(seek, "index")["--seek"]("print the registers after the instruction with this index instead of the statistics")
+             | Opt(thread_count, "count")["--threads"]("threads analyzing the trace") | Opt(top, "count")["--top"]("entries per report section");
+
+  const auto result = cli.parse(Args(argc, argv));
+  if (!result) {
+    std::cerr << "Error in command line: " << result.errorMessage() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  if (show_help || trace_file.empty() || binary_file.empty()) {
+    std::cout << cli << '\n';
+    return show_help ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  auto logger = spdlog::stderr_color_mt("console");
+  logger->set_level(spdlog::level::warn);
+  const auto loaded_files = cpp_box::load_unknown(binary_file, *logger);
+
+  std::ifstream is{ trace_file, std::ios::binary };
+  if (!is) {
+    std::cerr << "Unable to open " << trace_file << '\n';
+    return EXIT_FAILURE;
+  }
+
+  try {
+    cpp_box::trace::Reader reader{ is };
+    cpp_box::trace::Record record;
+    std::uint64_t index = 0;
+
+    if (seek >= 0) {
+      // registers are only known relative to the previous record, this decodes from the closest keyframe
+      index = reader.seek(static_cast<std::uint64_t>(seek));
+      while (reader.next(record)) {
+        if (index++ == static_cast<std::uint64_t>(seek)) {
+          print_state(static_cast<std::uint64_t>(seek), record, loaded_files);
+          return EXIT_SUCCESS;
+        }
+      }
+      std::cerr << "The trace has only " << index << " instructions\n";
+      return EXIT_FAILURE;
+    }
+
+    Analyzer analyzer{ std::max(thread_count, std::size_t{ 1 }) };
+    std::uint64_t accesses    = 0;
+    std::uint32_t previous_pc = 0;
+    Batch batch;
+    while (reader.next(record)) {
+      batch.pcs.push_back(record.pc);
+      batch.changed.push_back(record.changed);
+      accesses += record.accesses.size();
+      if (++index % batch_size == 0) {
+        previous_pc = batch.pcs.back();
+        analyzer.push(std::exchange(batch, Batch{ index, previous_pc, {}, {} }));
+        batch.pcs.reserve(batch_size);
+        batch.changed.reserve(batch_size);
+      }
+    }
+    analyzer.push(std::move(batch));
+
+    const auto statistics = analyzer.finish();
+    std::cout << "Trace: " << index << " instructions";
+    if (reader.memory_accesses()) { std::cout << ", " << accesses << " data accesses"; }
+    std::cout << '\n';
+    print_report(statistics, loaded_files, index, top);
+  } catch (const std::runtime_error &e) {
+    std::cerr << "Error reading " << trace_file << ": " << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+}
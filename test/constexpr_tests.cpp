@@ -2,6 +2,8 @@
 #include <catch2/catch.hpp>
 
 #include <cpp_box/arm.hpp>
+#include <cpp_box/lockstep.hpp>
+#include <cpp_box/snapshot.hpp>
 
 template<bool B> bool static_test()
 {
@@ -40,6 +42,196 @@ template<typename... T> CONSTEXPR auto run(T... bytes)
   return system;
 }
 
+struct Test_Coprocessor
+{
+  std::array<std::uint32_t, 16> registers{};
+
+  [[nodiscard]] constexpr bool has_coprocessor(const std::uint32_t number) const noexcept { return number == 7; }
+
+  // CRd = CRn + CRm
+  template<typename System> constexpr void data_operation(System & /*unused*/, const cpp_box::arm::Coprocessor_Data_Operation op) noexcept
+  {
+    registers[op.destination_register()] = registers[op.operand_register_1()] + registers[op.operand_register_2()];
+  }
+
+  template<typename System>
+  [[nodiscard]] constexpr std::uint32_t read_register(System & /*unused*/, const cpp_box::arm::Coprocessor_Register_Transfer op) noexcept
+  {
+    return registers[op.coprocessor_register()];
+  }
+
+  template<typename System>
+  constexpr void write_register(System & /*unused*/, const cpp_box::arm::Coprocessor_Register_Transfer op, const std::uint32_t value) noexcept
+  {
+    registers[op.coprocessor_register()] = value;
+  }
+};
+
+template<typename... T> CONSTEXPR auto run_coprocessor_instruction(T... instruction)
+{
+  cpp_box::arm::System<1024, std::array<std::uint8_t, 1024>, cpp_box::arm::NO_MMIO, Test_Coprocessor> system{};
+  system.PC() = 4;
+  (system.process(instruction), ...);
+  return system;
+}
+
+template<std::size_t N> constexpr auto to_bytes(const std::array<std::uint32_t, N> &words)
+{
+  std::array<std::uint8_t, N * 4> bytes{};
+  for (std::size_t idx = 0; idx < bytes.size(); ++idx) { bytes[idx] = static_cast<std::uint8_t>(words[idx / 4] >> ((idx % 4) * 8)); }
+  return bytes;
+}
+
+constexpr std::array<std::uint32_t, 18> irq_program{
+  0xe10f1000,  // 00: mrs r1, cpsr
+  0xe3c11080,  // 04: bic r1, r1, #0x80
+  0xe121f001,  // 08: msr cpsr_c, r1
+  0xe3a00001,  // 0c: mov r0, #1
+  0xe2800001,  // 10: add r0, r0, #1
+  0xe1a0f00e,  // 14: mov pc, lr
+  0x00000040,  // 18: IRQ handler address
+  0,          0, 0, 0, 0, 0, 0, 0, 0,
+  0xe3a02005,  // 40: mov r2, #5
+  0xe25ef004   // 44: subs pc, lr, #4
+};
+
+// IRQ line is raised once IRQs are unmasked, right before 'mov r0, #1'
+CONSTEXPR auto run_irq_program(const bool return_from_handler)
+{
+  cpp_box::arm::System system{ to_bytes(irq_program) };
+  system.setup_run(0);
+  for (int op = 0; op < 3; ++op) { system.next_operation(); }
+
+  system.interrupts.irq = true;
+  system.next_operation();
+
+  if (return_from_handler) {
+    system.interrupts.irq = false;
+    while (system.operations_remaining()) { system.next_operation(); }
+  }
+  return system;
+}
+
+// any write halts the core, the scheduled event raises the IRQ line
+struct Test_Wait_MMIO : cpp_box::arm::NO_MMIO
+{
+  [[nodiscard]] constexpr bool is_mmio_range(const std::uint32_t loc) const noexcept { return loc == 0x100; }
+
+  template<typename System> constexpr void write_word(System &sys, const std::uint32_t /*unused*/, const std::uint32_t /*unused*/) noexcept
+  {
+    sys.wait_for_interrupt();
+  }
+
+  template<typename System> constexpr void event(System &sys, const std::uint32_t /*unused*/) noexcept { sys.interrupts.irq = true; }
+};
+
+constexpr std::array<std::uint32_t, 4> wait_program{
+  0xe3a01c01,  // mov r1, #0x100
+  0xe5810000,  // str r0, [r1]
+  0xe3a00007,  // mov r0, #7
+  0xe1a0f00e   // mov pc, lr
+};
+
+// reads 0 until the scheduled event
+struct Test_Poll_MMIO : cpp_box::arm::NO_MMIO
+{
+  bool ready{ false };
+
+  [[nodiscard]] constexpr bool is_mmio_range(const std::uint32_t loc) const noexcept { return loc == 0x100; }
+
+  template<typename System> [[nodiscard]] constexpr std::uint32_t read_word(const System & /*unused*/, const std::uint32_t /*unused*/) const noexcept
+  {
+    return ready ? 1 : 0;
+  }
+
+  template<typename System> constexpr void event(System & /*unused*/, const std::uint32_t /*unused*/) noexcept { ready = true; }
+};
+
+constexpr std::array<std::uint32_t, 5> poll_program{
+  0xe3a01c01,  // 00: mov r1, #0x100
+  0xe5910000,  // 04: ldr r0, [r1]
+  0xe3500000,  // 08: cmp r0, #0
+  0x0afffffc,  // 0c: beq 04
+  0xe1a0f00e   // 10: mov pc, lr
+};
+
+CONSTEXPR auto run_poll_program(const bool skip_idle_loops)
+{
+  cpp_box::arm::System<1024, std::array<std::uint8_t, 1024>, Test_Poll_MMIO> system{ to_bytes(poll_program) };
+  system.skip_idle_loops     = skip_idle_loops;
+  system.cycle_model.enabled = true;
+  system.scheduler.schedule(10000, 0);
+  system.run(0);
+  return system;
+}
+
+// runs the poll program to `cycle`, then continues it in another system the core state is restored into
+CONSTEXPR auto run_restored_poll_program(const std::uint64_t cycle)
+{
+  cpp_box::arm::System<1024, std::array<std::uint8_t, 1024>, Test_Poll_MMIO> original{ to_bytes(poll_program) };
+  original.cycle_model.enabled = true;
+  original.scheduler.schedule(10000, 0);
+  original.setup_run(0);
+  original.run_until(cycle);
+
+  cpp_box::arm::System<1024, std::array<std::uint8_t, 1024>, Test_Poll_MMIO> restored{};
+  restored.cycle_model.enabled = true;
+  restored.builtin_ram         = original.builtin_ram;
+  cpp_box::snapshot::apply_core(restored, cpp_box::snapshot::capture_core(original));
+  restored.run_until(cpp_box::arm::Scheduler::never);
+  return restored;
+}
+
+constexpr std::array<std::uint32_t, 5> cycle_program{
+  0xe3a00080,  // mov r0, #0x80    1S
+  0xe3a01005,  // mov r1, #5       1S
+  0xe5801000,  // str r1, [r0]     2N
+  0xe5902000,  // ldr r2, [r0]     1S + 1N + 1I
+  0xe1a0f00e   // mov pc, lr       1S, refill 1N + 1S
+};
+
+CONSTEXPR auto run_cycle_program(const bool wait_states)
+{
+  cpp_box::arm::System system{ to_bytes(cycle_program) };
+  system.cycle_model.enabled = true;
+  if (wait_states) { system.cycle_model.add_region({ 0x80, 0x100, 1, 3 }); }
+  system.run(0);
+  return system;
+}
+
+CONSTEXPR auto run_wait_program(const bool schedule_event)
+{
+  cpp_box::arm::System<1024, std::array<std::uint8_t, 1024>, Test_Wait_MMIO> system{ to_bytes(wait_program) };
+  if (schedule_event) { system.scheduler.schedule(1000, 0); }
+  system.run(0);
+  return system;
+}
+
+constexpr std::array<std::uint32_t, 7> lockstep_program{
+  0xe3a00080,  // 00: mov r0, #0x80
+  0xe3a01000,  // 04: mov r1, #0
+  0xe7c01001,  // 08: strb r1, [r0, r1]
+  0xe2811001,  // 0c: add r1, r1, #1
+  0xe3510010,  // 10: cmp r1, #16
+  0x1afffffb,  // 14: bne 08
+  0xe1a0f00e   // 18: mov pc, lr
+};
+
+enum struct Perturbation { NONE, REGISTER, MEMORY, RETURN };
+
+CONSTEXPR auto run_lockstep_program(const Perturbation perturbation)
+{
+  cpp_box::arm::System reference{ to_bytes(lockstep_program) };
+  auto program = lockstep_program;
+  if (perturbation == Perturbation::RETURN) { program[0] = lockstep_program.back(); }
+  cpp_box::arm::System candidate{ to_bytes(program) };
+  if (perturbation == Perturbation::REGISTER) { candidate.registers[5] = 1; }
+  if (perturbation == Perturbation::MEMORY) { candidate.write_byte(0x200, 1); }
+  // registers are compared after every block otherwise
+  const std::uint64_t block_interval = perturbation == Perturbation::RETURN ? 1000 : 1;
+  return cpp_box::lockstep::run(reference, candidate, 0, cpp_box::lockstep::Settings{ block_interval });
+}
+
 
 TEST_CASE("test always executing jump")
 {
@@ -235,6 +427,20 @@ TEST_CASE("Test arbitrary code execution with loop")
   REQUIRE(TEST(system.read_byte(104) == 4));
   REQUIRE(TEST(system.read_byte(105) == 0));
   REQUIRE(TEST(system.read_byte(106) == 1));
+
+  // the ldr, a strb per iteration and every bne but the last, plus the return
+  REQUIRE(TEST(system.counters.loads == 1));
+  REQUIRE(TEST(system.counters.stores == 100));
+  REQUIRE(TEST(system.counters.branches_taken == 100));
+
+  // the final bne fails its condition, the program fits the decoded instruction cache
+  REQUIRE(TEST(system.statistics.executed[static_cast<std::size_t>(cpp_box::arm::Instruction_Type::Data_Processing)] == 603));
+  REQUIRE(TEST(system.statistics.executed[static_cast<std::size_t>(cpp_box::arm::Instruction_Type::Multiply_Long)] == 100));
+  REQUIRE(TEST(system.statistics.executed[static_cast<std::size_t>(cpp_box::arm::Instruction_Type::Branch)] == 100));
+  REQUIRE(TEST(system.statistics.condition_failed == 1));
+  REQUIRE(TEST(system.statistics.i_cache_hits() == system.instructions));
+  REQUIRE(TEST(system.statistics.memory_reads == 1));
+  REQUIRE(TEST(system.statistics.memory_writes == 100));
 }
 
 
@@ -318,4 +524,179 @@ TEST_CASE("Test arbitrary code")
   REQUIRE(TEST(thing.read_byte(1001) == 12));  // NOLINT This suppresses an initialization warning from catch2
 }
 
+TEST_CASE("Coprocessor register transfers and data operation")
+{
+  CONSTEXPR auto system = run_coprocessor_instruction(cpp_box::arm::Instruction{ 0xe3a00005 },   // mov r0, #5
+                                                      cpp_box::arm::Instruction{ 0xe3a01007 },   // mov r1, #7
+                                                      cpp_box::arm::Instruction{ 0xee000710 },   // mcr p7, 0, r0, c0, c0, 0
+                                                      cpp_box::arm::Instruction{ 0xee011710 },   // mcr p7, 0, r1, c1, c0, 0
+                                                      cpp_box::arm::Instruction{ 0xee002701 },   // cdp p7, 0, c2, c0, c1, 0
+                                                      cpp_box::arm::Instruction{ 0xee122710 });  // mrc p7, 0, r2, c2, c0, 0
+
+  REQUIRE(TEST(cpp_box::arm::System<>::decode(cpp_box::arm::Instruction{ 0xee002701 })
+               == cpp_box::arm::Instruction_Type::Coprocessor_Data_Operation));
+  REQUIRE(TEST(cpp_box::arm::System<>::decode(cpp_box::arm::Instruction{ 0xee122710 })
+               == cpp_box::arm::Instruction_Type::Coprocessor_Register_Transfer));
+  REQUIRE(TEST(system.coprocessors.registers[2] == 12));
+  REQUIRE(TEST(system.registers[2] == 12));
+}
+
+TEST_CASE("Coprocessor register transfer to PC sets flags")
+{
+  CONSTEXPR auto system = run_coprocessor_instruction(cpp_box::arm::Instruction{ 0xe3a00206 },   // mov r0, #0x60000000
+                                                      cpp_box::arm::Instruction{ 0xee000710 },   // mcr p7, 0, r0, c0, c0, 0
+                                                      cpp_box::arm::Instruction{ 0xee10f710 });  // mrc p7, 0, pc, c0, c0, 0
+
+  REQUIRE(TEST(system.z_flag()));
+  REQUIRE(TEST(system.c_flag()));
+  REQUIRE(TEST(!system.n_flag()));
+  REQUIRE(TEST(system.PC() == 16));
+}
+
+TEST_CASE("IRQ entry banks LR and SPSR")
+{
+  CONSTEXPR auto system = run_irq_program(false);
+
+  REQUIRE(TEST(system.mode() == cpp_box::arm::Mode::IRQ));
+  REQUIRE(TEST(system.registers[2] == 5));
+  REQUIRE(TEST(system.LR() == 0x14));
+  REQUIRE(TEST((system.SPSR() & cpp_box::arm::System<>::mode_mask) == static_cast<std::uint32_t>(cpp_box::arm::Mode::System)));
+  REQUIRE(TEST((system.CSPR & cpp_box::arm::System<>::i_bit) != 0));
+}
+
+TEST_CASE("SUBS PC, LR returns from IRQ")
+{
+  CONSTEXPR auto system = run_irq_program(true);
+
+  REQUIRE(TEST(system.mode() == cpp_box::arm::Mode::System));
+  REQUIRE(TEST(system.registers[0] == 2));
+  REQUIRE(TEST(system.registers[2] == 5));
+  REQUIRE(TEST((system.CSPR & cpp_box::arm::System<>::i_bit) == 0));
+}
+
+TEST_CASE("Wait for interrupt skips ahead to the next event")
+{
+  CONSTEXPR auto system = run_wait_program(true);
+
+  REQUIRE(TEST(system.registers[0] == 7));
+  REQUIRE(TEST(system.cycles() == 1002));
+  REQUIRE(TEST(system.idle_cycles == 998));
+}
+
+TEST_CASE("Wait for interrupt with nothing scheduled stalls")
+{
+  CONSTEXPR auto system = run_wait_program(false);
+
+  REQUIRE(TEST(system.stalled()));
+  REQUIRE(TEST(system.registers[0] == 0));
+}
+
+TEST_CASE("SWP exchanges register and memory")
+{
+  CONSTEXPR auto system = run_code(0,
+                                   to_bytes(std::array<std::uint32_t, 7>{
+                                     0xe3a00080,  // mov r0, #0x80
+                                     0xe3a01005,  // mov r1, #5
+                                     0xe5801000,  // str r1, [r0]
+                                     0xe3a02009,  // mov r2, #9
+                                     0xe1003092,  // swp r3, r2, [r0]
+                                     0xe5904000,  // ldr r4, [r0]
+                                     0xe1a0f00e   // mov pc, lr
+                                   }));
+
+  REQUIRE(TEST(system.registers[3] == 5));
+  REQUIRE(TEST(system.registers[4] == 9));
+}
+
+TEST_CASE("Cycle model follows the ARM7TDMI S, N and I cycle counts")
+{
+  CONSTEXPR auto system = run_cycle_program(false);
+
+  REQUIRE(TEST(system.registers[2] == 5));
+  REQUIRE(TEST(system.cycle_model.totals.sequential == 5));
+  REQUIRE(TEST(system.cycle_model.totals.non_sequential == 4));
+  REQUIRE(TEST(system.cycle_model.totals.internal == 1));
+  REQUIRE(TEST(system.estimated_cycles() == 10));
+  REQUIRE(TEST(system.cycles() == 5));
+}
+
+TEST_CASE("Cycle model charges wait states of the region accessed")
+{
+  CONSTEXPR auto system = run_cycle_program(true);
+
+  // the data accesses of the str and ldr are non-sequential
+  REQUIRE(TEST(system.cycle_model.totals.wait_states == 6));
+  REQUIRE(TEST(system.estimated_cycles() == 16));
+}
+
+TEST_CASE("Polling loop is skipped ahead to the next event")
+{
+  CONSTEXPR auto skipped  = run_poll_program(true);
+  CONSTEXPR auto executed = run_poll_program(false);
+
+  REQUIRE(TEST(skipped.registers[0] == 1));
+  REQUIRE(TEST(9000 < skipped.idle_loop.skipped_cycles));
+  REQUIRE(TEST(skipped.cycles() == executed.cycles()));
+  REQUIRE(TEST(skipped.instructions == executed.instructions));
+  REQUIRE(TEST(skipped.counters.loads == executed.counters.loads));
+  REQUIRE(TEST(skipped.counters.branches_taken == executed.counters.branches_taken));
+  REQUIRE(TEST(skipped.statistics.fetches() == executed.statistics.fetches()));
+  REQUIRE(TEST(skipped.statistics.mmio_accesses == executed.statistics.mmio_accesses));
+  REQUIRE(TEST(skipped.estimated_cycles() == executed.estimated_cycles()));
+  REQUIRE(TEST(executed.idle_loop.skipped_cycles == 0));
+  REQUIRE(TEST(0 < skipped.idle_loop.skipped_instructions));
+  REQUIRE(TEST(skipped.idle_loop.skipped_instructions < skipped.instructions));
+  REQUIRE(TEST(executed.idle_loop.skipped_instructions == 0));
+
+  // every load polls the device, instruction fetches of the same address are not counted
+  REQUIRE(TEST(executed.statistics.mmio_accesses == executed.counters.loads));
+}
+
+TEST_CASE("Lockstep finds the first block after which the engines differ")
+{
+  CONSTEXPR auto same             = run_lockstep_program(Perturbation::NONE);
+  CONSTEXPR auto changed_register = run_lockstep_program(Perturbation::REGISTER);
+  CONSTEXPR auto changed_memory   = run_lockstep_program(Perturbation::MEMORY);
+  CONSTEXPR auto returned_early   = run_lockstep_program(Perturbation::RETURN);
+
+  REQUIRE(TEST(!same));
+  REQUIRE(TEST(same.instructions == 2 + 16 * 4 + 1));
+
+  // the first block ends with the bne
+  REQUIRE(TEST(changed_register.difference == cpp_box::lockstep::Difference::REGISTER));
+  REQUIRE(TEST(changed_register.register_index == 5));
+  REQUIRE(TEST(changed_register.instructions == 6));
+  REQUIRE(TEST(changed_register.last_match == 0));
+  REQUIRE(TEST(changed_register.block_begin == 0));
+  REQUIRE(TEST(changed_register.block_last == 0x14));
+  REQUIRE(TEST(changed_register.block_words[2] == 0xe7c01001));
+
+  // memory is compared at the end only, the last block falls through the bne into the return
+  REQUIRE(TEST(changed_memory.difference == cpp_box::lockstep::Difference::MEMORY));
+  REQUIRE(TEST(changed_memory.instructions == same.instructions));
+  REQUIRE(TEST(changed_memory.block_begin == 0x08));
+  REQUIRE(TEST(changed_memory.block_last == 0x18));
+
+  // compared as soon as the candidate returned, even though the interval is not over
+  REQUIRE(TEST(returned_early.difference == cpp_box::lockstep::Difference::FINISHED));
+  REQUIRE(TEST(returned_early.expected == 0));
+  REQUIRE(TEST(returned_early.actual == 1));
+  REQUIRE(TEST(returned_early.instructions == 6));
+}
+
+TEST_CASE("Restored core state continues where it was captured")
+{
+  CONSTEXPR auto restored = run_restored_poll_program(5000);
+  CONSTEXPR auto executed = run_poll_program(false);
+
+  // the pending event was restored with the scheduler, otherwise the loop would poll forever
+  REQUIRE(TEST(restored.registers[0] == 1));
+  REQUIRE(TEST(restored.registers[15] == executed.registers[15]));
+  REQUIRE(TEST(restored.instructions == executed.instructions));
+  REQUIRE(TEST(restored.cycles() == executed.cycles()));
+  REQUIRE(TEST(restored.counters.loads == executed.counters.loads));
+  REQUIRE(TEST(restored.statistics.mmio_accesses == executed.statistics.mmio_accesses));
+  REQUIRE(TEST(restored.estimated_cycles() == executed.estimated_cycles()));
+}
+
 #endif
@@ -0,0 +1,1228 @@
+#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main()
+#include <catch2/catch.hpp>
+
+#include <cpp_box/arm.hpp>
+#include <cpp_box/cache.hpp>
+#include <cpp_box/coverage.hpp>
+#include <cpp_box/devices.hpp>
+#include <cpp_box/heatmap.hpp>
+#include <cpp_box/profiler.hpp>
+#include <cpp_box/smp.hpp>
+#include <cpp_box/snapshot.hpp>
+#include <cpp_box/trace.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Tests of the parts of the emulator that are not constexpr: host threads, devices and files
+
+using Machine = cpp_box::arm::System<64 * 1024, std::vector<std::uint8_t>, cpp_box::devices::Devices>;
+
+using cpp_box::system::Memory_Map;
+
+constexpr std::uint32_t address(const Memory_Map loc) noexcept { return static_cast<std::uint32_t>(loc); }
+
+// runs a `b .` loop until the cycle count advanced by cycles, which dispatches the device events due until then
+void spin(Machine &sys, const std::uint64_t cycles)
+{
+  const auto loop = address(Memory_Map::USER_RAM_START);
+  sys.write_word(loop, 0xeaff'fffe);
+  sys.setup_run(loop);
+  sys.run_until(sys.cycles() + cycles);
+}
+
+void start_dma(Machine &sys, const std::uint32_t source, const std::uint32_t destination, const std::uint32_t length, const bool fill)
+{
+  sys.write_word(address(Memory_Map::DMA_SOURCE), source);
+  sys.write_word(address(Memory_Map::DMA_DESTINATION), destination);
+  sys.write_word(address(Memory_Map::DMA_LENGTH), length);
+  sys.write_word(address(Memory_Map::DMA_CONTROL),
+                 static_cast<std::uint32_t>(cpp_box::system::Dma_Control::START)
+                   | (fill ? static_cast<std::uint32_t>(cpp_box::system::Dma_Control::FILL) : 0u));
+}
+
+// an 8x4 screen and a ring of 4 commands
+constexpr std::uint32_t screen_buffer = 0x8000;
+constexpr std::uint32_t blit_ring     = 0x4000;
+
+void setup_blitter(Machine &sys)
+{
+  sys.write_half_word(address(Memory_Map::SCREEN_WIDTH), 8);
+  sys.write_half_word(address(Memory_Map::SCREEN_HEIGHT), 4);
+  sys.write_word(address(Memory_Map::SCREEN_BUFFER), screen_buffer);
+  sys.write_word(address(Memory_Map::BLITTER_RING_BASE), blit_ring);
+  sys.write_word(address(Memory_Map::BLITTER_RING_SIZE), 4);
+}
+
+void blit(Machine &sys, const cpp_box::system::Blit_Command &command)
+{
+  const auto head = sys.read_word(address(Memory_Map::BLITTER_TAIL));
+  std::memcpy(&sys.builtin_ram[blit_ring + (head % 4) * sizeof(command)], &command, sizeof(command));
+  sys.write_word(address(Memory_Map::BLITTER_HEAD), head + 1);
+}
+
+[[nodiscard]] std::vector<std::uint8_t> read_file(const std::filesystem::path &path)
+{
+  std::ifstream file{ path, std::ios::binary };
+  return { std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+}
+
+void write_file(const std::filesystem::path &path, const std::vector<std::uint8_t> &bytes)
+{
+  std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+  file.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));  // NOLINT
+}
+
+// little endian value of a save state file
+[[nodiscard]] std::uint64_t get(const std::vector<std::uint8_t> &bytes, const std::size_t position, const std::size_t size)
+{
+  std::uint64_t value = 0;
+  for (std::size_t byte = 0; byte < size; ++byte) { value |= std::uint64_t{ bytes.at(position + byte) } << (byte * 8); }
+  return value;
+}
+
+// feeds a tracer the instructions a run would retire, as pairs of address and instruction word
+template<typename Tracer, typename System>
+void retire(Tracer &tracer, const System &sys, const std::vector<std::pair<std::uint32_t, std::uint32_t>> &instructions)
+{
+  for (const auto &[pc, word] : instructions) { tracer(sys, pc, cpp_box::arm::Instruction{ word }); }
+}
+
+// stall cycles of each access, as pairs of address and whether it writes
+[[nodiscard]] std::vector<std::uint32_t> stalls(cpp_box::cache::Cache &cache, const std::vector<std::pair<std::uint32_t, bool>> &accesses)
+{
+  std::vector<std::uint32_t> result;
+  for (const auto &[loc, write] : accesses) { result.push_back(cache.access(loc, write).stall); }
+  return result;
+}
+
+[[nodiscard]] std::uint32_t pixel(const Machine &sys, const std::uint32_t x, const std::uint32_t y)
+{
+  return sys.read_word(screen_buffer + (y * 8 + x) * 4);
+}
+
+TEST_CASE("Shared memory loads and stores are little endian and shared between copies")
+{
+  cpp_box::smp::Shared_Memory memory{ 64, 0 };
+  auto copy = memory;
+
+  memory.store<std::uint32_t>(8, 0x1234'5678);
+  REQUIRE(copy.load<std::uint32_t>(8) == 0x1234'5678);
+  REQUIRE(copy.load<std::uint16_t>(10) == 0x1234);
+  REQUIRE(copy[8] == 0x78);
+
+  // unaligned accesses are made of byte accesses
+  memory.store<std::uint32_t>(17, 0xaabb'ccdd);
+  REQUIRE(copy[17] == 0xdd);
+  REQUIRE(copy[20] == 0xaa);
+  REQUIRE(copy.load<std::uint32_t>(17) == 0xaabb'ccdd);
+  REQUIRE(copy.load<std::uint16_t>(19) == 0xaabb);
+}
+
+TEST_CASE("Guest stores to shared memory do not tear")
+{
+  using System = cpp_box::arm::System<1024, cpp_box::smp::Shared_Memory>;
+  System writer;
+  System reader{ cpp_box::arm::Existing_RAM{}, writer.builtin_ram };
+
+  constexpr std::uint32_t loc = 0x100;
+  std::atomic<bool> done{ false };
+  std::thread thread{ [&] {
+    for (std::uint32_t idx = 0; idx < 100'000; ++idx) { writer.write_word(loc, (idx & 1u) != 0 ? 0xffff'ffff : 0); }
+    done = true;
+  } };
+
+  bool torn = false;
+  while (!done) {
+    const auto value = reader.read_word(loc);
+    torn             = torn || (value != 0 && value != 0xffff'ffff);
+  }
+  thread.join();
+
+  REQUIRE(!torn);
+  REQUIRE(reader.read_word(loc) == 0xffff'ffff);
+}
+
+TEST_CASE("Secondary cores run on the memory of the boot core")
+{
+  using System = cpp_box::arm::System<64 * 1024, cpp_box::smp::Shared_Memory, cpp_box::devices::Devices>;
+
+  auto boot_core = std::make_unique<System>();
+  boot_core->write_word(0x100, 0x1234'5678);
+
+  std::vector<std::uint32_t> configured;
+  cpp_box::smp::Machine<System> machine{ std::move(boot_core), 3, [&](System & /*core*/, const std::uint32_t id) { configured.push_back(id); } };
+
+  REQUIRE(configured == std::vector<std::uint32_t>{ 1, 2 });
+  REQUIRE(machine.cores.size() == 3);
+  for (const auto &core : machine.cores) {
+    REQUIRE(core->builtin_ram.data() == machine.cores.front()->builtin_ram.data());
+    REQUIRE(core->read_word(0x100) == 0x1234'5678);
+  }
+}
+
+TEST_CASE("Sub word MMIO accesses address the lanes of a register")
+{
+  auto sys              = std::make_unique<Machine>();
+  const auto timer_load = address(Memory_Map::TIMER_0_LOAD);
+
+  sys->write_word(timer_load, 0x1122'3344);
+  REQUIRE(sys->read_byte(timer_load) == 0x44);
+  REQUIRE(sys->read_byte(timer_load + 3) == 0x11);
+  REQUIRE(sys->read_half_word(timer_load + 2) == 0x1122);
+
+  // writes to the upper lanes are ignored, the low lane writes the zero extended value
+  sys->write_byte(timer_load + 1, 0xff);
+  sys->write_half_word(timer_load + 2, 0xffff);
+  REQUIRE(sys->read_word(timer_load) == 0x1122'3344);
+
+  sys->write_byte(timer_load, 0x55);
+  REQUIRE(sys->read_word(timer_load) == 0x55);
+  sys->write_half_word(timer_load, 0x6677);
+  REQUIRE(sys->read_word(timer_load) == 0x6677);
+}
+
+TEST_CASE("Trace markers nest spans and end those left open inside of an ended one")
+{
+  using cpp_box::devices::Trace_Markers;
+
+  auto sys = std::make_unique<Machine>();
+  const auto &markers = sys->mmio_callback.trace_markers();
+  const auto mark     = [&](const Memory_Map reg, const std::uint32_t id, const std::uint64_t instructions) {
+    sys->instructions = instructions;
+    sys->write_word(address(reg), id);
+  };
+
+  constexpr std::uint32_t name = 0x3000;
+  for (std::uint32_t idx = 0; idx < 8; ++idx) { sys->write_byte(name + idx, static_cast<std::uint8_t>("physics"[idx])); }
+  sys->write_word(address(Memory_Map::TRACE_NAME_ID), 1);
+  sys->write_word(address(Memory_Map::TRACE_NAME), name);
+  REQUIRE(sys->read_word(address(Memory_Map::TRACE_NAME_ID)) == 1);
+  REQUIRE(markers.name(1) == "physics");
+  REQUIRE(markers.name(9) == "marker 9");
+
+  mark(Memory_Map::TRACE_BEGIN, 1, 10);
+  mark(Memory_Map::TRACE_BEGIN, 2, 20);
+  mark(Memory_Map::TRACE_BEGIN, 3, 30);
+  mark(Memory_Map::TRACE_END, 7, 40);
+  mark(Memory_Map::TRACE_END, 1, 50);
+  mark(Memory_Map::TRACE_BEGIN, 2, 60);
+  mark(Memory_Map::TRACE_END, 2, 70);
+
+  const auto spans = markers.spans();
+  REQUIRE(spans.size() == 4);
+  REQUIRE(spans[0].id == 3);
+  REQUIRE(spans[0].depth == 2);
+  REQUIRE(spans[0].begin_instruction == 30);
+  REQUIRE(spans[0].end_instruction == 50);
+  REQUIRE(spans[1].id == 2);
+  REQUIRE(spans[1].depth == 1);
+  REQUIRE(spans[2].id == 1);
+  REQUIRE(spans[2].depth == 0);
+  REQUIRE(spans[2].begin_instruction == 10);
+  REQUIRE(spans[2].end_time >= spans[2].begin_time);
+  REQUIRE(spans[3].id == 2);
+  REQUIRE(spans[3].depth == 0);
+  REQUIRE(spans[3].end_instruction == 70);
+
+  std::ostringstream trace;
+  cpp_box::devices::write_chrome_trace(trace, { &markers }, cpp_box::devices::Timeline::GUEST_INSTRUCTIONS);
+  REQUIRE(trace.str().find(R"({"name":"physics","ph":"X","pid":0,"tid":0,"ts":10,"dur":40,"args":{"instructions":40,"depth":0}})")
+          != std::string::npos);
+
+  // spans begun deeper than max_depth are not recorded
+  for (std::uint32_t id = 100; id <= 100 + Trace_Markers::max_depth; ++id) { mark(Memory_Map::TRACE_BEGIN, id, id); }
+  mark(Memory_Map::TRACE_END, 100 + Trace_Markers::max_depth, 200);
+  REQUIRE(markers.spans().size() == 4);
+  mark(Memory_Map::TRACE_END, 100, 200);
+  REQUIRE(markers.spans().size() == 4 + Trace_Markers::max_depth);
+}
+
+TEST_CASE("Random device lanes are xoshiro128++ and reproducible with a fixed seed")
+{
+  using cpp_box::devices::Random_Device;
+  constexpr std::size_t count = 1000;  // several refills
+
+  // scalar xoshiro128++ of lane 0, seeded from the first two values of splitmix64
+  std::uint64_t seed = 42;
+  const auto splitmix64 = [&seed] {
+    seed += 0x9E37'79B9'7F4A'7C15;
+    auto z = seed;
+    z      = (z ^ (z >> 30)) * 0xBF58'476D'1CE4'E5B9;
+    z      = (z ^ (z >> 27)) * 0x94D0'49BB'1331'11EB;
+    return z ^ (z >> 31);
+  };
+  const auto rotl = [](const std::uint32_t value, const int shift) { return (value << shift) | (value >> (32 - shift)); };
+
+  std::array<std::uint32_t, 4> lane_state{};
+  for (std::size_t word = 0; word < lane_state.size(); word += 2) {
+    const auto value     = splitmix64();
+    lane_state[word]     = static_cast<std::uint32_t>(value);
+    lane_state[word + 1] = static_cast<std::uint32_t>(value >> 32);
+  }
+  const auto next = [&] {
+    auto &[s0, s1, s2, s3] = lane_state;
+    const auto result      = rotl(s0 + s3, 7) + s0;
+    const auto t           = s1 << 9;
+    s2 ^= s0;
+    s3 ^= s1;
+    s1 ^= s2;
+    s0 ^= s3;
+    s2 ^= t;
+    s3 = rotl(s3, 11);
+    return result;
+  };
+
+  Random_Device device{ 42 };
+  std::vector<std::uint32_t> values;
+  for (std::size_t idx = 0; idx < count; ++idx) { values.push_back(device.read()); }
+
+  // the lanes are interleaved in the buffer
+  bool lane_matches = true;
+  for (std::size_t idx = 0; idx < count; idx += Random_Device::lanes) { lane_matches = lane_matches && values[idx] == next(); }
+  REQUIRE(lane_matches);
+
+  Random_Device same{ 42 };
+  Random_Device other{ 43 };
+  bool same_values  = true;
+  bool other_values = true;
+  for (std::size_t idx = 0; idx < count; ++idx) {
+    const auto value = values[idx];
+    same_values      = same_values && same.read() == value;
+    other_values     = other_values && other.read() == value;
+  }
+  REQUIRE(same_values);
+  REQUIRE(!other_values);
+
+  // reseeding starts the sequence over, a restored state continues it in the middle of a buffer
+  device.reseed(42);
+  REQUIRE(device.read() == values[0]);
+  const auto state = device.save_state();
+  Random_Device restored{ 7 };
+  REQUIRE(restored.restore_state(state));
+  REQUIRE(restored.read() == values[1]);
+  REQUIRE(!restored.restore_state({ 1, 2, 3 }));
+
+  // the register reads the same values
+  auto sys = std::make_unique<Machine>();
+  sys->mmio_callback.random().reseed(42);
+  REQUIRE(sys->read_word(address(Memory_Map::RANDOM_DEVICE)) == values[0]);
+  REQUIRE(sys->read_word(address(Memory_Map::RANDOM_DEVICE)) == values[1]);
+}
+
+TEST_CASE("Device bus maps the registers of each device and nothing else")
+{
+  const cpp_box::devices::Devices devices;
+
+  REQUIRE(devices.is_mmio_range(address(Memory_Map::RANDOM_DEVICE)));
+  REQUIRE(devices.is_mmio_range(address(Memory_Map::DMA_STATUS) + 3));
+  REQUIRE(devices.is_mmio_range(address(Memory_Map::TRACE_NAME)));
+  REQUIRE(devices.bus.find(address(Memory_Map::DMA_SOURCE))->device == &devices.dma());
+  REQUIRE(devices.bus.find(address(Memory_Map::BLITTER_TAIL))->device == &devices.blitter());
+
+  // plain RAM between and after the devices
+  REQUIRE(!devices.is_mmio_range(address(Memory_Map::SCREEN_WIDTH)));
+  REQUIRE(!devices.is_mmio_range(address(Memory_Map::IRQ_HANDLER)));
+  REQUIRE(!devices.is_mmio_range(address(Memory_Map::TRACE_NAME) + 4));
+  REQUIRE(!devices.is_mmio_range(address(Memory_Map::USER_RAM_START)));
+}
+
+TEST_CASE("DMA copies and fills RAM and raises its interrupt on completion")
+{
+  using cpp_box::system::Dma_Status;
+  constexpr auto dma_interrupt = static_cast<std::uint32_t>(cpp_box::system::Interrupt_Source::DMA);
+
+  auto sys = std::make_unique<Machine>();
+  for (std::uint32_t idx = 0; idx < 64; ++idx) { sys->write_byte(0x3000 + idx, static_cast<std::uint8_t>(idx + 1)); }
+
+  // the copy is done at once, completion is signalled after length / bytes_per_cycle cycles
+  start_dma(*sys, 0x3000, 0x3100, 64, false);
+  REQUIRE(sys->read_word(address(Memory_Map::DMA_STATUS)) == static_cast<std::uint32_t>(Dma_Status::BUSY));
+  REQUIRE(sys->read_byte(0x3100) == 1);
+  REQUIRE(sys->read_byte(0x3100 + 63) == 64);
+  REQUIRE(sys->read_byte(0x3100 + 64) == 0);
+  REQUIRE((sys->read_word(address(Memory_Map::INTERRUPT_STATUS)) & dma_interrupt) == 0);
+
+  spin(*sys, 64 / cpp_box::devices::Dma::bytes_per_cycle + 1);
+  REQUIRE(sys->read_word(address(Memory_Map::DMA_STATUS)) == 0);
+  REQUIRE((sys->read_word(address(Memory_Map::INTERRUPT_STATUS)) & dma_interrupt) != 0);
+  sys->write_word(address(Memory_Map::INTERRUPT_STATUS), dma_interrupt);
+
+  // the fill pattern repeats on word boundaries of the destination
+  start_dma(*sys, 0x1122'3344, 0x3201, 6, true);
+  REQUIRE(sys->read_byte(0x3200) == 0);
+  REQUIRE(sys->read_byte(0x3201) == 0x33);
+  REQUIRE(sys->read_half_word(0x3202) == 0x1122);
+  REQUIRE(sys->read_word(0x3204) == 0x0022'3344);
+
+  start_dma(*sys, 0xabab'abab, 0x3300, 5, true);
+  REQUIRE(sys->read_word(0x3300) == 0xabab'abab);
+  REQUIRE(sys->read_word(0x3304) == 0xab);
+  spin(*sys, 2);
+  sys->write_word(address(Memory_Map::INTERRUPT_STATUS), dma_interrupt);
+
+  // transfers not entirely inside of RAM are not done and do not complete
+  start_dma(*sys, 0x3000, 64 * 1024 - 8, 16, false);
+  REQUIRE(sys->read_word(address(Memory_Map::DMA_STATUS)) == static_cast<std::uint32_t>(Dma_Status::ERROR));
+  REQUIRE(sys->read_word(64 * 1024 - 8) == 0);
+
+  start_dma(*sys, 0xffff'0000, 0x3400, 16, false);
+  REQUIRE(sys->read_word(address(Memory_Map::DMA_STATUS)) == static_cast<std::uint32_t>(Dma_Status::ERROR));
+
+  spin(*sys, 100);
+  REQUIRE((sys->read_word(address(Memory_Map::INTERRUPT_STATUS)) & dma_interrupt) == 0);
+}
+
+TEST_CASE("Blitter fills, copies, blends and scales rectangles clipped to the screen")
+{
+  using cpp_box::system::Blit_Operation;
+  constexpr std::uint32_t background = 0xff10'2030;
+  constexpr std::uint32_t key        = 0xff00'ff00;
+
+  auto sys = std::make_unique<Machine>();
+  setup_blitter(*sys);
+
+  blit(*sys, { Blit_Operation::FILL_RECT, 0, background, 0, 0, 0, 0, -2, -1, 4, 3, 0 });
+  REQUIRE(pixel(*sys, 0, 0) == background);
+  REQUIRE(pixel(*sys, 1, 1) == background);
+  REQUIRE(pixel(*sys, 2, 0) == 0);
+  REQUIRE(pixel(*sys, 0, 2) == 0);
+
+  blit(*sys, { Blit_Operation::FILL_RECT, 0, 0xffff'ffff, 0, 0, 0, 0, 6, 3, 10, 5, 0 });
+  REQUIRE(pixel(*sys, 5, 3) == 0);
+  REQUIRE(pixel(*sys, 6, 3) == 0xffff'ffff);
+  REQUIRE(pixel(*sys, 7, 3) == 0xffff'ffff);
+  REQUIRE(sys->read_word(screen_buffer + 8 * 4 * 4) == 0);
+
+  // row 0 gets A, key, B, key over the background
+  constexpr std::uint32_t image = 0x5000;
+  const std::array<std::uint32_t, 4> row{ 0xff00'00aa, key, 0xff00'00bb, key };
+  for (std::uint32_t idx = 0; idx < row.size(); ++idx) { sys->write_word(image + idx * 4, row[idx]); }
+  blit(*sys, { Blit_Operation::COPY_RECT, static_cast<std::uint16_t>(cpp_box::system::Blit_Flags::COLOR_KEY), image, key, 4, 4, 1, 0, 0, 4, 1, 0 });
+  REQUIRE(pixel(*sys, 0, 0) == 0xff00'00aa);
+  REQUIRE(pixel(*sys, 1, 0) == background);
+  REQUIRE(pixel(*sys, 2, 0) == 0xff00'00bb);
+  REQUIRE(pixel(*sys, 3, 0) == 0);
+
+  // opaque source pixels replace the screen, transparent ones keep it
+  sys->write_word(image + 16, 0xff00'00cc);
+  sys->write_word(image + 20, 0x0000'00dd);
+  blit(*sys, { Blit_Operation::BLEND_RECT, 0, image + 16, 0, 2, 2, 1, 0, 1, 2, 1, 0 });
+  REQUIRE(pixel(*sys, 0, 1) == 0xff00'00cc);
+  REQUIRE(pixel(*sys, 1, 1) == background);
+
+  // 2x2 source to 4x4 at the right edge, half of it is clipped
+  for (std::uint32_t idx = 0; idx < 4; ++idx) { sys->write_word(image + 32 + idx * 4, 0xff00'0001 + idx); }
+  blit(*sys, { Blit_Operation::SCALED_BLIT, 0, image + 32, 0, 2, 2, 2, 6, 0, 4, 4, 0 });
+  REQUIRE(pixel(*sys, 6, 0) == 0xff00'0001);
+  REQUIRE(pixel(*sys, 7, 1) == 0xff00'0001);
+  REQUIRE(pixel(*sys, 6, 2) == 0xff00'0003);
+  REQUIRE(pixel(*sys, 7, 3) == 0xff00'0003);
+  REQUIRE(pixel(*sys, 5, 0) == 0);
+}
+
+TEST_CASE("Blitter ignores heads further ahead than the ring")
+{
+  auto sys = std::make_unique<Machine>();
+  setup_blitter(*sys);
+
+  const auto head = address(Memory_Map::BLITTER_HEAD);
+  const auto tail = address(Memory_Map::BLITTER_TAIL);
+
+  sys->write_word(head, 5);
+  REQUIRE(sys->read_word(tail) == 0);
+
+  // behind the tail
+  sys->write_word(head, 3);
+  REQUIRE(sys->read_word(tail) == 3);
+  sys->write_word(head, 2);
+  REQUIRE(sys->read_word(tail) == 3);
+
+  // indexes are free running, a full ring may wrap around 2^32
+  sys->write_word(head, 7);
+  REQUIRE(sys->read_word(tail) == 7);
+
+  sys->write_word(address(Memory_Map::BLITTER_RING_SIZE), 0);
+  sys->write_word(head, 8);
+  REQUIRE(sys->read_word(tail) == 7);
+}
+
+TEST_CASE("PMU cycles are the estimate of the cycle model when it is enabled")
+{
+  const auto pmu_cycles = [](Machine &sys) {
+    const auto low = sys.read_word(address(Memory_Map::PMU_CYCLES));
+    return std::uint64_t{ low } | (std::uint64_t{ sys.read_word(address(Memory_Map::PMU_CYCLES) + 4) } << 32);
+  };
+  const auto enable_pmu = static_cast<std::uint32_t>(cpp_box::system::Pmu_Control::ENABLE);
+
+  auto sys = std::make_unique<Machine>();
+  sys->write_word(address(Memory_Map::PMU_CONTROL), enable_pmu);
+  spin(*sys, 100);
+  REQUIRE(pmu_cycles(*sys) == sys->cycles());
+
+  // a taken branch is 2S + 1N
+  auto modelled                 = std::make_unique<Machine>();
+  modelled->cycle_model.enabled = true;
+  modelled->write_word(address(Memory_Map::PMU_CONTROL), enable_pmu);
+  spin(*modelled, 100);
+  REQUIRE(pmu_cycles(*modelled) == modelled->estimated_cycles());
+  REQUIRE(pmu_cycles(*modelled) == modelled->instructions * 3);
+}
+
+TEST_CASE("Trace records read back as written")
+{
+  using Traced = cpp_box::arm::
+    System<1024, std::array<std::uint8_t, 1024>, cpp_box::arm::NO_MMIO, cpp_box::arm::NO_COPROCESSOR, cpp_box::trace::Access_Observer>;
+
+  const std::array<std::uint32_t, 7> program{
+    0xe3a00c01,  // mov r0, #0x100
+    0xe8900006,  // ldmia r0, {r1, r2}
+    0xe5801008,  // str r1, [r0, #8]
+    0xea000000,  // b 0x14
+    0xe3a03001,  // mov r3, #1
+    0xe3b04000,  // movs r4, #0
+    0xe1a0f00e   // mov pc, lr
+  };
+
+  auto sys = std::make_unique<Traced>();
+  for (std::uint32_t idx = 0; idx < program.size(); ++idx) { sys->write_word(idx * 4, program[idx]); }
+  sys->write_word(0x100, 0x1111'1111);
+  sys->write_word(0x104, 0x2222'2222);
+  sys->i_cache.fill_cache(*sys);
+
+  const auto path = std::filesystem::temp_directory_path() / "cpp_box_runtime_tests.trace";
+  {
+    cpp_box::trace::Writer writer{ path, true };
+    sys->memory_observer.writer = &writer;
+    sys->run(0, writer);
+    writer.finish(*sys);
+    REQUIRE(writer.records == 6);
+  }
+
+  std::ifstream is{ path, std::ios::binary };
+  cpp_box::trace::Reader reader{ is };
+  REQUIRE(reader.memory_accesses());
+
+  std::vector<cpp_box::trace::Record> records;
+  for (cpp_box::trace::Record record; reader.next(record);) { records.push_back(record); }
+  std::filesystem::remove(path);
+
+  REQUIRE(records.size() == 6);
+  REQUIRE(records[0].pc == 0);
+  REQUIRE(records[0].registers[0] == 0x100);
+  REQUIRE((records[0].changed & 1u) != 0);
+  REQUIRE(records[0].accesses.empty());
+
+  REQUIRE(records[1].pc == 4);
+  REQUIRE(records[1].changed == 0b110);
+  REQUIRE(records[1].registers[1] == 0x1111'1111);
+  REQUIRE(records[1].registers[2] == 0x2222'2222);
+  REQUIRE(records[1].accesses.size() == 2);
+  REQUIRE(records[1].accesses[0].address == 0x100);
+  REQUIRE(records[1].accesses[1].address == 0x104);
+  REQUIRE(records[1].accesses[1].size == 4);
+  REQUIRE(!records[1].accesses[1].write);
+
+  REQUIRE(records[2].pc == 8);
+  REQUIRE(records[2].changed == 0);
+  REQUIRE(records[2].accesses.size() == 1);
+  REQUIRE(records[2].accesses[0].address == 0x108);
+  REQUIRE(records[2].accesses[0].write);
+
+  // the branch skips 0x10
+  REQUIRE(records[3].pc == 0xc);
+  REQUIRE(records[4].pc == 0x14);
+  REQUIRE(records[4].changed == 0x8000);
+  REQUIRE(records[4].registers[15] == sys->CSPR);
+  REQUIRE(records[4].registers[3] == 0);
+
+  REQUIRE(records[5].pc == 0x18);
+  REQUIRE(records[5].registers[2] == 0x2222'2222);
+}
+
+TEST_CASE("Trace seeks from the closest keyframe")
+{
+  using Traced = cpp_box::arm::System<1024>;
+
+  const std::array<std::uint32_t, 5> program{
+    0xe3a00000,  // mov r0, #0
+    0xe2800001,  // add r0, r0, #1
+    0xe3500803,  // cmp r0, #0x30000
+    0x1afffffc,  // bne 4
+    0xe1a0f00e   // mov pc, lr
+  };
+
+  auto sys = std::make_unique<Traced>();
+  for (std::uint32_t idx = 0; idx < program.size(); ++idx) { sys->write_word(idx * 4, program[idx]); }
+  sys->i_cache.fill_cache(*sys);
+
+  const auto path = std::filesystem::temp_directory_path() / "cpp_box_runtime_tests_keyframes.trace";
+  std::uint64_t records = 0;
+  {
+    cpp_box::trace::Writer writer{ path, false, 4096 };
+    sys->run(0, writer);
+    writer.finish(*sys);
+    records = writer.records;
+  }
+  REQUIRE(records == 3 * 0x30000 + 2);
+
+  const std::array<std::uint64_t, 6> indexes{ 0, 1, cpp_box::trace::keyframe_interval - 1, cpp_box::trace::keyframe_interval, 300'001, records - 1 };
+  std::vector<cpp_box::trace::Record> expected;
+  {
+    std::ifstream is{ path, std::ios::binary };
+    cpp_box::trace::Reader reader{ is };
+    cpp_box::trace::Record record;
+    for (std::uint64_t index = 0; reader.next(record); ++index) {
+      if (std::find(indexes.begin(), indexes.end(), index) != indexes.end()) { expected.push_back(record); }
+    }
+  }
+  REQUIRE(expected.size() == indexes.size());
+
+  // backwards too, from the end of the trace
+  std::ifstream is{ path, std::ios::binary };
+  cpp_box::trace::Reader reader{ is };
+  for (std::size_t idx = indexes.size(); idx-- > 0;) {
+    auto index = reader.seek(indexes[idx]);
+    REQUIRE(index == indexes[idx] / cpp_box::trace::keyframe_interval * cpp_box::trace::keyframe_interval);
+
+    cpp_box::trace::Record record;
+    bool read = true;
+    while (index++ <= indexes[idx]) { read = read && reader.next(record); }
+    REQUIRE(read);
+    REQUIRE(record.pc == expected[idx].pc);
+    REQUIRE(record.changed == expected[idx].changed);
+    REQUIRE(record.registers == expected[idx].registers);
+  }
+
+  // the keyframe table after the end is not read as records
+  cpp_box::trace::Record record;
+  auto index = reader.seek(records - 1);
+  while (reader.next(record)) { ++index; }
+  REQUIRE(index == records);
+  REQUIRE(record.pc == 0x10);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Save states restore RAM, registers and devices")
+{
+  const auto timer_control = static_cast<std::uint32_t>(cpp_box::system::Timer_Control::ENABLE)
+                             | static_cast<std::uint32_t>(cpp_box::system::Timer_Control::PERIODIC);
+  const auto user_ram = address(Memory_Map::USER_RAM_START);
+
+  // the `b .` loop of spin and data after it
+  const std::array<std::uint8_t, 8> image_bytes{ 0xfe, 0xff, 0xff, 0xea, 1, 2, 3, 4 };
+  const cpp_box::snapshot::Image image{ image_bytes.data(), image_bytes.size() };
+
+  auto sys = std::make_unique<Machine>();
+  for (std::uint32_t idx = 0; idx < image_bytes.size(); ++idx) { sys->write_byte(user_ram + idx, image_bytes[idx]); }
+
+  // a periodic timer and a DMA transfer, both with their next event pending
+  sys->write_word(address(Memory_Map::TIMER_0_LOAD), 300);
+  sys->write_word(address(Memory_Map::TIMER_0_CONTROL), timer_control);
+  spin(*sys, 1000);
+  start_dma(*sys, 0x5a5a'5a5a, 0x3000, 4096, true);
+  sys->write_byte(user_ram + 5, 0x20);
+  for (std::uint32_t reg = 0; reg < 13; ++reg) { sys->registers[reg] = reg * 0x1111'1111; }
+
+  const auto path = std::filesystem::temp_directory_path() / "cpp_box_runtime_tests.state";
+  cpp_box::snapshot::save(path, *sys, image);
+
+  auto restored = std::make_unique<Machine>();
+  cpp_box::snapshot::load(path, *restored, image);
+  std::filesystem::remove(path);
+
+  REQUIRE(restored->builtin_ram == sys->builtin_ram);
+  REQUIRE(restored->registers == sys->registers);
+  REQUIRE(restored->CSPR == sys->CSPR);
+  REQUIRE(restored->cycles() == sys->cycles());
+  REQUIRE(restored->instructions == sys->instructions);
+  REQUIRE(restored->mmio_callback.save_state() == sys->mmio_callback.save_state());
+  REQUIRE(restored->read_word(address(Memory_Map::TIMER_0_VALUE)) == sys->read_word(address(Memory_Map::TIMER_0_VALUE)));
+  REQUIRE(restored->read_word(address(Memory_Map::DMA_STATUS)) == static_cast<std::uint32_t>(cpp_box::system::Dma_Status::BUSY));
+
+  // the pending events were restored with the scheduler, both machines go on the same way
+  spin(*sys, 1000);
+  spin(*restored, 1000);
+  REQUIRE(restored->read_word(address(Memory_Map::DMA_STATUS)) == 0);
+  REQUIRE(restored->read_word(address(Memory_Map::INTERRUPT_STATUS)) == sys->read_word(address(Memory_Map::INTERRUPT_STATUS)));
+  REQUIRE(restored->read_word(address(Memory_Map::INTERRUPT_STATUS)) != 0);
+  REQUIRE(restored->builtin_ram == sys->builtin_ram);
+  REQUIRE(restored->cycles() == sys->cycles());
+  REQUIRE(restored->mmio_callback.save_state() == sys->mmio_callback.save_state());
+
+  // devices are restored all or nothing, and only from the state of the same devices
+  auto devices = sys->mmio_callback.save_state();
+  cpp_box::devices::Devices fresh;
+  REQUIRE(fresh.restore_state(devices));
+  REQUIRE(fresh.save_state() == devices);
+
+  cpp_box::devices::Devices other;
+  const auto initial = other.save_state();
+  devices.back().push_back(0);
+  REQUIRE(!other.restore_state(devices));
+  devices.pop_back();
+  REQUIRE(!other.restore_state(devices));
+  REQUIRE(other.save_state() == initial);
+}
+
+TEST_CASE("Save states with events of no device or of an unjoined core do not crash")
+{
+  auto sys = std::make_unique<Machine>();
+  auto state = cpp_box::snapshot::capture(*sys);
+
+  // Core_Registers only schedules events once the core joined a multi core machine
+  const auto core_registers = sys->mmio_callback.bus.find(address(Memory_Map::CORE_ID))->index;
+  state.core.event_count    = 2;
+  state.core.events[0]      = { sys->cycles() + 10, core_registers << 16 };
+  state.core.events[1]      = { sys->cycles() + 20, 0xffffu << 16 };
+
+  auto restored = std::make_unique<Machine>();
+  cpp_box::snapshot::restore(*restored, state);
+  spin(*restored, 100);
+  REQUIRE(restored->read_word(address(Memory_Map::INTERRUPT_STATUS)) == 0);
+}
+
+TEST_CASE("Save states store the pages that differ from the image as runs of changed bytes")
+{
+  using cpp_box::snapshot::page_size;
+  constexpr std::size_t ram_size   = 8 * page_size;
+  constexpr std::size_t page_count = 44;  // offset of the header's stored page count
+
+  const auto user_ram = address(Memory_Map::USER_RAM_START);
+  std::vector<std::uint8_t> image_bytes(page_size + 100);
+  for (std::size_t idx = 0; idx < image_bytes.size(); ++idx) { image_bytes[idx] = static_cast<std::uint8_t>(idx * 7 + 1); }
+  const cpp_box::snapshot::Image image{ image_bytes.data(), image_bytes.size() };
+
+  std::vector<std::uint8_t> ram(ram_size);
+  std::copy(image_bytes.begin(), image_bytes.end(), ram.begin() + user_ram);
+
+  const auto path = std::filesystem::temp_directory_path() / "cpp_box_runtime_tests_pages.state";
+  const auto round_trip = [&] {
+    cpp_box::snapshot::write(path, cpp_box::snapshot::State{}, ram.data(), ram.size(), image);
+    std::vector<std::uint8_t> loaded(ram_size, 0xcc);
+    static_cast<void>(cpp_box::snapshot::read(path, loaded.data(), loaded.size(), image));
+    return loaded;
+  };
+
+  // RAM as loaded stores no pages
+  REQUIRE(round_trip() == ram);
+  const auto unchanged = read_file(path);
+  REQUIRE(get(unchanged, page_count, 4) == 0);
+
+  // a single byte costs a run header and the byte, and one for the zeros after it
+  ram[page_size * 5 + 100] = 0x42;
+  REQUIRE(round_trip() == ram);
+  const auto sparse = read_file(path);
+  REQUIRE(get(sparse, page_count, 4) == 1);
+  REQUIRE(sparse.size() == unchanged.size() + 16 + 4 + 1 + 4);
+
+  // changes to the image, to its original values and short runs of zeros inside of literals
+  ram[user_ram + 10] = 0;
+  ram[user_ram + 11] = image_bytes[11];
+  ram[user_ram + 12] = static_cast<std::uint8_t>(~image_bytes[12]);
+  ram[user_ram + 14] = static_cast<std::uint8_t>(~image_bytes[14]);
+  ram[user_ram + page_size + 99] ^= 0x80;
+  ram[user_ram + page_size + 100] = 0xff;
+  REQUIRE(round_trip() == ram);
+  REQUIRE(get(read_file(path), page_count, 4) == 3);
+
+  // a page without zeros in its delta is one literal run
+  for (std::size_t idx = 0; idx < page_size; ++idx) { ram[page_size * 7 + idx] = static_cast<std::uint8_t>(idx % 255 + 1); }
+  REQUIRE(round_trip() == ram);
+  REQUIRE(get(read_file(path), page_count, 4) == 4);
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Save states of other machines and damaged save states are rejected")
+{
+  using cpp_box::snapshot::page_size;
+  constexpr std::size_t ram_size = 4 * page_size;
+
+  const std::array<std::uint8_t, 4> image_bytes{ 1, 2, 3, 4 };
+  const cpp_box::snapshot::Image image{ image_bytes.data(), image_bytes.size() };
+
+  // one stored page, without devices
+  std::vector<std::uint8_t> ram(ram_size);
+  ram[page_size + 8] = 0x42;
+
+  const auto path = std::filesystem::temp_directory_path() / "cpp_box_runtime_tests_damaged.state";
+  cpp_box::snapshot::write(path, cpp_box::snapshot::State{}, ram.data(), ram.size(), image);
+  const auto saved = read_file(path);
+
+  const auto rejected = [&](const std::vector<std::uint8_t> &bytes) {
+    write_file(path, bytes);
+    std::vector<std::uint8_t> loaded(ram_size);
+    try {
+      static_cast<void>(cpp_box::snapshot::read(path, loaded.data(), loaded.size(), image));
+    } catch (const std::runtime_error &) {
+      return true;
+    }
+    return false;
+  };
+
+  REQUIRE(!rejected(saved));
+
+  std::vector<std::uint8_t> other_ram(ram_size / 2);
+  REQUIRE_THROWS_AS(cpp_box::snapshot::read(path, other_ram.data(), other_ram.size(), image), std::runtime_error);
+
+  const std::array<std::uint8_t, 4> other_image_bytes{ 1, 2, 3, 5 };
+  REQUIRE_THROWS_AS(cpp_box::snapshot::read(path, ram.data(), ram.size(), cpp_box::snapshot::Image{ other_image_bytes.data(), 4 }),
+                    std::runtime_error);
+
+  auto not_a_state = saved;
+  not_a_state[0] = 'X';
+  REQUIRE(rejected(not_a_state));
+
+  // anywhere in the header, the core, the page table and the page data
+  bool truncated = true;
+  for (std::size_t size = 0; size < saved.size(); size += 7) {
+    truncated = truncated && rejected(std::vector<std::uint8_t>(saved.begin(), saved.begin() + static_cast<std::ptrdiff_t>(size)));
+  }
+  REQUIRE(truncated);
+  REQUIRE(rejected(std::vector<std::uint8_t>(saved.begin(), saved.end() - 1)));
+
+  // the page table follows the core's values
+  const auto entry = 48 + get(saved, 32, 4) * 8;
+  const auto data  = get(saved, entry + 8, 8);
+  REQUIRE(get(saved, entry, 4) == 1);
+
+  auto page_outside = saved;
+  page_outside[entry] = 4;
+  REQUIRE(rejected(page_outside));
+
+  // a run of zeros past the end of the page
+  auto long_run = saved;
+  long_run[data]     = 0xff;
+  long_run[data + 1] = 0xff;
+  REQUIRE(rejected(long_run));
+
+  // literals past the end of the page data
+  auto long_literals = saved;
+  long_literals[data + 2] = 0xff;
+  REQUIRE(rejected(long_literals));
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Sampling profiler samples every interval'th instruction and sums the samples per line and function")
+{
+  const cpp_box::arm::System<> sys{};
+  const auto user_ram = address(Memory_Map::USER_RAM_START);
+
+  cpp_box::Loaded_Files files;
+  files.location_data[0] = cpp_box::Memory_Location{ "add r0, r0, #1", "src/loop.cpp", 7, ".text", "loop:" };
+  files.location_data[4] = cpp_box::Memory_Location{ "b 0x00001000", "src/loop.cpp", 7, ".text", "loop:" };
+
+  // three iterations of the loop, then instructions without location data
+  cpp_box::profiler::Sampling_Profiler profiler{ 3 };
+  retire(profiler,
+         sys,
+         { { user_ram, 0xe2800001 },
+           { user_ram + 4, 0xeafffffd },
+           { user_ram, 0xe2800001 },
+           { user_ram + 4, 0xeafffffd },
+           { user_ram, 0xe2800001 },
+           { user_ram + 4, 0xeafffffd },
+           { user_ram + 0x100, 0xe1a00000 },
+           { user_ram + 0x104, 0xe1a00000 },
+           { user_ram + 0x108, 0xe1a00000 },
+           { user_ram + 0x10c, 0xe1a00000 } });
+
+  REQUIRE(profiler.samples == 3);
+  REQUIRE(profiler.hits.size() == 3);
+  REQUIRE(profiler.hits.at(0) == 1);
+  REQUIRE(profiler.hits.at(4) == 1);
+  REQUIRE(profiler.hits.at(0x108) == 1);
+  REQUIRE(profiler.countdown == 2);
+
+  const auto profile = cpp_box::profiler::summarize(profiler, files);
+  REQUIRE(profile.samples == 3);
+  REQUIRE(profile.interval == 3);
+  REQUIRE(profile.functions.size() == 2);
+  REQUIRE(profile.functions[0].name == "loop");
+  REQUIRE(profile.functions[0].samples == 2);
+  REQUIRE(profile.functions[1].name == "<unknown>");
+  REQUIRE(profile.lines.size() == 2);
+  REQUIRE(profile.lines[0].name == "loop.cpp:7");
+  REQUIRE(profile.lines[0].samples == 2);
+  REQUIRE(profile.instructions.size() == 3);
+  REQUIRE(profile.instructions[0].name == "0x00001000  add r0, r0, #1");
+  REQUIRE(profile.instructions[2].name == "0x00001108");
+
+  const auto samples = cpp_box::profiler::line_samples(profiler, files, "src/loop.cpp");
+  REQUIRE(samples.size() == 1);
+  REQUIRE(samples.at(7) == 2);
+
+  std::ostringstream report;
+  cpp_box::profiler::write_report(report, profile);
+  REQUIRE(report.str().rfind("Samples: 3 (one every 3 instructions)\n", 0) == 0);
+  REQUIRE(report.str().find("\nFunctions\n   self%    samples\n   66.67          2  loop\n   33.33          1  <unknown>\n") != std::string::npos);
+
+  profiler.reset();
+  REQUIRE(profiler.samples == 0);
+  REQUIRE(profiler.hits.empty());
+  REQUIRE(profiler.countdown == 3);
+}
+
+TEST_CASE("Call graph profiler unwinds returns that skip frames")
+{
+  const cpp_box::arm::System<> sys{};
+
+  constexpr std::uint32_t nop       = 0xe1a00000;
+  constexpr std::uint32_t bl        = 0xeb0003fd;
+  constexpr std::uint32_t mov_pc_lr = 0xe1a0f00e;
+  constexpr std::uint32_t mov_lr_pc = 0xe1a0e00f;
+  constexpr std::uint32_t mov_pc_r4 = 0xe1a0f004;
+  constexpr std::uint32_t ldm_r4_pc = 0xe8bd8010;
+
+  // main calls f, which calls g, main calls f again, which calls h, and h returns straight to main
+  cpp_box::profiler::Call_Graph_Profiler profiler;
+  retire(profiler,
+         sys,
+         { { 0x1000, nop },
+           { 0x1004, bl },
+           { 0x2000, nop },
+           { 0x2004, bl },
+           { 0x3000, nop },
+           { 0x3004, mov_pc_lr },
+           { 0x2008, mov_pc_lr },
+           { 0x1008, mov_lr_pc },
+           { 0x100c, mov_pc_r4 },
+           { 0x2000, nop },
+           { 0x2004, bl },
+           { 0x4000, ldm_r4_pc },
+           { 0x1010, nop } });
+
+  const auto &nodes = profiler.nodes;
+  REQUIRE(nodes.size() == 4);
+  REQUIRE(nodes[0].function == 0x1000);
+  REQUIRE(nodes[0].self == 5);
+  REQUIRE(nodes[1].function == 0x2000);
+  REQUIRE(nodes[1].parent == 0);
+  REQUIRE(nodes[1].self == 5);
+  REQUIRE(nodes[2].function == 0x3000);
+  REQUIRE(nodes[2].parent == 1);
+  REQUIRE(nodes[2].self == 2);
+  REQUIRE(nodes[3].function == 0x4000);
+  REQUIRE(nodes[3].parent == 1);
+  REQUIRE(nodes[3].self == 1);
+  REQUIRE(nodes[1].children == std::vector<std::uint32_t>{ 2, 3 });
+  REQUIRE(profiler.inclusive() == std::vector<std::uint64_t>{ 13, 8, 2, 1 });
+
+  const std::map<std::uint32_t, std::string> symbols{ { 0x1000, "main" }, { 0x2000, "f" }, { 0x3000, "g" }, { 0x4000, "h" } };
+
+  std::ostringstream folded;
+  cpp_box::profiler::write_folded_stacks(folded, profiler, symbols);
+  REQUIRE(folded.str() == "main 5\nmain;f 5\nmain;f;g 2\nmain;f;h 1\n");
+
+  // hottest callees first
+  std::ostringstream tree;
+  cpp_box::profiler::write_call_tree(tree, profiler, symbols);
+  REQUIRE(tree.str()
+          == "  inclusive%   inclusive   exclusive  function\n"
+             "     100.00%          13           5  main\n"
+             "      61.54%           8           5    f\n"
+             "      15.38%           2           2      g\n"
+             "       7.69%           1           1      h\n");
+
+  profiler.reset();
+  REQUIRE(profiler.nodes.empty());
+}
+
+TEST_CASE("Call graph profiler counts calls deeper than max_depth in the deepest frame")
+{
+  const cpp_box::arm::System<> sys{};
+  constexpr auto max_depth = cpp_box::profiler::Call_Graph_Profiler::max_depth;
+
+  // runaway recursion 2000 calls deep, then returning from 977 of them
+  std::vector<std::pair<std::uint32_t, std::uint32_t>> instructions(2000, { 0x5000, 0xebfffffe });
+  instructions.resize(2000 + 978, { 0x5004, 0xe1a0f00e });
+
+  cpp_box::profiler::Call_Graph_Profiler profiler;
+  retire(profiler, sys, instructions);
+
+  REQUIRE(profiler.nodes.size() == max_depth);
+  REQUIRE(profiler.nodes[1].self == 1);
+  REQUIRE(profiler.nodes[max_depth - 2].self == 2);
+  REQUIRE(profiler.nodes[max_depth - 1].self == 2 * (2000 - (max_depth - 1)));
+  REQUIRE(profiler.nodes[max_depth - 1].children.empty());
+  REQUIRE(profiler.inclusive().front() == instructions.size());
+}
+
+TEST_CASE("Coverage maps of two runs merge into the lines and functions executed by either")
+{
+  const auto user_ram = address(Memory_Map::USER_RAM_START);
+
+  // words outside of [begin, end) are ignored
+  cpp_box::coverage::Coverage_Map first{ user_ram, user_ram + 0x20 };
+  first.mark(user_ram - 4);
+  first.mark(user_ram);
+  first.mark(user_ram + 0x10);
+  first.mark(user_ram + 0x20);
+
+  cpp_box::coverage::Coverage_Map second{ user_ram, user_ram + 0x20 };
+  second.mark(user_ram + 4);
+  second.mark(user_ram + 0x10);
+  second.mark(user_ram + 0x18);
+
+  REQUIRE(first.words == 8);
+  REQUIRE(first.executed_words() == 2);
+  REQUIRE(!first.contains(user_ram + 0x20));
+  REQUIRE(!first.executed(user_ram - 4));
+
+  cpp_box::coverage::Coverage_Map other_code{ user_ram, user_ram + 0x40 };
+  REQUIRE_THROWS_AS(first.merge(other_code), std::invalid_argument);
+
+  first.merge(second);
+  REQUIRE(first.executed_words() == 4);
+  REQUIRE(first.executed(user_ram));
+  REQUIRE(first.executed(user_ram + 4));
+  REQUIRE(!first.executed(user_ram + 8));
+  REQUIRE(first.executed(user_ram + 0x18));
+
+  // literal pools and code outside of the map are left out
+  cpp_box::Loaded_Files files;
+  files.location_data[0x00] = cpp_box::Memory_Location{ "push {lr}", "src/main.cpp", 3, ".text", "main:" };
+  files.location_data[0x04] = cpp_box::Memory_Location{ "bl 0x00001010", "src/main.cpp", 4, ".text", "main:" };
+  files.location_data[0x08] = cpp_box::Memory_Location{ "pop {pc}", "src/main.cpp", 5, ".text", "main:" };
+  files.location_data[0x0c] = cpp_box::Memory_Location{ ".word 0x00001000", "src/main.cpp", 5, ".text", "main:" };
+  files.location_data[0x10] = cpp_box::Memory_Location{ "mov r0, #0", "src/util.cpp", 10, ".text", "helper:" };
+  files.location_data[0x14] = cpp_box::Memory_Location{ "bx lr", "src/util.cpp", 11, ".text", "helper:" };
+  files.location_data[0x18] = cpp_box::Memory_Location{ "mov r0, #1", "src/util.cpp", 12, ".text", "helper:" };
+  files.location_data[0x1c] = cpp_box::Memory_Location{ "bx lr", "src/util.cpp", 20, ".text", "dead:" };
+  files.location_data[0x20] = cpp_box::Memory_Location{ "bx lr", "src/util.cpp", 30, ".text", "outside:" };
+
+  std::ostringstream lcov;
+  cpp_box::coverage::write_lcov(lcov, first, files, "unit test-1");
+  REQUIRE(lcov.str()
+          == "TN:unit_test_1\nSF:src/main.cpp\n"
+             "FN:3,main\nFNDA:1,main\nFNF:1\nFNH:1\n"
+             "DA:3,1\nDA:4,1\nDA:5,0\nLF:3\nLH:2\nend_of_record\n"
+             "TN:unit_test_1\nSF:src/util.cpp\n"
+             "FN:20,dead\nFN:10,helper\nFNDA:0,dead\nFNDA:1,helper\nFNF:2\nFNH:1\n"
+             "DA:10,1\nDA:11,0\nDA:12,1\nDA:20,0\nLF:4\nLH:2\nend_of_record\n");
+}
+
+TEST_CASE("Direct mapped cache misses on every line that was evicted by another one of its set")
+{
+  // 4 sets of one 32 byte line, 0x00 and 0x80 share set 0
+  cpp_box::cache::Cache cache{ cpp_box::cache::Cache_Config{ 128, 1, 32, cpp_box::cache::Write_Policy::WRITE_BACK, 8 } };
+
+  REQUIRE(stalls(cache, { { 0x00, false }, { 0x1c, false }, { 0x80, false }, { 0x00, false }, { 0x20, false }, { 0x04, false } })
+          == std::vector<std::uint32_t>{ 8, 0, 8, 8, 8, 0 });
+  REQUIRE(cache.statistics.reads == 6);
+  REQUIRE(cache.statistics.read_misses == 4);
+  REQUIRE(cache.statistics.writes == 0);
+  REQUIRE(cache.statistics.write_backs == 0);
+}
+
+TEST_CASE("Set associative cache evicts the least recently used line of a set")
+{
+  // 2 sets of two ways, 0x00, 0x40 and 0x80 share set 0
+  cpp_box::cache::Cache cache{ cpp_box::cache::Cache_Config{ 128, 2, 32, cpp_box::cache::Write_Policy::WRITE_BACK, 8 } };
+
+  REQUIRE(stalls(cache, { { 0x00, false }, { 0x40, false }, { 0x00, false }, { 0x80, false }, { 0x00, false }, { 0x40, false }, { 0x20, false } })
+          == std::vector<std::uint32_t>{ 8, 8, 0, 8, 0, 8, 8 });
+  REQUIRE(cache.statistics.read_misses == 5);
+
+  // 0x40 evicted 0x80, the least recently used after the hit on 0x00
+  REQUIRE(cache.access(0x00, false).hit);
+  REQUIRE(!cache.access(0x80, false).hit);
+}
+
+TEST_CASE("Write-back caches stall to write back dirty lines, write-through caches never allocate on writes")
+{
+  cpp_box::cache::Cache_Config config{ 128, 1, 32, cpp_box::cache::Write_Policy::WRITE_BACK, 8 };
+
+  // a written line costs a second miss penalty when it is evicted
+  cpp_box::cache::Cache write_back{ config };
+  REQUIRE(stalls(write_back, { { 0x00, true }, { 0x80, false }, { 0x00, false }, { 0x00, true }, { 0x80, false }, { 0x00, false } })
+          == std::vector<std::uint32_t>{ 8, 16, 8, 0, 16, 8 });
+  REQUIRE(write_back.statistics.writes == 2);
+  REQUIRE(write_back.statistics.write_misses == 1);
+  REQUIRE(write_back.statistics.write_backs == 2);
+
+  // writes go to the write buffer without stalling, only reads fill lines
+  config.write_policy = cpp_box::cache::Write_Policy::WRITE_THROUGH;
+  cpp_box::cache::Cache write_through{ config };
+  REQUIRE(stalls(write_through, { { 0x00, true }, { 0x00, false }, { 0x00, true }, { 0x80, false }, { 0x00, true } })
+          == std::vector<std::uint32_t>{ 0, 8, 0, 8, 0 });
+  REQUIRE(write_through.statistics.writes == 3);
+  REQUIRE(write_through.statistics.write_misses == 2);
+  REQUIRE(write_through.statistics.read_misses == 2);
+  REQUIRE(write_through.statistics.write_backs == 0);
+}
+
+TEST_CASE("Cache sizes must be powers of two holding at least one set of words")
+{
+  const auto make = [](const std::uint32_t size, const std::uint32_t associativity, const std::uint32_t line_size) {
+    return cpp_box::cache::Cache{ cpp_box::cache::Cache_Config{ size, associativity, line_size, cpp_box::cache::Write_Policy::WRITE_BACK, 8 } };
+  };
+
+  REQUIRE_THROWS_AS(make(96, 1, 32), std::invalid_argument);
+  REQUIRE_THROWS_AS(make(128, 3, 32), std::invalid_argument);
+  REQUIRE_THROWS_AS(make(128, 1, 2), std::invalid_argument);
+  REQUIRE_THROWS_AS(make(64, 4, 32), std::invalid_argument);
+  REQUIRE_NOTHROW(make(64, 2, 32));
+}
+
+TEST_CASE("Branch profiler recognizes the instructions that may write the PC")
+{
+  using cpp_box::profiler::Branch_Profiler;
+
+  REQUIRE(Branch_Profiler::may_write_pc(0xea000000));  // b
+  REQUIRE(Branch_Profiler::may_write_pc(0xeb000000));  // bl
+  REQUIRE(Branch_Profiler::may_write_pc(0x0a000000));  // beq
+  REQUIRE(Branch_Profiler::may_write_pc(0xe12fff1e));  // bx lr
+  REQUIRE(Branch_Profiler::may_write_pc(0xe1a0f00e));  // mov pc, lr
+  REQUIRE(Branch_Profiler::may_write_pc(0xe08ff100));  // add pc, pc, r0, lsl #2
+  REQUIRE(Branch_Profiler::may_write_pc(0xe59ff000));  // ldr pc, [pc]
+  REQUIRE(Branch_Profiler::may_write_pc(0xe49df004));  // ldr pc, [sp], #4
+  REQUIRE(Branch_Profiler::may_write_pc(0xe8bd8010));  // ldm sp!, {r4, pc}
+
+  REQUIRE(!Branch_Profiler::may_write_pc(0xe1a00000));  // nop
+  REQUIRE(!Branch_Profiler::may_write_pc(0xe3500000));  // cmp r0, #0
+  REQUIRE(!Branch_Profiler::may_write_pc(0xe129f000));  // msr cpsr_fc, r0
+  REQUIRE(!Branch_Profiler::may_write_pc(0xe328f20f));  // msr cpsr_f, #0xf0000000
+  REQUIRE(!Branch_Profiler::may_write_pc(0xe5910000));  // ldr r0, [r1]
+  REQUIRE(!Branch_Profiler::may_write_pc(0xe580f000));  // str pc, [r0]
+  REQUIRE(!Branch_Profiler::may_write_pc(0xe8bd0010));  // ldm sp!, {r4}
+  REQUIRE(!Branch_Profiler::may_write_pc(0xe92d4010));  // push {r4, lr}
+}
+
+TEST_CASE("Branch profiler counts outcomes, flips and jump targets")
+{
+  constexpr std::uint32_t nop = 0xe1a00000;
+
+  cpp_box::arm::System<> sys{};
+  cpp_box::profiler::Branch_Profiler profiler;
+
+  // bne to 0x1200, falling through to 0x1104 when it fails
+  for (const bool taken : { true, true, false, true, false, false }) {
+    sys.z_flag(!taken);
+    profiler(sys, 0x1100, cpp_box::arm::Instruction{ 0x1a00003e });
+    profiler(sys, taken ? 0x1200 : 0x1104, cpp_box::arm::Instruction{ nop });
+  }
+
+  // mov pc, lr is unconditional, movne r0, #1 never writes the PC
+  sys.z_flag(true);
+  retire(profiler,
+         sys,
+         { { 0x1300, 0xe1a0f00e }, { 0x1000, nop }, { 0x1300, 0xe1a0f00e }, { 0x2000, nop }, { 0x1300, 0xe1a0f00e }, { 0x1000, nop } });
+  retire(profiler, sys, { { 0x1500, 0x13a00001 }, { 0x1504, nop } });
+
+  REQUIRE(profiler.branches.size() == 3);
+
+  const auto &bne = profiler.branches.at(0x1100);
+  REQUIRE(bne.passed == 3);
+  REQUIRE(bne.failed == 3);
+  REQUIRE(bne.flips == 3);
+  REQUIRE(bne.targets == std::map<std::uint32_t, std::uint64_t>{ { 0x1200, 3 } });
+
+  const auto &ret = profiler.branches.at(0x1300);
+  REQUIRE(ret.passed == 0);
+  REQUIRE(ret.failed == 0);
+  REQUIRE(ret.targets == std::map<std::uint32_t, std::uint64_t>{ { 0x1000, 2 }, { 0x2000, 1 } });
+
+  const auto &movne = profiler.branches.at(0x1500);
+  REQUIRE(movne.failed == 1);
+  REQUIRE(movne.targets.empty());
+
+  // instructions without location data sort last
+  cpp_box::Loaded_Files files;
+  files.location_data[0x100] = cpp_box::Memory_Location{ "bne 0x00001200", "src/loop.cpp", 9, ".text", "loop:" };
+
+  std::ostringstream csv;
+  cpp_box::profiler::write_branch_csv(csv, profiler, files);
+  REQUIRE(csv.str()
+          == "line,address,disassembly,passed,failed,taken_percent,flips,targets\n"
+             "loop.cpp:9,0x00001100,\"bne 0x00001200\",3,3,50.00,3,0x00001200:3\n"
+             "<unknown>,0x00001300,\"\",0,0,100.00,0,0x00001000:2 0x00002000:1\n"
+             "<unknown>,0x00001500,\"\",0,1,0.00,0,\n");
+
+  std::ostringstream json;
+  cpp_box::profiler::write_branch_json(json, profiler, files);
+  REQUIRE(json.str().rfind("{\n\"loop.cpp:9\":[\n{\"address\":\"0x00001100\",\"disassembly\":\"bne 0x00001200\",\"passed\":3,\"failed\":3,"
+                           "\"flips\":3,\"targets\":{\"0x00001200\":3}}\n],\n\"<unknown>\":[\n",
+                           0)
+          == 0);
+
+  profiler.reset();
+  REQUIRE(profiler.branches.empty());
+}
+
+TEST_CASE("Heatmap counts the loads and stores of each page and of the tracked words")
+{
+  using Heatmap_System = cpp_box::arm::System<64 * 1024,
+                                              std::vector<std::uint8_t>,
+                                              cpp_box::arm::NO_MMIO,
+                                              cpp_box::arm::NO_COPROCESSOR,
+                                              cpp_box::heatmap::Memory_Heatmap>;
+
+  auto sys            = std::make_unique<Heatmap_System>();
+  auto &heatmap       = sys->memory_observer;
+  const auto user_ram = address(Memory_Map::USER_RAM_START);
+
+  // two loads from page 2 and two stores to page 3, instruction fetches from page 1 are not counted
+  const std::array<std::uint32_t, 7> program{
+    0xe3a01a02,  // mov r1, #0x2000
+    0xe3a02a03,  // mov r2, #0x3000
+    0xe5910000,  // ldr r0, [r1]
+    0xe5910004,  // ldr r0, [r1, #4]
+    0xe5820000,  // str r0, [r2]
+    0xe5c20001,  // strb r0, [r2, #1]
+    0xeafffffe   // b .
+  };
+  for (std::uint32_t idx = 0; idx < program.size(); ++idx) { sys->write_word(user_ram + idx * 4, program[idx]); }
+
+  heatmap.track_words(0x2000, 0x2008);
+  heatmap.reset();
+  sys->setup_run(user_ram);
+  sys->run_until(sys->cycles() + 20);
+
+  REQUIRE(heatmap.pages.size() == cpp_box::system::TOTAL_RAM / cpp_box::heatmap::Memory_Heatmap::page_size);
+  REQUIRE(heatmap.pages[1].total() == 0);
+  REQUIRE(heatmap.pages[2].reads == 2);
+  REQUIRE(heatmap.pages[2].writes == 0);
+  REQUIRE(heatmap.pages[3].reads == 0);
+  REQUIRE(heatmap.pages[3].writes == 2);
+  REQUIRE(heatmap.words.size() == 2);
+  REQUIRE(heatmap.words[0].reads == 1);
+  REQUIRE(heatmap.words[1].reads == 1);
+
+  // symbols outside of the tracked words, or never accessed, are left out
+  const std::vector<cpp_box::heatmap::Data_Symbol> symbols{ { "unused", 0x2008, 0x2010 }, { "table", 0x2000, 0x2008 }, { "flag", 0x3000, 0x3004 } };
+  const auto counts = cpp_box::heatmap::symbol_counts(heatmap, symbols);
+  REQUIRE(counts.size() == 1);
+  REQUIRE(counts[0].symbol->name == "table");
+  REQUIRE(counts[0].counts.reads == 2);
+  REQUIRE(counts[0].counts.writes == 0);
+
+  // accesses past the end of the pages and while disabled are ignored
+  cpp_box::heatmap::Memory_Heatmap small{ 2 * cpp_box::heatmap::Memory_Heatmap::page_size };
+  REQUIRE(small.access(*sys, user_ram, 0x1ffc, 4, true) == 0);
+  REQUIRE(small.access(*sys, user_ram, 0x2000, 4, true) == 0);
+  small.enabled = false;
+  REQUIRE(small.access(*sys, user_ram, 0x1000, 4, false) == 0);
+  REQUIRE(small.pages.size() == 2);
+  REQUIRE(small.pages[1].writes == 1);
+  REQUIRE(small.pages[1].reads == 0);
+
+  heatmap.reset();
+  REQUIRE(heatmap.pages[2].total() == 0);
+  REQUIRE(heatmap.words[0].total() == 0);
+}